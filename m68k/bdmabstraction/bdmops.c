@@ -691,6 +691,21 @@ int bdm_query_status(void)
 #endif
 }
 
+#if BDMDriverVersion_M == BDMDriverJohns_M
+static int bdm_wait_poll(void *arg)
+{
+    int x = bdmStatus();
+
+    if(x < 0) return -1;
+    if(x & BDM_TARGETRESET) return BDM_STAT_RESET;
+    if(x & BDM_TARGETHALT) return BDM_STAT_PSTHALT;
+    if(x & BDM_TARGETSTOPPED) return BDM_STAT_HALT;
+    if(x & BDM_TARGETPOWER) return BDM_STAT_NOPWR;
+    if(x & BDM_TARGETNC) return BDM_STAT_NC;
+    return 0;
+}
+#endif
+
 /*
  * wait for stopped target
  */
@@ -709,8 +724,8 @@ int bdm_wait(void)
 	if(x & BDM_TARGETNC) return BDM_STAT_NC;
     }
 #else
-    /* not implemented */
-    return -1;
+    /* poll with the library's adaptive policy */
+    return bdmPollWait(bdm_wait_poll, NULL, -1);
 #endif
 }
 
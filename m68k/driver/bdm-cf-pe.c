@@ -326,43 +326,82 @@ cf_pe_init_hardware (struct BDM *self)
 }
 
 /*
- * Clock a word to/from the target
+ * Data register values for a bit with the clock low and high, indexed
+ * by the data bit. Computed once so the clock loop only indexes a table.
  */
-static void
-cf_pe_serial_clocker (struct BDM *self, unsigned short wval, int holdback)
-{
-  unsigned long shiftRegister;
-  unsigned char dataBit;
-  unsigned int  counter;
+static const unsigned char cf_pe_dr_bit[2][2] = {
+  { CF_PE_MAKE_DR (0),
+    CF_PE_MAKE_DR (CF_PE_DR_CLOCK_HIGH) },
+  { CF_PE_MAKE_DR (CF_PE_DR_DATA_IN),
+    CF_PE_MAKE_DR (CF_PE_DR_DATA_IN | CF_PE_DR_CLOCK_HIGH) }
+};
 
-  shiftRegister = wval;
-  counter       = 17 - holdback;
-  
-  while (counter--) {
-    dataBit = ((shiftRegister & 0x10000) ? CF_PE_DR_DATA_IN : 0);
-
-    shiftRegister <<= 1;
-    
-    bdm_outb_data (CF_PE_MAKE_DR (dataBit), self);
+#define CF_PE_NO_DELAY(_d)
 
-    if (self->delayTimer)
-      bdm_delay (self->delayTimer << 1);
+/*
+ * Clock one bit. The setup delay is twice the clock high and low delays.
+ */
+#define CF_PE_CLOCK_BIT(_delay)                                   \
+  do {                                                            \
+    const unsigned char *dr = cf_pe_dr_bit[(shiftRegister >> 16) & 1]; \
+    shiftRegister <<= 1;                                          \
+    bdm_outb_data (dr[0], self);                                  \
+    _delay (delay << 1);                                          \
+    bdm_outb_data (dr[1], self);                                  \
+    _delay (delay);                                               \
+    bdm_outb_data (dr[0], self);                                  \
+    _delay (delay);                                               \
+    if ((bdm_inb_status (self) & CF_PE_SR_DATA_OUT) == 0)         \
+      shiftRegister |= 1;                                         \
+  } while (0)
 
-    bdm_outb_data (CF_PE_MAKE_DR (dataBit | CF_PE_DR_CLOCK_HIGH), self);
-    
-    if (self->delayTimer)
-      bdm_delay (self->delayTimer);
+/*
+ * Clock the last `_bits' bits of a frame. Fully unrolled, entering the
+ * switch at the first bit to send handles the holdback.
+ */
+#define CF_PE_CLOCK_FRAME(_bits, _delay)                        \
+  switch (_bits) {                                              \
+    case 17: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 16: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 15: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 14: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 13: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 12: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 11: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 10: CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 9:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 8:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 7:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 6:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 5:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 4:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 3:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 2:  CF_PE_CLOCK_BIT (_delay); BDM_FALLTHROUGH;         \
+    case 1:  CF_PE_CLOCK_BIT (_delay);                          \
+    default: break;                                             \
+  }
 
-    bdm_outb_data (CF_PE_MAKE_DR (dataBit), self);
-    
-    if (self->delayTimer)
-      bdm_delay (self->delayTimer);
+/*
+ * Clock a word to/from the target
+ */
+static void
+cf_pe_serial_clocker (struct BDM *self, unsigned short wval, int holdback)
+{
+  unsigned long shiftRegister = wval;
+  int           delay = self->delayTimer;
 
-    if ((bdm_inb_status (self) & CF_PE_SR_DATA_OUT) == 0)
-      shiftRegister |= 1;    
+  /*
+   * With no delay set, the usual case on a slow port, use a copy of
+   * the clock loop without any delay tests.
+   */
+  if (delay == 0) {
+    CF_PE_CLOCK_FRAME (17 - holdback, CF_PE_NO_DELAY);
+  }
+  else {
+    CF_PE_CLOCK_FRAME (17 - holdback, bdm_delay);
   }
 
-  bdm_outb_data (CF_PE_MAKE_DR (0), self);
+  bdm_outb_data (cf_pe_dr_bit[0][0], self);
   
   self->readValue = shiftRegister & 0x1FFFF;
   
@@ -994,6 +1033,7 @@ bdm_cf_pe_init_self (struct BDM *self)
   self->get_status      = cf_pe_get_status;
   self->init_hardware   = cf_pe_init_hardware;
   self->serial_clock    = cf_pe_serial_clock;
+  self->serial_clocker  = cf_pe_serial_clocker;
   self->gen_bus_error   = cf_pe_gen_bus_error;
   self->restart_chip    = cf_pe_restart_chip;
   self->release_chip    = cf_pe_release_chip;
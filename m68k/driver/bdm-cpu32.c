@@ -258,15 +258,86 @@ cpu32_pd_init_hardware (struct BDM *self)
   return status;
 }
 
+/*
+ * Control port values for a bit with the clock low and high, indexed by
+ * the data bit.
+ */
+static const unsigned char cpu32_pd_cr_bit[2][2] = {
+  { CPU32_PD_CR_NOT_SINGLESTEP,
+    CPU32_PD_CR_NOT_SINGLESTEP | CPU32_PD_CR_CLOCKBAR_BKPT },
+  { CPU32_PD_CR_DATA | CPU32_PD_CR_NOT_SINGLESTEP,
+    CPU32_PD_CR_DATA | CPU32_PD_CR_NOT_SINGLESTEP | CPU32_PD_CR_CLOCKBAR_BKPT }
+};
+
+/*
+ * Clock one bit. The interface always needs a short delay on each clock
+ * edge so the delays are passed in rather than tested.
+ */
+#define CPU32_PD_CLOCK_BIT(_high, _low)                                   \
+  do {                                                                    \
+    const unsigned char *cr = cpu32_pd_cr_bit[(shiftRegister >> 16) & 1]; \
+    shiftRegister <<= 1;                                                  \
+    bdm_outb_control (cr[1], self);                                       \
+    bdm_delay (_high);                                                    \
+    if ((bdm_inb_status (self) & CPU32_PD_SR_DATA_BAR) == 0)              \
+      shiftRegister |= 1;                                                 \
+    bdm_outb_control (cr[0], self);                                       \
+    bdm_delay (_low);                                                     \
+  } while (0)
+
+/*
+ * Clock the last `_bits' bits of a frame, fully unrolled.
+ */
+#define CPU32_PD_CLOCK_FRAME(_bits, _high, _low)        \
+  switch (_bits) {                                      \
+    case 17: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 16: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 15: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 14: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 13: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 12: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 11: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 10: CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 9:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 8:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 7:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 6:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 5:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 4:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 3:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 2:  CPU32_PD_CLOCK_BIT (_high, _low); BDM_FALLTHROUGH; \
+    case 1:  CPU32_PD_CLOCK_BIT (_high, _low);          \
+    default: break;                                     \
+  }
+
+/*
+ * Clock a word to/from the target without checking the target status
+ */
+static void
+cpu32_pd_serial_clocker (struct BDM *self, unsigned short wval, int holdback)
+{
+  unsigned long shiftRegister = wval;
+
+  if (self->delayTimer == 0) {
+    CPU32_PD_CLOCK_FRAME (17 - holdback, 1, 1);
+  }
+  else {
+    int high = self->delayTimer + 1;
+    int low = (self->delayTimer >> 1) + 1;
+    CPU32_PD_CLOCK_FRAME (17 - holdback, high, low);
+  }
+  self->readValue = shiftRegister & 0x1FFFF;
+  if (self->debugFlag)
+    PRINTF (" cpu32_pd_serial_clock -- send 0x%05x  receive 0x%05x\n",
+            wval, self->readValue);
+}
+
 /*
  * Clock a word to/from the target
  */
 static int
 cpu32_pd_serial_clock (struct BDM *self, unsigned short wval, int holdback)
 {
-  unsigned long shiftRegister;
-  unsigned char dataBit;
-  unsigned int  counter;
   unsigned int  status = cpu32_pd_get_status (self);
 
   if (status & BDM_TARGETRESET)
@@ -275,22 +346,7 @@ cpu32_pd_serial_clock (struct BDM *self, unsigned short wval, int holdback)
     return BDM_FAULT_CABLE;
   if (status & BDM_TARGETPOWER)
     return BDM_FAULT_POWER;
-  shiftRegister = wval;
-  counter = 17 - holdback;
-  while (counter--) {
-    dataBit = ((shiftRegister & 0x10000) ? CPU32_PD_CR_DATA : 0);
-    shiftRegister <<= 1;
-    bdm_outb_control (dataBit | CPU32_PD_CR_NOT_SINGLESTEP | CPU32_PD_CR_CLOCKBAR_BKPT, self);
-    bdm_delay (self->delayTimer + 1);
-    if ((bdm_inb_status (self) & CPU32_PD_SR_DATA_BAR) == 0)
-      shiftRegister |= 1;
-    bdm_outb_control (dataBit | CPU32_PD_CR_NOT_SINGLESTEP, self);
-    bdm_delay ((self->delayTimer >> 1) + 1);
-  }
-  self->readValue = shiftRegister & 0x1FFFF;
-  if (self->debugFlag)
-    PRINTF (" cpu32_pd_serial_clock -- send 0x%05x  receive 0x%05x\n",
-            wval, self->readValue);
+  cpu32_pd_serial_clocker (self, wval, holdback);
   if (self->readValue & 0x10000) {
     if (self->readValue == 0x10001)
       return BDM_FAULT_BERR;
@@ -870,6 +926,7 @@ bdm_cpu32_pd_init_self (struct BDM *self)
   self->get_status    = cpu32_pd_get_status;
   self->init_hardware = cpu32_pd_init_hardware;
   self->serial_clock  = cpu32_pd_serial_clock;
+  self->serial_clocker = cpu32_pd_serial_clocker;
   self->gen_bus_error = cpu32_gen_bus_error;
   self->read_sysreg   = cpu32_read_sysreg;
   self->write_sysreg  = cpu32_write_sysreg;
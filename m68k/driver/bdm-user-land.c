@@ -178,6 +178,18 @@ os_move_out (void *dst, void *src, int size)
   return os_copy_out (dst, src, size);
 }
 
+int
+os_user_copy_in (void *dst, void *src, int size)
+{
+  return os_copy_in (dst, src, size);
+}
+
+int
+os_user_copy_out (void *dst, void *src, int size)
+{
+  return os_copy_out (dst, src, size);
+}
+
 void
 os_lock_module ()
 {
@@ -118,6 +118,18 @@ static int bdmDrvWriteLongWord (struct BDM *self, struct BDMioctl *ioc);
 static int bdmDrvWriteWord (struct BDM *self, struct BDMioctl *ioc);
 static int bdmDrvWriteByte (struct BDM *self, struct BDMioctl *ioc);
 
+/*
+ * Marks a case that falls through to the next one on purpose.
+ */
+#if defined (__has_attribute)
+#if __has_attribute (fallthrough)
+#define BDM_FALLTHROUGH __attribute__ ((fallthrough))
+#endif
+#endif
+#ifndef BDM_FALLTHROUGH
+#define BDM_FALLTHROUGH do { } while (0)
+#endif
+
 /*
  * Common processor defines.
  */
@@ -421,161 +433,218 @@ bdmBitBashSendCommandTillTargetReady (struct BDM *self, unsigned short command)
   }
 }
 
+/*
+ * Clock a command in the middle of a block transfer. Interfaces with a
+ * raw clocker do not have the target status checked on every frame. The
+ * status is checked on the first and last frame of each buffer and a
+ * not ready response is retried as usual. An illegal command response
+ * is recovered with a Forced TA on a Coldfire that supports it, the
+ * same as the checked serial clock does.
+ */
+static int
+bdmBitBashStreamCommand (struct BDM *self, unsigned short command, int checked)
+{
+  if (checked || !self->serial_clocker)
+    return bdmBitBashSendCommandTillTargetReady (self, command);
+
+  (self->serial_clocker) (self, command, 0);
+
+  if ((self->readValue & 0x10000) == 0)
+    return 0;
+  if (self->readValue == 0x10001)
+    return BDM_FAULT_BERR;
+  if (self->readValue != 0x10000) {
+    if ((self->processor != BDM_CPU32) &&
+        (self->cf_debug_ver >= CF_BDM_REV_D)) {
+      if (self->debugFlag)
+        PRINTF (" bdmBitBashStreamCommand -- forced ta\n");
+      (self->serial_clocker) (self, BDM_FORCED_TA_CMD, 0);
+      (self->serial_clocker) (self, BDM_NOP_CMD, 0);
+      (self->serial_clocker) (self, BDM_NOP_CMD, 0);
+      return BDM_FAULT_FORCED_TA;
+    }
+    return BDM_FAULT_NVC;
+  }
+
+  return bdmBitBashSendCommandTillTargetReady (self, command);
+}
+
+/*
+ * Clock a FILL data word. The response is not used.
+ */
+static int
+bdmBitBashStreamData (struct BDM *self, unsigned short data)
+{
+  if (!self->serial_clocker)
+    return bdmDrvSerialClock (self, data, 0);
+
+  (self->serial_clocker) (self, data, 0);
+  return 0;
+}
+
+/*
+ * The largest DUMP or FILL operand size for the bytes left.
+ */
+static int
+bdmBitBashStreamSize (int count)
+{
+  if (count >= 4)
+    return 4;
+  if (count >= 2)
+    return 2;
+  return 1;
+}
+
+static int
+bdmBitBashStreamCmdSize (int size)
+{
+  if (size == 4)
+    return BDM_SIZE_LONG;
+  if (size == 2)
+    return BDM_SIZE_WORD;
+  return BDM_SIZE_BYTE;
+}
+
+/*
+ * Abandon a block transfer. A NOP collects the response to the DUMP or
+ * FILL in flight so the next command starts on a clean frame.
+ */
+static void
+bdmBitBashStreamDrain (struct BDM *self)
+{
+  if (self->debugFlag)
+    PRINTF ("bdmBitBashStreamDrain - dump:%d fill:%d\n",
+            self->streamDump, self->streamFill);
+
+  bdmDrvSerialClock (self, BDM_NOP_CMD, 0);
+  self->streamDump = 0;
+  self->streamFill = 0;
+}
+
 /*
  * Fill I/O buffer with data from target
+ *
+ * The response to a DUMP is returned while the next command is clocked
+ * so the next DUMP is sent with the last word of the current one. When
+ * more of the read follows this buffer (streamLeft) the last DUMP stays
+ * in flight (streamDump) and the next buffer carries on from it.
  */
 static int
 bdmBitBashFillBuf (struct BDM *self, int count)
 {
   unsigned short *sp = (unsigned short *)self->ioBuffer;
-  int cmd;
-  int err;
+  int            left = count + self->streamLeft;
+  int            size = self->streamDump;
+  int            err;
 
   if (self->debugFlag)
-    PRINTF ("bdmBitBashFillBuf - count:%d\n", count);
+    PRINTF ("bdmBitBashFillBuf - count:%d left:%d\n", count, left);
 
   if (count == 0)
     return 0;
 
-  if (count >= 4)
-    cmd = BDM_DUMP_CMD | BDM_SIZE_LONG;
-  else if (count >= 2)
-    cmd = BDM_DUMP_CMD | BDM_SIZE_WORD;
-  else
-    cmd = BDM_DUMP_CMD | BDM_SIZE_BYTE;
+  if (!size) {
+    size = bdmBitBashStreamSize (left);
+    err = bdmDrvSerialClock (self, BDM_DUMP_CMD | bdmBitBashStreamCmdSize (size), 0);
+    if (err) {
+      bdmBitBashStreamDrain (self);
+      return err;
+    }
+  }
 
-  err = bdmDrvSerialClock (self, cmd, 0);
-  if (err)
-    return err;
+  while (count > 0) {
+    unsigned short next;
+    int            last = count <= size;
 
-  for (;;) {
-    switch (count) {
-      case 1:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
-        if (err)
-          return err;
-        *(unsigned char *)sp = self->readValue;
-        return 0;
-
-      case 2:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
-        if (err)
-          return err;
-        *sp = self->readValue;
-        return 0;
-
-      case 3:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_DUMP_CMD | BDM_SIZE_BYTE);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        count -= 2;
-        break;
-
-      case 4:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        err = bdmDrvSerialClock (self, BDM_NOP_CMD, 0);
-        if (err)
-          return err;
-        *sp = self->readValue;
-        return 0;
-
-      case 5:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_DUMP_CMD | BDM_SIZE_BYTE);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        count -= 4;
-        break;
-
-      case 6:
-      case 7:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_DUMP_CMD | BDM_SIZE_WORD);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        count -= 4;
-        break;
-
-      default:
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        err = bdmBitBashSendCommandTillTargetReady (self, BDM_DUMP_CMD | BDM_SIZE_LONG);
-        if (err)
-          return err;
-        *sp++ = self->readValue;
-        count -= 4;
-        break;
+    left -= size;
+    count -= size;
+
+    if (left) {
+      self->streamDump = bdmBitBashStreamSize (left);
+      next = BDM_DUMP_CMD | bdmBitBashStreamCmdSize (self->streamDump);
     }
+    else {
+      self->streamDump = 0;
+      next = BDM_NOP_CMD;
+    }
+
+    if (size == 4) {
+      err = bdmBitBashStreamCommand (self, BDM_NOP_CMD, 0);
+      if (err) {
+        bdmBitBashStreamDrain (self);
+        return err;
+      }
+      *sp++ = self->readValue;
+    }
+
+    err = bdmBitBashStreamCommand (self, next, last);
+    if (err) {
+      bdmBitBashStreamDrain (self);
+      return err;
+    }
+
+    if (size == 1)
+      *(unsigned char *)sp = self->readValue;
+    else
+      *sp++ = self->readValue;
+
+    size = self->streamDump;
   }
+
+  return 0;
 }
 
 /*
  * Send contents of I/O buffer to target
+ *
+ * Each FILL command returns the response to the previous one. The NOP
+ * that collects the last response is only sent at the end of the write.
  */
 static int
 bdmBitBashSendBuf (struct BDM *self, int count)
 {
   unsigned short *sp = (unsigned short *)self->ioBuffer;
-  int cmd;
-  int err;
+  int            first = 1;
+  int            size;
+  int            err;
 
   if (self->debugFlag)
-    PRINTF ("bdmBitBashSendBuf - count:%d\n", count);
+    PRINTF ("bdmBitBashSendBuf - count:%d left:%d\n", count, self->streamLeft);
 
   if (count == 0)
     return 0;
 
-  for (;;) {
-    if (count >= 4)
-      cmd = BDM_FILL_CMD | BDM_SIZE_LONG;
-    else if (count >= 2)
-      cmd = BDM_FILL_CMD | BDM_SIZE_WORD;
-    else if (count >= 1)
-      cmd = BDM_FILL_CMD | BDM_SIZE_BYTE;
-    else
-      cmd = BDM_NOP_CMD;
-    err = bdmBitBashSendCommandTillTargetReady (self, cmd);
-    if (err)
+  while (count > 0) {
+    size = bdmBitBashStreamSize (count);
+    err = bdmBitBashStreamCommand (self,
+                                   BDM_FILL_CMD | bdmBitBashStreamCmdSize (size),
+                                   first);
+    if (err) {
+      bdmBitBashStreamDrain (self);
       return err;
-    if (count >= 4) {
-      err = bdmDrvSerialClock (self, *sp++, 0);
-      if (err)
-        return err;
-      err = bdmDrvSerialClock (self, *sp++, 0);
-      if (err)
-        return err;
-      count -= 4;
-    }
-    else if (count >= 2) {
-      err = bdmDrvSerialClock (self, *sp++, 0);
-      if (err)
-        return err;
-      count -= 2;
     }
-    else if (count >= 1) {
-      err = bdmDrvSerialClock (self, *(unsigned char *)sp, 0);
-      if (err)
-        return err;
-      count -= 1;
+    first = 0;
+    self->streamFill = 1;
+    if (size == 1) {
+      err = bdmBitBashStreamData (self, *(unsigned char *)sp);
     }
     else {
-      return 0;
+      err = bdmBitBashStreamData (self, *sp++);
+      if (!err && (size == 4))
+        err = bdmBitBashStreamData (self, *sp++);
     }
+    if (err) {
+      bdmBitBashStreamDrain (self);
+      return err;
+    }
+    count -= size;
   }
+
+  if (self->streamLeft)
+    return 0;
+
+  self->streamFill = 0;
+  return bdmBitBashSendCommandTillTargetReady (self, BDM_NOP_CMD);
 }
 
 /*
@@ -814,6 +883,26 @@ bdmDrvSerialClock (struct BDM *self, unsigned short wval, int holdback)
   return (self->serial_clock) (self, wval, holdback);
 }
 
+/*
+ * Clock a number of NOP frames to measure the interface bit rate. The
+ * count is limited so a bad argument cannot hold the interface.
+ */
+static int
+bdmDrvClockBench (struct BDM *self, int frames)
+{
+  int err = 0;
+
+  if (!self->serial_clock)
+    return EINVAL;
+  if (frames > BDM_CLOCK_BENCH_MAX_FRAMES)
+    return EINVAL;
+
+  while ((frames-- > 0) && !err)
+    err = (self->serial_clock) (self, BDM_NOP_CMD, 0);
+
+  return err;
+}
+
 /*
  * Generate a bus error on the target.
  */
@@ -1235,6 +1324,81 @@ bdm_close (unsigned int minor)
   return 0;
 }
 
+/*
+ * Handle a BDMioctl argument request. The argument is in kernel space.
+ */
+static int
+bdmDrvIocRequest (struct BDM *self, unsigned int cmd, struct BDMioctl *ioc)
+{
+  int err;
+
+  switch (cmd) {
+    case BDM_READ_CTLREG:
+      err = bdmDrvReadSystemRegister (self, ioc, BDM_SYS_REG_MODE_CONTROL);
+      break;
+
+    case BDM_READ_DBREG:
+      err = bdmDrvReadSystemRegister (self, ioc, BDM_SYS_REG_MODE_DEBUG);
+      break;
+
+    case BDM_READ_REG:
+      err = bdmDrvReadProcessorRegister (self, ioc);
+      break;
+
+    case BDM_READ_SYSREG:
+      err = bdmDrvReadSystemRegister (self, ioc, BDM_SYS_REG_MODE_MAPPED);
+      break;
+
+    case BDM_READ_LONGWORD:
+      err = bdmDrvReadLongWord (self, ioc);
+      break;
+
+    case BDM_READ_WORD:
+      err = bdmDrvReadWord (self, ioc);
+      break;
+
+    case BDM_READ_BYTE:
+      err = bdmDrvReadByte (self, ioc);
+      break;
+
+    case BDM_WRITE_CTLREG:
+      err = bdmDrvWriteSystemRegister (self, ioc, BDM_SYS_REG_MODE_CONTROL);
+      break;
+
+    case BDM_WRITE_DBREG:
+      err = bdmDrvWriteSystemRegister (self, ioc, BDM_SYS_REG_MODE_DEBUG);
+      break;
+
+    case BDM_WRITE_SYSREG:
+      err = bdmDrvWriteSystemRegister (self, ioc, BDM_SYS_REG_MODE_MAPPED);
+      break;
+
+    case BDM_WRITE_REG:
+      err = bdmDrvWriteProcessorRegister (self, ioc);
+      break;
+
+    case BDM_WRITE_LONGWORD:
+      err = bdmDrvWriteLongWord (self, ioc);
+      break;
+
+    case BDM_WRITE_WORD:
+      err = bdmDrvWriteWord (self, ioc);
+      break;
+
+    case BDM_WRITE_BYTE:
+      err = bdmDrvWriteByte (self, ioc);
+      break;
+
+    default:
+      err = EINVAL;
+      break;
+  }
+
+  return err;
+}
+
+static int bdm_exec_batch (unsigned int minor, unsigned long arg);
+
 BDM_STATIC int
 bdm_ioctl (unsigned int minor, unsigned int cmd, unsigned long arg)
 {
@@ -1249,6 +1413,9 @@ bdm_ioctl (unsigned int minor, unsigned int cmd, unsigned long arg)
   if (self->debugFlag > 3)
     PRINTF ("BDMioctl cmd:0x%x\n", cmd);
 
+  if (cmd == BDM_EXEC_BATCH)
+    return bdm_exec_batch (minor, arg);
+
   switch (cmd) {
     case BDM_READ_REG:
     case BDM_READ_CTLREG:
@@ -1270,6 +1437,7 @@ bdm_ioctl (unsigned int minor, unsigned int cmd, unsigned long arg)
     case BDM_SPEED:
     case BDM_DEBUG:
     case BDM_SET_CF_PST:
+    case BDM_CLOCK_BENCH:
       err = os_copy_in ((void*) &iarg, (void*) arg, sizeof iarg);
       if (self->debugFlag > 3)
         PRINTF ("BDMioctl cmd->iarg:0x%x\n", iarg);
@@ -1332,59 +1500,20 @@ bdm_ioctl (unsigned int minor, unsigned int cmd, unsigned long arg)
       break;
 
     case BDM_READ_CTLREG:
-      err = bdmDrvReadSystemRegister (self, &ioc, BDM_SYS_REG_MODE_CONTROL);
-      break;
-
     case BDM_READ_DBREG:
-      err = bdmDrvReadSystemRegister (self, &ioc, BDM_SYS_REG_MODE_DEBUG);
-      break;
-
     case BDM_READ_REG:
-      err = bdmDrvReadProcessorRegister (self, &ioc);
-      break;
-
     case BDM_READ_SYSREG:
-      err = bdmDrvReadSystemRegister (self, &ioc, BDM_SYS_REG_MODE_MAPPED);
-      break;
-
     case BDM_READ_LONGWORD:
-      err = bdmDrvReadLongWord (self, &ioc);
-      break;
-
     case BDM_READ_WORD:
-      err = bdmDrvReadWord (self, &ioc);
-      break;
-
     case BDM_READ_BYTE:
-      err = bdmDrvReadByte (self, &ioc);
-      break;
-
     case BDM_WRITE_CTLREG:
-      err = bdmDrvWriteSystemRegister (self, &ioc, BDM_SYS_REG_MODE_CONTROL);
-      break;
-
     case BDM_WRITE_DBREG:
-      err = bdmDrvWriteSystemRegister (self, &ioc, BDM_SYS_REG_MODE_DEBUG);
-      break;
-
     case BDM_WRITE_SYSREG:
-      err = bdmDrvWriteSystemRegister (self, &ioc, BDM_SYS_REG_MODE_MAPPED);
-      break;
-
     case BDM_WRITE_REG:
-      err = bdmDrvWriteProcessorRegister (self, &ioc);
-      break;
-
     case BDM_WRITE_LONGWORD:
-      err = bdmDrvWriteLongWord (self, &ioc);
-      break;
-
     case BDM_WRITE_WORD:
-      err = bdmDrvWriteWord (self, &ioc);
-      break;
-
     case BDM_WRITE_BYTE:
-      err = bdmDrvWriteByte (self, &ioc);
+      err = bdmDrvIocRequest (self, cmd, &ioc);
       break;
 
     case BDM_GET_CPU_TYPE:
@@ -1407,6 +1536,10 @@ bdm_ioctl (unsigned int minor, unsigned int cmd, unsigned long arg)
       self->cf_use_pst = iarg;
       break;
 
+    case BDM_CLOCK_BENCH:
+      err = bdmDrvClockBench (self, iarg);
+      break;
+
     default:
       err = EINVAL;
       break;
@@ -1440,6 +1573,49 @@ bdm_ioctl (unsigned int minor, unsigned int cmd, unsigned long arg)
   return err;
 }
 
+/*
+ * Run a batch of BDMioctl requests. The operations are copied in one at
+ * a time so the caller's array can be any size. The array is always in
+ * user space, even where the kernel has copied in the ioctl argument.
+ */
+static int
+bdm_exec_batch (unsigned int minor, unsigned long arg)
+{
+  struct BDM        *self = &bdm_device_info[minor];
+  struct BDMbatch   batch;
+  struct BDMbatchOp *op;
+  struct BDMbatchOp kop;
+  unsigned int      i;
+  int               err;
+
+  err = os_copy_in ((void*) &batch, (void*) arg, sizeof batch);
+  if (err)
+    return err;
+
+  for (i = 0, op = batch.ops; i < batch.count; i++, op++) {
+    err = os_user_copy_in ((void*) &kop, (void*) op, sizeof kop);
+    if (err)
+      return err;
+
+    if (self->debugFlag > 3)
+      PRINTF ("BDMioctl batch op:%u cmd:0x%x\n", i, kop.code);
+
+    err = bdmDrvIocRequest (self, kop.code, &kop.ioc);
+
+    if (!err &&
+        os_user_copy_out ((void*) &op->ioc, (void*) &kop.ioc, sizeof kop.ioc))
+      return EFAULT;
+
+    if (os_user_copy_out ((void*) &op->error, (void*) &err, sizeof err))
+      return EFAULT;
+
+    if (err)
+      return err;
+  }
+
+  return 0;
+}
+
 BDM_STATIC int
 bdm_read (unsigned int minor, unsigned char *buf, int count)
 {
@@ -1448,17 +1624,22 @@ bdm_read (unsigned int minor, unsigned char *buf, int count)
   int        err;
 
   nleft = count;
+  self->streamDump = 0;
   while (nleft) {
     if (nleft > sizeof self->ioBuffer)
       ncopy = sizeof self->ioBuffer;
     else
       ncopy = nleft;
+    self->streamLeft = nleft - ncopy;
     err = bdmDrvFillBuf (self, ncopy);
     if (err)
       return err;
     err = os_move_out (buf, self->ioBuffer, ncopy);
-    if (err)
+    if (err) {
+      if (self->streamDump)
+        bdmBitBashStreamDrain (self);
       return err;
+    }
     nleft -= ncopy;
 #ifndef BUF_INCREMENTED_BY_MOVE_OUT
     buf += ncopy;
@@ -1475,14 +1656,19 @@ bdm_write (unsigned int minor, unsigned char *buf, int count)
   int        err;
 
   nleft = count;
+  self->streamFill = 0;
   while (nleft) {
     if (nleft > sizeof self->ioBuffer)
       ncopy = sizeof self->ioBuffer;
     else
       ncopy = nleft;
     err = os_move_in (self->ioBuffer, (void*) buf, ncopy);
-    if (err)
+    if (err) {
+      if (self->streamFill)
+        bdmBitBashStreamDrain (self);
       return err;
+    }
+    self->streamLeft = nleft - ncopy;
     err = bdmDrvSendBuf (self, ncopy);
     if (err)
       return err;
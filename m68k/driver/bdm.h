@@ -198,6 +198,36 @@ struct BDMioctl {
 #define BDM_GET_CF_PST     _IOR('B', 33, int)
 #define BDM_SET_CF_PST     _IOR('B', 34, int)
 
+/*
+ * Batched requests. The operations are BDMioctl argument requests
+ * (register, control, debug and system register and memory accesses)
+ * processed in order until one fails. The error field of each processed
+ * operation holds 0 or the error code. Operations not processed are not
+ * touched.
+ */
+struct BDMbatchOp {
+    unsigned int      code;
+    int               error;
+    struct BDMioctl   ioc;
+};
+
+struct BDMbatch {
+    unsigned int      count;
+    struct BDMbatchOp *ops;
+};
+
+#define BDM_EXEC_BATCH     _IOWR('B', 35, struct BDMbatch)
+
+/*
+ * Clock the argument's count of NOP frames through the interface's
+ * serial clock. Used to measure the bit rate of bit-banged interfaces.
+ * Interfaces that do not clock frames on the host, or a count above
+ * BDM_CLOCK_BENCH_MAX_FRAMES, return EINVAL. The frames are clocked
+ * without a break so the limit keeps a run short on a slow port.
+ */
+#define BDM_CLOCK_BENCH    _IOW('B', 36, int)
+#define BDM_CLOCK_BENCH_MAX_FRAMES (1 << 16)
+
 /*
  * bits in status word returned by BDM_GET_STATUS ioctl
  */
@@ -343,6 +373,15 @@ struct BDM {
    */
   char         ioBuffer[512];
   unsigned int readValue;
+
+  /*
+   * Block transfer stream state. The bytes of a read or write left after
+   * the buffer being moved, the size of a DUMP command in flight and if
+   * the response to the last FILL is still to be collected.
+   */
+  int          streamLeft;
+  int          streamDump;
+  int          streamFill;
   
   /*
    * Interface specific handlers
@@ -350,6 +389,7 @@ struct BDM {
   int (*get_status)(struct BDM *self);
   int (*init_hardware) (struct BDM *self);
   int (*serial_clock) (struct BDM *self, unsigned short wval, int holdback);
+  void (*serial_clocker) (struct BDM *self, unsigned short wval, int holdback);
   int (*gen_bus_error) (struct BDM *self);
   int (*restart_chip) (struct BDM *self);
   int (*release_chip) (struct BDM *self);
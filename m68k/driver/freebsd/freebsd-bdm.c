@@ -140,6 +140,40 @@ os_copy_out (void *dst, void *src, int size)
   return 0;
 }
 
+/**
+ * Copies data from a user-space address to kernel-space address.
+ *
+ * The ioctl argument has already been copied in by the kernel so
+ * os_copy_in() is a plain copy. Pointers held in the argument still
+ * refer to user-space and are copied with this function.
+ *
+ * Param dst   Kernel-space address to copy to.
+ * Param src   User-space address to copy from.
+ * Param size  Number of bytes to copy.
+ * 
+ * Returns     0 if successful.
+ */
+static int
+os_user_copy_in (void *dst, void *src, int size)
+{
+  return copyin(src, dst, (size_t)size);
+}
+
+/**
+ * Copies data from a kernel-space address to user-space address.
+ *
+ * Param dst   User-space address to copy to.
+ * Param src   Kernel-space address to copy from.
+ * Param size  Number of bytes to copy.
+ * 
+ * Returns     0 if successful.
+ */
+static int
+os_user_copy_out (void *dst, void *src, int size)
+{
+  return copyout(src, dst, (size_t)size);
+}
+
 /**
  * Moves data from user-space address to kernel-space address.
  *
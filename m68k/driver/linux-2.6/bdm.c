@@ -137,6 +137,8 @@ os_copy_in (void *dst, void *src, int size)
 }
 
 #define os_move_out os_copy_out
+#define os_user_copy_in os_copy_in
+#define os_user_copy_out os_copy_out
 
 static int
 os_copy_out (void *dst, void *src, int size)
@@ -115,6 +115,9 @@ os_copy_out (void *dst, void *src, int size)
   return 0;
 }
 
+#define os_user_copy_in os_copy_in
+#define os_user_copy_out os_copy_out
+
 static void
 os_lock_module ()
 {
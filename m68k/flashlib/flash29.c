@@ -349,6 +349,169 @@ prog_entry(void)
 {
   return "flash29_prog";
 }
+
+/* Number of bus words programmed by one batch in host mode.
+ */
+#define FLASH29_BATCH 64
+
+/* Append a bus width write of VAL to ADR to the batch OPS.
+ */
+static int
+batch_write(chiptype_t * ct, struct BDMbatchOp *ops, int n,
+            uint32_t adr, uint32_t val)
+{
+  switch (ct->bus_width) {
+    case 1:
+      ops[n].code = BDM_WRITE_BYTE;
+      break;
+    case 2:
+      ops[n].code = BDM_WRITE_WORD;
+      break;
+    default:
+      ops[n].code = BDM_WRITE_LONGWORD;
+      break;
+  }
+  ops[n].error = 0;
+  ops[n].ioc.address = adr;
+  ops[n].ioc.value = val;
+  return n + 1;
+}
+
+/* Programming for host mode. Every single BDM access is a round trip to
+   the interface, so the command sequences for a run of bus words are
+   compiled into one batch: just program command and data in unlock
+   bypass mode, the full unlock sequence otherwise. Words that are all
+   ones are left out. The chip is not polled per word. At the end of a
+   batch the last word is polled and the batch is read back as a block.
+   Words that did not make it, e.g. because the interface was faster
+   than the chip, are programmed again the slow way.
+ */
+static uint32_t
+flash29_prog_host(chiptype_t * ct,
+                  uint32_t pos, unsigned char *data, uint32_t cnt)
+{
+  struct BDMbatchOp ops[FLASH29_BATCH * 5];
+  unsigned char buf[FLASH29_BATCH * 4];
+  unsigned char rbuf[FLASH29_BATCH * 4];
+  const alg_info_t *alg_info = ct->alg_info;
+  void (*wr_func) (uint32_t, uint32_t);
+  uint32_t siz = ct->bus_width;
+  uint32_t reg1 = ct->reg1;
+  uint32_t reg2 = ct->reg2;
+  uint32_t cmd_bypass = alg_info->cmd_bypass;
+  uint32_t start = pos & ~(siz - 1);
+  uint32_t lead = pos - start;
+  uint32_t total = (lead + cnt + siz - 1) & ~(siz - 1);
+  uint32_t adr, off, last, i, j, k, n;
+  int ret = 1;
+
+  set_chip_access(ct, siz);
+  wr_func = ct->wr_func;
+
+  if (cmd_bypass) {
+    wr_func(reg1, alg_info->cmd_reset);
+    wr_func(reg1, alg_info->cmd_unlock1);
+    wr_func(reg2, alg_info->cmd_unlock2);
+    wr_func(reg1, cmd_bypass);
+  }
+
+  /* Offsets from START are used so flash ending at 0xffffffff does not
+     wrap.
+   */
+  for (off = 0; ret && off < total; off += n) {
+    int nops = 0;
+
+    adr = start + off;
+    n = total - off;
+    if (n > FLASH29_BATCH * siz)
+      n = FLASH29_BATCH * siz;
+
+    /* Bytes of the bus words outside the data keep their contents.
+     */
+    for (k = 0; k < n; k++) {
+      if (off + k < lead || off + k - lead >= cnt)
+        buf[k] = chip_rd_char(adr + k);
+      else
+        buf[k] = data[off + k - lead];
+    }
+
+    last = 0;
+    for (k = 0; k < n; k += siz) {
+      uint32_t val = 0;
+
+      for (j = 0; j < siz; j++)
+        val = (val << 8) | buf[k + j];
+      if (val == ct->bus_mask)
+        continue;
+      if (!cmd_bypass) {
+        nops = batch_write(ct, ops, nops, reg1, alg_info->cmd_reset);
+        nops = batch_write(ct, ops, nops, reg1, alg_info->cmd_unlock1);
+        nops = batch_write(ct, ops, nops, reg2, alg_info->cmd_unlock2);
+      }
+      nops = batch_write(ct, ops, nops, reg1, alg_info->cmd_program);
+      nops = batch_write(ct, ops, nops, adr + k, val);
+      last = k + 1;
+    }
+
+    if (!nops)
+      continue;
+
+    if (bdmExecBatch(ops, nops) < 0) {
+      printf("flash29: batch at 0x%08lx: %s\n",
+             (unsigned long) adr, bdmErrorString());
+      ret = 0;
+      break;
+    }
+
+    /* Deferred check: once the last word is done the others are too.
+     */
+    k = last - 1;
+    for (i = 0, j = 0; j < siz; j++)
+      i = (i << 8) | buf[k + j];
+    wait_chip(ct, adr + k, i);
+
+    if (bdmReadMemory(adr, rbuf, n) < 0) {
+      printf("flash29: read back at 0x%08lx: %s\n",
+             (unsigned long) adr, bdmErrorString());
+      ret = 0;
+      break;
+    }
+
+    for (k = 0; ret && k < n; k += siz) {
+      uint32_t val = 0;
+
+      for (j = 0; j < siz; j++) {
+        if (rbuf[k + j] != buf[k + j])
+          break;
+      }
+      if (j == siz)
+        continue;
+
+      for (j = 0; j < siz; j++)
+        val = (val << 8) | buf[k + j];
+      if (!cmd_bypass) {
+        wr_func(reg1, alg_info->cmd_reset);
+        wr_func(reg1, alg_info->cmd_unlock1);
+        wr_func(reg2, alg_info->cmd_unlock2);
+      }
+      wr_func(reg1, alg_info->cmd_program);
+      wr_func(adr + k, val);
+      if (!wait_chip(ct, adr + k, val)) {
+        ret = 0;
+        n = k;
+      }
+    }
+  }
+
+  if (cmd_bypass) {
+    wr_func(reg1, alg_info->cmd_resbypass1);
+    wr_func(reg2, alg_info->cmd_resbypass2);
+  }
+
+  if (off <= lead)
+    return 0;
+  return off - lead > cnt ? cnt : off - lead;
+}
 #endif
 
 /* The actual programming function
@@ -372,6 +535,10 @@ flash29_prog(void *chip_descr,
   uint32_t cmd_unlock1 = alg_info->cmd_unlock1;
   uint32_t cmd_unlock2 = alg_info->cmd_unlock2;
 
+#if HOST_FLASHING
+  return flash29_prog_host(ct, pos, data, cnt);
+#endif
+
   set_chip_access(ct, siz);
   
   wr_func = ct->wr_func;
@@ -670,6 +837,54 @@ download_struct(void *chip_descr, uint32_t adr)
   return alg_adr + sizeof(*alg);
 }
 
+/* The 29xxx chips have no common sector layout. Uniform sectors of the
+   size in the FLASH_SECTOR_SIZE variable are assumed if it is set.
+ */
+static int
+flash29_sector(void *chip_descr, uint32_t adr, flash_sector_t *sec)
+{
+  chiptype_t *ct = chip_descr;
+  uint32_t size;
+
+  flash_get_var("FLASH_SECTOR_SIZE", &size, 0);
+  if (!size || adr < ct->adr)
+    return 0;
+
+  sec->start = adr - ((adr - ct->adr) % size);
+  sec->size = size;
+  sec->erase_arg = (sec->start - ct->adr) >> ct->shift;
+  sec->erase_wait = 1;
+  sec->blank_chk = 0;
+  sec->no_reprogram = 0;
+  return 1;
+}
+
+/* Check on a queued erase without waiting for it. A chip that is done
+   reads erased, DQ5 of a chip still busy signals a timeout.
+ */
+static int
+flash29_erase_poll(void *chip_descr)
+{
+  chiptype_t *ct = chip_descr;
+  uint32_t rval = ct->rd_func(ct->wait_adr) & ct->bus_mask;
+  uint32_t i;
+
+  if (rval == ct->bus_mask)
+    return 1;
+
+  for (i = 0; i < ct->bus_width; i += ct->chip_width) {
+    uint32_t chip = (rval >> (i << 3)) & ct->chip_mask;
+
+    if (chip != ct->chip_mask && (chip & ct->alg_info->timeout_mask)) {
+      /* DQ5 and the end of the erase may have coincided. */
+      rval = ct->rd_func(ct->wait_adr) & ct->bus_mask;
+      return rval == ct->bus_mask ? 1 : -1;
+    }
+  }
+
+  return 0;
+}
+
 void
 init_flash29(int num)
 {
@@ -678,6 +893,8 @@ init_flash29(int num)
                      flash29_search_chip,
                      flash29_erase, 0, flash29_erase_wait, flash29_prog,
                      prog_entry);
+  register_sector_map(num, flash29_sector);
+  register_erase_poll(num, flash29_erase_poll);
 }
 
 #else
@@ -32,6 +32,7 @@
 #include "flashintelc3.h"
 #include "flashintelp30.h"
 #include "flash_filter.h"
+#include "flashcrc.h"
 
 #if HOST_FLASHING
 # include <errno.h>
@@ -44,6 +45,7 @@
 # include <string.h>
 # include <sys/types.h> 
 # include <sys/stat.h> 
+# include <sys/time.h>
 # include <unistd.h>
 # include <elf-utils.h>
 # include <BDMlib.h>
@@ -63,6 +65,8 @@ typedef struct
   int (*erase_wait) (void *);
   uint32_t (*prog) (void *, uint32_t, unsigned char *, uint32_t);
   char *(*prog_entry) (void);
+  int (*sector) (void *, uint32_t, flash_sector_t *);
+  int (*erase_poll) (void *);
   unsigned char *p_code;
   uint32_t p_entry;
   uint32_t p_len;
@@ -113,6 +117,27 @@ typedef struct variable_s
 
 static variable_t *s_variables = 0;
 
+#if HOST_FLASHING
+
+/* The plugin in target RAM is either the flash plugin of PLUGIN_AREA or
+   the CRC plugin. They may share the RAM so loading one drops the other.
+ */
+static area_t *plugin_area = NULL;
+
+/* The CRC plugin.
+ */
+static struct
+{
+  unsigned char *p_code;
+  uint32_t p_entry;
+  uint32_t p_len;
+  uint32_t ram;
+  uint32_t len;
+  int loaded;
+} crc_plugin;
+
+#endif
+
 /* Initialize all known algorithms, determine maximum size of chip descriptors
    and register RAM for whole address range.
  */
@@ -160,6 +185,8 @@ register_algorithm(int num,
   algorithm[num].erase_wait = erase_wait;
   algorithm[num].prog = prog;
   algorithm[num].prog_entry = prog_entry;
+  algorithm[num].sector = NULL;
+  algorithm[num].erase_poll = NULL;
 
   algorithm[num].p_code = NULL;
   algorithm[num].p_entry = 0;
@@ -168,6 +195,25 @@ register_algorithm(int num,
   algorithm[num].len = 0;
 }
 
+/* Drivers knowing the sector layout of their chips register the lookup
+   function here, after register_algorithm.
+ */
+void
+register_sector_map(int num,
+                    int (*sector) (void *, uint32_t, flash_sector_t *))
+{
+  algorithm[num].sector = sector;
+}
+
+/* Drivers that can check on an erase without blocking register the poll
+   function here, after register_algorithm.
+ */
+void
+register_erase_poll(int num, int (*erase_poll) (void *))
+{
+  algorithm[num].erase_poll = erase_poll;
+}
+
 /* Search memory area where ADR belongs to.
  */
 static area_t *
@@ -184,6 +230,47 @@ search_area (adr)
 
 #if HOST_FLASHING
 
+/* Copy the code of the section holding the plugin entry symbol NAME.
+ */
+static int
+elf_plugin_code(elf_handle *handle, const char *name,
+                int (*prfunc) (const char *format, ...),
+                unsigned char **p_code, uint32_t *p_entry, uint32_t *p_len)
+{
+  GElf_Sym entrysym;
+  GElf_Shdr shdr;
+  void *data;
+  uint32_t size;
+
+  if (!elf_get_symbol(handle, name, &entrysym))
+  {
+    if (prfunc)
+      prfunc("could not find prog entry symbol %s", name);
+    return 0;
+  }
+
+  if (!elf_get_section_hdr(handle, entrysym.st_shndx, &shdr))
+  {
+    if (prfunc)
+      prfunc("could not get section header for prog entry");
+    return 0;
+  }
+
+  data = elf_get_section_data(handle, entrysym.st_shndx, &size);
+  if (!data)
+  {
+    if (prfunc)
+      prfunc("could not get section data for prog entry");
+    return 0;
+  }
+
+  *p_entry = entrysym.st_value;
+  *p_len = size;
+  *p_code = malloc(size);
+  memcpy(*p_code, data, size);
+  return 1;
+}
+
 /* register target flash plugins. The adr/len defines a RAM area on the
    target that can be used to download plugin and contents.
  */
@@ -244,48 +331,34 @@ elf_flash_plugin_load(int (*prfunc) (const char *format, ...),
     return 0;
   }
 
-  for (i = 0; i < NUMOF(algorithm); i++)
+  if (STREQ(dmagic, FLASHCRC_MAGIC))
   {
-    uint32_t value;
-    GElf_Sym entrysym;
-    GElf_Shdr shdr;
-    void *data;
-    uint32_t size;
-
-    if (!STREQ(dmagic, algorithm[i].driver_magic))
-      continue;
-
-    if (!elf_get_symbol(&handle, algorithm[i].prog_entry(), &entrysym))
+    if (elf_plugin_code(&handle, FLASHCRC_ENTRY, prfunc, &crc_plugin.p_code,
+                        &crc_plugin.p_entry, &crc_plugin.p_len))
     {
+      crc_plugin.ram = adr;
+      crc_plugin.len = len;
+      crc_plugin.loaded = 0;
       if (prfunc)
-        prfunc("could not find prog entry symbol %s",
-               algorithm[i].prog_entry());
-      elf_close(&handle);
-      return 0;
+        prfunc("%s loaded, size:%d", dmagic, crc_plugin.p_len);
     }
+    elf_close(&handle);
+    return 1;
+  }
 
-    if (!elf_get_section_hdr(&handle, entrysym.st_shndx, &shdr))
-    {
-      if (prfunc)
-        prfunc("could not get section header for prog entry");
-      elf_close(&handle);
-      return 0;
-    }
+  for (i = 0; i < NUMOF(algorithm); i++)
+  {
+    if (!STREQ(dmagic, algorithm[i].driver_magic))
+      continue;
 
-    data = elf_get_section_data(&handle, entrysym.st_shndx, &size);
-    if (!data)
+    if (!elf_plugin_code(&handle, algorithm[i].prog_entry(), prfunc,
+                         &algorithm[i].p_code, &algorithm[i].p_entry,
+                         &algorithm[i].p_len))
     {
-      if (prfunc)
-        prfunc("could not get section data for prog entry");
       elf_close(&handle);
       return 0;
     }
 
-    algorithm[i].p_entry = entrysym.st_value;
-    algorithm[i].p_len = size;
-    algorithm[i].p_code = malloc(size);
-    memcpy(algorithm[i].p_code, data, size);
-
     algorithm[i].ram = adr;
     algorithm[i].len = len;
     break;
@@ -330,6 +403,114 @@ flash_plugin(int (*prfunc) (const char *format, ...),
 
 #endif
 
+#if HOST_FLASHING
+
+/* Poll interval limits in micro-seconds while waiting for a plugin.
+ */
+#define PROG_POLL_MIN 50
+#define PROG_POLL_MAX 5000
+
+/* Set up the plugin's stack frame, stack pointer and program counter in
+   one batch. ARGS are the plugin function's arguments in order. Be
+   careful with the longword writes, they must be longword aligned!
+ */
+static int
+prog_clone_frame(int cpu_type, uint32_t sp, uint32_t pc,
+                 uint32_t *args, int argc)
+{
+  struct BDMbatchOp ops[8];
+  uint32_t ra;
+  int cnt = 0;
+
+  memset (ops, 0, sizeof (ops));
+
+  sp -= 4;
+  ra = sp;
+  ops[cnt].code = BDM_WRITE_WORD;
+  ops[cnt].ioc.address = sp;
+  switch (cpu_type) {
+    case BDM_CPU32:
+      ops[cnt++].ioc.value = 0x4afa;    /* BGND instruction */
+      break;
+    case BDM_COLDFIRE:
+      ops[cnt++].ioc.value = 0x4ac8;    /* HALT instruction */
+      break;
+    default:
+      return -1;
+  }
+
+  while (argc--) {
+    sp -= 4;
+    ops[cnt].code = BDM_WRITE_LONGWORD;
+    ops[cnt].ioc.address = sp;
+    ops[cnt++].ioc.value = args[argc];
+  }
+
+  sp -= 4;
+  ops[cnt].code = BDM_WRITE_LONGWORD;   /* return address to BGND */
+  ops[cnt].ioc.address = sp;
+  ops[cnt++].ioc.value = ra;
+
+  ops[cnt].code = BDM_WRITE_REG;
+  ops[cnt].ioc.address = BDM_REG_A7;
+  ops[cnt++].ioc.value = sp;
+  ops[cnt].code = BDM_WRITE_SYSREG;
+  ops[cnt].ioc.address = BDM_REG_RPC;
+  ops[cnt++].ioc.value = pc;
+
+  return bdmExecBatch (ops, cnt);
+}
+
+/* Micro-seconds since START.
+ */
+static uint32_t
+prog_clone_usecs(struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return ((now.tv_sec - start->tv_sec) * 1000000) +
+    (now.tv_usec - start->tv_usec);
+}
+
+/* Wait for the plugin started at GO to stop. Sleep through most of the
+   EXPECT micro-seconds the run should take, then poll with a backing
+   off interval. Returns the run time or 0 on error.
+ */
+static uint32_t
+prog_clone_wait(struct timeval *go, uint32_t expect)
+{
+  uint32_t poll = PROG_POLL_MIN;
+  uint32_t elapsed;
+  int status;
+
+  expect -= expect / 8;
+  elapsed = prog_clone_usecs (go);
+  if (elapsed < expect)
+    usleep (expect - elapsed);
+
+  while (1) {
+    status = bdmStatus ();
+    if (status < 0)
+      return 0;
+    if (status & (BDM_TARGETSTOPPED | BDM_TARGETHALT))
+      break;
+    usleep (poll);
+    if (poll < PROG_POLL_MAX)
+      poll *= 2;
+  }
+
+  elapsed = prog_clone_usecs (go);
+  return elapsed ? elapsed : 1;
+}
+
+#endif
+
+/* Program through a plugin on the target. On a Coldfire the BDM can write
+   to memory while the plugin runs so the content window is split into
+   two buffers and the next chunk is downloaded while the plugin programs
+   the current one.
+ */
 static int
 prog_clone(area_t * area, uint32_t adr, unsigned char *data, uint32_t size)
 {
@@ -339,12 +520,20 @@ prog_clone(area_t * area, uint32_t adr, unsigned char *data, uint32_t size)
   uint32_t len;
   static uint32_t entry = 0;
   static uint32_t content = 0;
-  static area_t *last_area = NULL;
-  uint32_t sp, ra;
+  static double usecs_per_byte = 0;
+  uint32_t args[4];
+  uint32_t sp;
   uint32_t sent = 0;
+  uint32_t window;
+  uint32_t buffer[2];
+  uint32_t chunk;
   uint32_t num;
+  uint32_t loaded = 0;
+  uint32_t usecs;
+  struct timeval go;
   unsigned long wrote_num = 0;
   int cpu_type;
+  int cur = 0;
 
   if (!area->alg)
     return 0;
@@ -359,62 +548,67 @@ prog_clone(area_t * area, uint32_t adr, unsigned char *data, uint32_t size)
   mem = area->alg->ram;
   len = area->alg->len;
 
-  if (area != last_area) {
+  if (area != plugin_area) {
     /* Download plugin and chip descriptor into target. */
     entry = area->alg->download_struct (area->chip_descriptor, mem);
     bdmWriteMemory (entry, area->alg->p_code, area->alg->p_len);
-    content = entry + area->alg->p_len;
-    last_area = area;
+    content = (entry + area->alg->p_len + 3) & ~3;
+    plugin_area = area;
+    crc_plugin.loaded = 0;
+    usecs_per_byte = 0;
   }
 
-  while (sent < size) {
-    sp = mem + len;
+  sp = mem + len;
 
-    num = sp - 0x200 - content; /* FIXME: stack size should be
-                                   determined dynamically */
-    if (num > size - sent)
-      num = size - sent;
+  window = sp - 0x200 - content;        /* FIXME: stack size should be
+                                           determined dynamically */
+  buffer[0] = buffer[1] = content;
+  chunk = window;
+  if ((cpu_type == BDM_COLDFIRE) && (window >= 8)) {
+    chunk = (window / 2) & ~3;
+    buffer[1] = content + chunk;
+  }
 
-    /* Set up stack frame. 
-     * Be careful with the longword writes, they must be longword aligned! 
-     */
-    switch (cpu_type) {
-      case BDM_CPU32:
-        sp -= 4;
-        ra = sp;
-        bdmWriteWord (sp, 0x4afa);       /* BGND instruction */
-        break;
-      case BDM_COLDFIRE:
-        sp -= 4;
-        ra = sp;
-        bdmWriteWord (sp, 0x4ac8);       /* HALT instruction */
+  while (sent < size) {
+    num = size - sent;
+    if (num > chunk)
+      num = chunk;
+
+    /* Download contents unless it went down while the last chunk was
+       being programmed. */
+    if (!loaded) {
+      if (bdmWriteMemory (buffer[cur], data, num) < 0)
         break;
-      default:
-        return 0;
     }
 
-    sp -= 4;
-    bdmWriteLongWord (sp, num);          /* amount of data to flash */
-    sp -= 4;
-    bdmWriteLongWord (sp, content);      /* adr of memory contents */
-    sp -= 4;
-    bdmWriteLongWord (sp, adr);          /* destination adr */
-    sp -= 4;
-    bdmWriteLongWord (sp, mem);          /* chip descriptor */
-    sp -= 4;
-    bdmWriteLongWord (sp, ra);           /* return address to BGND */
+    args[0] = mem;                      /* chip descriptor */
+    args[1] = adr;                      /* destination adr */
+    args[2] = buffer[cur];              /* adr of memory contents */
+    args[3] = num;                      /* amount of data to flash */
+    if (prog_clone_frame (cpu_type, sp, entry + area->alg->p_entry,
+                          args, 4) < 0)
+      break;
 
-    /* Download contents. */
-    bdmWriteMemory (content, data, num);
+    /* Execute */
+    if (bdmGo() < 0)
+      break;
+    gettimeofday (&go, NULL);
+
+    /* Stream the next chunk into the other buffer. */
+    loaded = 0;
+    if ((buffer[0] != buffer[1]) && (sent + num < size)) {
+      loaded = size - sent - num;
+      if (loaded > chunk)
+        loaded = chunk;
+      if (bdmWriteMemory (buffer[!cur], data + num, loaded) < 0)
+        loaded = 0;
+    }
 
-    /* Set stack pointer and program counter. */
-    bdmWriteRegister(BDM_REG_A7, sp);
-    bdmWriteSystemRegister(BDM_REG_RPC, entry + area->alg->p_entry);
+    usecs = prog_clone_wait (&go, (uint32_t) (usecs_per_byte * num));
+    if (!usecs)
+      break;
+    usecs_per_byte = (double) usecs / num;
 
-    /* Execute */
-    bdmGo();
-    while (!((bdmStatus ()) & (BDM_TARGETSTOPPED | BDM_TARGETHALT))) ;
-    
     bdmReadRegister (BDM_REG_D0, &wrote_num);
 
     if (num != (uint32_t) wrote_num) {
@@ -425,6 +619,8 @@ prog_clone(area_t * area, uint32_t adr, unsigned char *data, uint32_t size)
     sent += num;
     data += num;
     adr += num;
+    if (loaded)
+      cur = !cur;
   }
 #else
   /* FIXME: to be done */
@@ -497,6 +693,50 @@ flash_register(char *description, uint32_t adr, char *hint_driver)
   return 0;
 }
 
+/* Search area of address and call its sector lookup.
+ */
+int
+flash_sector(uint32_t adr, flash_sector_t *sector)
+{
+  area_t *a;
+  alg_t *alg;
+
+  init();
+
+  if (!(a = search_area(adr)))
+    return 0;
+
+  if (alg = a->alg) {
+    if (alg->sector) {
+      return alg->sector(a->chip_descriptor, adr, sector);
+    }
+  }
+
+  return 0;
+}
+
+/* Walk the memory areas. The areas are kept in address order and cover
+   the whole address range.
+ */
+int
+flash_area(int index, uint32_t *adr, uint32_t *end, int *flash)
+{
+  area_t *a;
+
+  init();
+
+  for (a = area; a && index; a = a->next)
+    index--;
+
+  if (!a)
+    return 0;
+
+  *adr = a->adr;
+  *end = a->end;
+  *flash = a->alg != NULL;
+  return 1;
+}
+
 /* Search area of address and call its erase algorithm.
  */
 int
@@ -579,17 +819,17 @@ write_memory(uint32_t adr, unsigned char *data, uint32_t cnt)
       size = cnt - wrote;
 
     if (area->alg && area->alg->prog) {
-      ret = prog_clone(area, adr, data, size);
+      ret = prog_clone(area, adr + wrote, data + wrote, size);
       wrote += ret;
       if (ret != size)
         return wrote;
     } else {
       /* no programming algorithm defined, assume RAM */
 #if HOST_FLASHING
-      if (bdmWriteMemory(adr, data, size) < 0)
+      if (bdmWriteMemory(adr + wrote, data + wrote, size) < 0)
         return wrote;
 #else
-      memcpy((unsigned char *) adr, data, size);
+      memcpy((unsigned char *) adr + wrote, data + wrote, size);
 #endif
       wrote += size;
     }
@@ -597,6 +837,416 @@ write_memory(uint32_t adr, unsigned char *data, uint32_t cnt)
   return wrote;
 }
 
+#if HOST_FLASHING
+
+/* Return 1 if OLD can be turned into NEW by programming alone, that is no
+   bit has to go from 0 to 1. With NO_REPROGRAM set a longword that
+   differs also has to be erased in OLD, as it may be programmed only
+   once.
+ */
+static int
+diff_programmable(unsigned char *old, unsigned char *new, uint32_t cnt,
+                  int no_reprogram)
+{
+  uint32_t i;
+
+  for (i = 0; i < cnt; i++)
+    if ((old[i] & new[i]) != new[i])
+      return 0;
+
+  if (no_reprogram) {
+    for (i = 0; i < cnt; i += 4) {
+      uint32_t n = (cnt - i) < 4 ? (cnt - i) : 4;
+
+      if (memcmp(old + i, new + i, n) &&
+          memcmp(old + i, "\xff\xff\xff\xff", n))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/* Find the longword aligned span of NEW that differs from OLD. Returns
+   the length, zero if they are the same.
+ */
+static uint32_t
+diff_span(unsigned char *old, unsigned char *new, uint32_t cnt,
+          uint32_t *first)
+{
+  uint32_t start = 0;
+  uint32_t end = cnt;
+
+  while (start < cnt && old[start] == new[start])
+    start++;
+  if (start == cnt)
+    return 0;
+  while (end > start && old[end - 1] == new[end - 1])
+    end--;
+
+  start &= ~3;
+  end = (end + 3) & ~3;
+  if (end > cnt)
+    end = cnt;
+
+  *first = start;
+  return end - start;
+}
+
+/* Write CNT bytes of DATA to ADR in flash AREA, which holds OLD. Only
+   the differing span is programmed. With NO_REPROGRAM set the span is
+   split at longwords that already hold their data so none is programmed
+   twice. Returns 1 on success.
+ */
+static int
+diff_program(area_t *area, uint32_t adr, unsigned char *old,
+             unsigned char *data, uint32_t cnt, int no_reprogram)
+{
+  uint32_t first;
+  uint32_t len;
+
+  while ((len = diff_span(old, data, cnt, &first)) != 0) {
+    if (no_reprogram) {
+      uint32_t run = 0;
+
+      while (run < len && memcmp(old + first + run, data + first + run,
+                                 (len - run) < 4 ? (len - run) : 4))
+        run += 4;
+      if (run < len)
+        len = run;
+    }
+    if (prog_clone(area, adr + first, data + first, len) != len)
+      return 0;
+    first += len;
+    adr += first;
+    old += first;
+    data += first;
+    cnt -= first;
+  }
+  return 1;
+}
+
+/* A sector the differential write has to program.
+ */
+typedef struct diff_job_s
+{
+  area_t *area;
+  flash_sector_t sec;
+  unsigned char *old;
+  unsigned char *new;
+  int state;
+  int erased;
+  struct diff_job_s *next;
+} diff_job_t;
+
+#define DIFF_PROGRAM 0                  /* only needs programming */
+#define DIFF_ERASE   1                  /* needs an erase first */
+#define DIFF_ERASING 2                  /* erase started */
+#define DIFF_DONE    3
+
+static void
+diff_free(diff_job_t *job)
+{
+  while (job) {
+    diff_job_t *next = job->next;
+
+    free(job->old);
+    free(job->new);
+    free(job);
+    job = next;
+  }
+}
+
+/* Compare the part of DATA from ADR to END (inclusive) that is in the
+   flash AREA. Each sector is read back and merged with the data. Sectors
+   that already match are counted, the others are appended to the job
+   list at TAIL.
+ */
+static int
+diff_area(area_t *area, uint32_t adr, unsigned char *data, uint32_t end,
+          flash_diff_t *stats, diff_job_t ***tail)
+{
+  alg_t *alg = area->alg;
+  diff_job_t *job;
+  uint32_t pos = adr;
+
+  while (1) {
+    uint32_t off;
+    uint32_t cnt;
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+      return 0;
+    job->area = area;
+
+    if (!alg->sector || !alg->sector(area->chip_descriptor, pos, &job->sec)) {
+      /* Unknown layout, compare only the data range. */
+      job->sec.start = pos;
+      job->sec.size = (end - pos) + 1;
+      job->sec.erase_arg = -1;
+      job->sec.erase_wait = 0;
+      job->sec.blank_chk = 0;
+      job->sec.no_reprogram = 0;
+    }
+
+    off = pos - job->sec.start;
+    cnt = job->sec.size - off;
+    if (cnt > (end - pos) + 1)
+      cnt = (end - pos) + 1;
+
+    job->old = malloc(job->sec.size);
+    job->new = malloc(job->sec.size);
+    if (!job->old || !job->new)
+      break;
+
+    /* A sector the chip itself reports blank need not be read back.
+     */
+    if (job->sec.blank_chk && alg->blank_chk &&
+        alg->blank_chk(area->chip_descriptor, job->sec.erase_arg) == 1) {
+      memset(job->old, 0xff, job->sec.size);
+    }
+    else if (bdmReadMemory(job->sec.start, job->old, job->sec.size) < 0) {
+      break;
+    }
+
+    memcpy(job->new, job->old, job->sec.size);
+    memcpy(job->new + off, data + (pos - adr), cnt);
+
+    if (!memcmp(job->old, job->new, job->sec.size)) {
+      stats->same++;
+      diff_free(job);
+    }
+    else if (diff_programmable(job->old, job->new, job->sec.size,
+                               job->sec.no_reprogram)) {
+      job->state = DIFF_PROGRAM;
+      **tail = job;
+      *tail = &job->next;
+    }
+    else if (job->sec.erase_arg == -1) {
+      printf("\nflash at 0x%08lx needs an erase, sector layout unknown\n",
+             (unsigned long) pos);
+      break;
+    }
+    else {
+      job->state = DIFF_ERASE;
+      **tail = job;
+      *tail = &job->next;
+    }
+
+    if (pos + (cnt - 1) >= end)
+      return 1;
+    pos += cnt;
+  }
+
+  diff_free(job);
+  return 0;
+}
+
+/* Return 1 if JOB is the first pending job of its area. The jobs of an
+   area are worked through in order, one at a time.
+ */
+static int
+diff_head(diff_job_t *jobs, diff_job_t *job)
+{
+  for (; jobs != job; jobs = jobs->next)
+    if (jobs->area == job->area && jobs->state != DIFF_DONE)
+      return 0;
+  return 1;
+}
+
+/* The erase of JOB has finished. Verify it if the chip can.
+ */
+static int
+diff_erased(diff_job_t *job)
+{
+  alg_t *alg = job->area->alg;
+
+  if (job->sec.blank_chk && alg->blank_chk &&
+      alg->blank_chk(job->area->chip_descriptor, job->sec.erase_arg) != 1) {
+    printf("\nerase verify of sector at 0x%08lx failed\n",
+           (unsigned long) job->sec.start);
+    return 0;
+  }
+  memset(job->old, 0xff, job->sec.size);
+  job->erased = 1;
+  job->state = DIFF_PROGRAM;
+  return 1;
+}
+
+/* Erase scheduler. Every area (chip) works through its jobs in order, but
+   the areas run side by side: the erases of all areas are started, then
+   polled together, and while some chips are still erasing the sectors of
+   the chips that are done are programmed. Drivers without an erase poll
+   function wait for their erases in turn. Returns the first job not
+   done, NULL on success.
+ */
+static diff_job_t *
+diff_run(diff_job_t *jobs, flash_diff_t *stats)
+{
+  diff_job_t *job;
+  int pending;
+
+  do {
+    diff_job_t *ready = NULL;
+    alg_t *alg;
+    int ret;
+
+    pending = 0;
+    for (job = jobs; job; job = job->next) {
+      if (job->state == DIFF_DONE || !diff_head(jobs, job))
+        continue;
+      pending++;
+      alg = job->area->alg;
+
+      switch (job->state) {
+        case DIFF_ERASE:
+          alg->erase(job->area->chip_descriptor, job->sec.erase_arg);
+          if (alg->erase_poll) {
+            job->state = DIFF_ERASING;
+            break;
+          }
+          if (job->sec.erase_wait && alg->erase_wait)
+            alg->erase_wait(job->area->chip_descriptor);
+          if (!diff_erased(job))
+            return job;
+          break;
+        case DIFF_ERASING:
+          ret = alg->erase_poll(job->area->chip_descriptor);
+          if (ret < 0) {
+            printf("\nerase of sector at 0x%08lx failed\n",
+                   (unsigned long) job->sec.start);
+            return job;
+          }
+          if (ret && !diff_erased(job))
+            return job;
+          break;
+      }
+
+      if (job->state == DIFF_PROGRAM && !ready)
+        ready = job;
+    }
+
+    /* Program one sector, then look after the erases again.
+     */
+    if (ready) {
+      if (!diff_program(ready->area, ready->sec.start, ready->old,
+                        ready->new, ready->sec.size,
+                        ready->sec.no_reprogram))
+        return ready;
+      if (ready->erased)
+        stats->erased++;
+      else
+        stats->programmed++;
+      ready->state = DIFF_DONE;
+    }
+    else if (pending) {
+      usleep(PROG_POLL_MAX);
+    }
+  } while (pending);
+
+  return NULL;
+}
+
+#endif
+
+/* Write to memory through registered algorithms, skipping flash that
+   already holds the data.
+ */
+uint32_t
+write_memory_diff(uint32_t adr, unsigned char *data, uint32_t cnt,
+                  flash_diff_t *stats)
+{
+#if HOST_FLASHING
+  uint32_t wrote = 0;
+  flash_diff_t dummy;
+  diff_job_t *jobs = NULL;
+  diff_job_t **tail = &jobs;
+  diff_job_t *failed;
+
+  init();
+
+  if (!stats)
+    stats = &dummy;
+  memset(stats, 0, sizeof(*stats));
+
+  while (wrote < cnt) {
+    area_t *area = search_area(adr + wrote);
+    uint32_t size = (area->end - (adr + wrote)) + 1;
+
+    if (size > cnt - wrote)
+      size = cnt - wrote;
+
+    if (area->alg && area->alg->prog) {
+      if (!diff_area(area, adr + wrote, data + wrote,
+                     adr + wrote + (size - 1), stats, &tail)) {
+        diff_free(jobs);
+        return 0;
+      }
+    } else {
+      if (bdmWriteMemory(adr + wrote, data + wrote, size) < 0) {
+        diff_free(jobs);
+        return 0;
+      }
+    }
+    wrote += size;
+  }
+
+  if ((failed = diff_run(jobs, stats))) {
+    wrote = failed->sec.start > adr ? failed->sec.start - adr : 0;
+  }
+  diff_free(jobs);
+  return wrote;
+#else
+  return write_memory(adr, data, cnt);
+#endif
+}
+
+/* Check CNT bytes at ADR on the target against DATA by running the CRC
+   plugin on the target. Returns 1 if they match, 0 if they do not and -1
+   if the CRC can not be run on the target.
+ */
+int
+flash_crc32_verify(uint32_t adr, unsigned char *data, uint32_t cnt)
+{
+#if HOST_FLASHING
+  uint32_t args[4];
+  struct timeval go;
+  unsigned long crc;
+  int cpu_type;
+
+  if (!crc_plugin.p_code || bdmGetProcessor(&cpu_type) < 0)
+    return -1;
+
+  if (!crc_plugin.loaded) {
+    if (bdmWriteMemory(crc_plugin.ram, crc_plugin.p_code,
+                       crc_plugin.p_len) < 0)
+      return -1;
+    crc_plugin.loaded = 1;
+    plugin_area = NULL;
+  }
+
+  args[0] = 0;                          /* no chip descriptor */
+  args[1] = adr;
+  args[2] = 0;
+  args[3] = cnt;
+  if (prog_clone_frame(cpu_type, crc_plugin.ram + crc_plugin.len,
+                       crc_plugin.ram + crc_plugin.p_entry, args, 4) < 0)
+    return -1;
+
+  if (bdmGo() < 0)
+    return -1;
+  gettimeofday(&go, NULL);
+  if (!prog_clone_wait(&go, 0))
+    return -1;
+
+  if (bdmReadRegister(BDM_REG_D0, &crc) < 0)
+    return -1;
+
+  return (uint32_t) crc == flashcrc32(0, data, cnt);
+#else
+  return flashcrc32(0, (unsigned char *) adr, cnt) == flashcrc32(0, data, cnt);
+#endif
+}
+
 int 
 flash_set_var(const char *name, uint32_t value)
 {
@@ -55,6 +55,35 @@ void register_algorithm(int num, /* number that was passed to init function */
                         char *(*prog_entry) (void)
   );
 
+/* An erase sector. ERASE_ARG is what the driver's erase function takes
+   for the sector. It may be an address with the top bit set but is never
+   the -1 that erases the whole chip. ERASE_WAIT is set when the erase has
+   to be waited for with the erase_wait function. BLANK_CHK is set when
+   the driver's blank check function checks the sector (by ERASE_ARG) on
+   the chip. NO_REPROGRAM is set when a programmed longword must not be
+   programmed again before the sector is erased.
+ */
+typedef struct
+{
+  uint32_t start;
+  uint32_t size;
+  int32_t erase_arg;
+  int erase_wait;
+  int blank_chk;
+  int no_reprogram;
+} flash_sector_t;
+
+/* Drivers that know the erase sector layout of a chip register a function
+   to look up the sector holding an address. It returns 1 if found.
+ */
+void register_sector_map(int num,
+                         int (*sector) (void *, uint32_t, flash_sector_t *));
+
+/* Drivers that can check on an erase without blocking register a function
+   returning 1 when the erase is done, 0 while it runs and -1 on failure.
+ */
+void register_erase_poll(int num, int (*erase_poll) (void *));
+
 /* Load target drivers. ADR and LEN define memory region in the target that
    can be used for downloading code/data.
  */
@@ -65,12 +94,44 @@ int flash_plugin (int (*prfunc) (const char *format, ...),
  */
 int flash_register (char *description, uint32_t adr, char *hint_driver);
 
+/* Look up the erase sector of the flash holding ADR. Returns 1 if found,
+   0 if ADR is not flash or the driver does not know the layout.
+ */
+int flash_sector (uint32_t adr, flash_sector_t *sector);
+
+/* Get the INDEX'th memory area, counting from the lowest address. END is
+   the last byte of the area and FLASH is set if a driver programs it.
+   Returns 0 when there are no more areas.
+ */
+int flash_area (int index, uint32_t *adr, uint32_t *end, int *flash);
+
 int flash_erase (uint32_t adr, int32_t sec_adr);
 int flash_blank_chk (uint32_t adr, int32_t sec_adr);
 int flash_erase_wait (uint32_t adr);
 
 uint32_t write_memory (uint32_t adr, unsigned char *data, uint32_t cnt);
 
+/* Counters for write_memory_diff.
+ */
+typedef struct
+{
+  uint32_t same;                        /* sectors already holding the data */
+  uint32_t programmed;                  /* sectors programmed without erase */
+  uint32_t erased;                      /* sectors erased and programmed */
+} flash_diff_t;
+
+/* Write to memory, only programming flash sectors that differ from the
+   data. Changed sectors are erased if needed, keeping the sector's data
+   outside the written range.
+ */
+uint32_t write_memory_diff (uint32_t adr, unsigned char *data, uint32_t cnt,
+                            flash_diff_t *stats);
+
+/* Verify target memory with the CRC plugin. Returns 1 if it matches DATA,
+   0 if not and -1 if the CRC plugin is not loaded or fails.
+ */
+int flash_crc32_verify (uint32_t adr, unsigned char *data, uint32_t cnt);
+
 int flash_set_var (const char *name, uint32_t value);
 int flash_get_var (const char *name, uint32_t *value, uint32_t value_default);
 
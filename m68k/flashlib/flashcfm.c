@@ -28,6 +28,8 @@
 #define MCF_CFM_CFMCLKD_DIVLD                (0x80)
 
 #define MCF_CFM_CFMUSTAT_BLANK               (0x04)
+#define MCF_CFM_CFMUSTAT_ACCERR              (0x10)
+#define MCF_CFM_CFMUSTAT_PVIOL               (0x20)
 #define MCF_CFM_CFMUSTAT_CCIF                (0x40)
 #define MCF_CFM_CFMUSTAT_CBEIF               (0x80)
 
@@ -144,6 +146,78 @@ prog_entry(void)
 }
 #endif
 
+#if HOST_FLASHING
+
+/* Number of longwords launched by one batch in host mode.
+ */
+#define CFM_BATCH 32
+
+/* Programming for host mode. The CFM buffers a second command while one
+   is executing, and one BDM access takes longer than programming a
+   longword. So the command sequences for a run of longwords are sent as
+   one batch, each followed by a read of CFMUSTAT instead of a busy-wait.
+   The reads are checked afterwards. A command sent while the buffer is
+   full is not launched and sets ACCERR, which latches so no later
+   command of the batch is launched either. The first read showing an
+   error ends the batched part and the caller carries on from that
+   longword the slow way. Returns the number of longwords launched.
+ */
+static uint32_t
+flashcfm_prog_host(chiptype_t *ct,
+                   uint32_t offset, unsigned char *data, uint32_t cnt)
+{
+  struct BDMbatchOp ops[CFM_BATCH * 4];
+  uint32_t n = 0;
+
+  while (n < cnt) {
+    uint32_t num = cnt - n;
+    uint32_t i;
+    int nops = 0;
+
+    if (num > CFM_BATCH)
+      num = CFM_BATCH;
+
+    memset(ops, 0, sizeof(ops));
+    for (i = 0; i < num; i++) {
+      unsigned char *d = data + (n + i) * 4;
+
+      ops[nops].code = BDM_WRITE_LONGWORD;
+      ops[nops].ioc.address = offset + (n + i) * 4;
+      ops[nops++].ioc.value = ((uint32_t) d[0] << 24) | (d[1] << 16) |
+                              (d[2] << 8) | d[3];
+      ops[nops].code = BDM_WRITE_BYTE;
+      ops[nops].ioc.address = ct->cfmcmd;
+      ops[nops++].ioc.value = MCF_CFM_CFMCMD_WORD_PROGRAM;
+      ops[nops].code = BDM_WRITE_BYTE;
+      ops[nops].ioc.address = ct->cfmustat;
+      ops[nops++].ioc.value = MCF_CFM_CFMUSTAT_CBEIF;
+      ops[nops].code = BDM_READ_BYTE;
+      ops[nops++].ioc.address = ct->cfmustat;
+    }
+
+    if (bdmExecBatch(ops, nops) < 0) {
+      fprintf(stderr, "flashcfm: batch at 0x%08x: %s\n",
+              offset + n * 4, bdmErrorString());
+      return n;
+    }
+
+    for (i = 0; i < num; i++) {
+      uint32_t stat = ops[i * 4 + 3].ioc.value;
+
+      if (stat & (MCF_CFM_CFMUSTAT_ACCERR | MCF_CFM_CFMUSTAT_PVIOL)) {
+        write_byte(ct->cfmustat,
+                   MCF_CFM_CFMUSTAT_ACCERR | MCF_CFM_CFMUSTAT_PVIOL);
+        return n + i;
+      }
+    }
+    n += num;
+  }
+
+  return n;
+}
+
+#endif
+
 /* The actual programming function.
  * NOTE: pos and cnt need to be 4 byte aligned!
  */
@@ -161,8 +235,13 @@ flashcfm_prog(void *chip_descr,
     while (!(read_byte(ct->cfmustat) & MCF_CFM_CFMUSTAT_CBEIF)) {
     }
 
-    for (n = 0; n < cnt; ++n) {
+#if HOST_FLASHING
+    n = flashcfm_prog_host(ct, offset, data, cnt);
+#endif
+
+    for (; n < cnt; ++n) {
       uint32_t d = ((uint32_t *) data)[n];
+      uint8_t stat;
 
       /* write_longword on host assumes host endianess so will perform a
        * byte order swap if host is little endian.  we need to swap if little
@@ -170,17 +249,28 @@ flashcfm_prog(void *chip_descr,
        */
       if(is_little_endian())
         d = swap32(d);
+
+      /* The second stage of the command pipeline takes the next
+       * longword while the current one is programmed.
+       */
+      while (!((stat = read_byte(ct->cfmustat)) & MCF_CFM_CFMUSTAT_CBEIF)) {
+      }
       write_longword(offset + n * 4, d);
       
       write_byte(ct->cfmcmd, MCF_CFM_CFMCMD_WORD_PROGRAM);
       write_byte(ct->cfmustat, MCF_CFM_CFMUSTAT_CBEIF);
 
-      if (read_byte(ct->cfmustat) & MCF_CFM_CFMUSTAT_CBEIF) {
-        continue;
+      stat = read_byte(ct->cfmustat);
+      if (stat & (MCF_CFM_CFMUSTAT_ACCERR | MCF_CFM_CFMUSTAT_PVIOL)) {
+        write_byte(ct->cfmustat,
+                   MCF_CFM_CFMUSTAT_ACCERR | MCF_CFM_CFMUSTAT_PVIOL);
+        break;
       }
+    }
 
-      while (!(read_byte(ct->cfmustat) & MCF_CFM_CFMUSTAT_CCIF)) {
-      }
+    /* Let the last longwords finish before the array is read again.
+     */
+    while (!(read_byte(ct->cfmustat) & MCF_CFM_CFMUSTAT_CCIF)) {
     }
   }
 
@@ -341,6 +431,43 @@ download_struct(void *chip_descr, uint32_t adr)
   return adr;
 }
 
+/* The page erase size depends on the part. Pages of the size in the
+   FLASH_SECTOR_SIZE variable are used if it is set.
+ */
+static int
+flashcfm_sector(void *chip_descr, uint32_t adr, flash_sector_t *sec)
+{
+  chiptype_t *ct = (chiptype_t *) chip_descr;
+  uint32_t size;
+
+  flash_get_var("FLASH_SECTOR_SIZE", &size, 0);
+  if (!size || adr < ct->flash_address)
+    return 0;
+
+  sec->start = adr - ((adr - ct->flash_address) % size);
+  sec->size = size;
+  sec->erase_arg = sec->start;
+  sec->erase_wait = 1;
+  sec->blank_chk = 1;
+  sec->no_reprogram = 1;
+  return 1;
+}
+
+/* Check on an erase without waiting for it.
+ */
+static int
+flashcfm_erase_poll(void *chip_descr)
+{
+  chiptype_t *ct = (chiptype_t *) chip_descr;
+  uint8_t stat = read_byte(ct->cfmustat);
+
+  if (stat & (MCF_CFM_CFMUSTAT_ACCERR | MCF_CFM_CFMUSTAT_PVIOL)) {
+    write_byte(ct->cfmustat, MCF_CFM_CFMUSTAT_ACCERR | MCF_CFM_CFMUSTAT_PVIOL);
+    return -1;
+  }
+  return (stat & MCF_CFM_CFMUSTAT_CCIF) ? 1 : 0;
+}
+
 void
 init_flashcfm(int num)
 {
@@ -350,6 +477,8 @@ init_flashcfm(int num)
                      flashcfm_erase,
                      flashcfm_blank_chk,
                      flashcfm_erase_wait, flashcfm_prog, prog_entry);
+  register_sector_map(num, flashcfm_sector);
+  register_erase_poll(num, flashcfm_erase_poll);
 }
 #else
 void
@@ -0,0 +1,67 @@
+/* $Id:
+ *
+ * Portions of this program which I authored may be used for any purpose
+ * so long as this notice is left intact. 
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include "flashcrc.h"
+#include "flash_filter.h"
+#include <stdint.h>
+
+#define FLASHCRC_POLY 0xedb88320
+
+/* The plugin loader only downloads the section holding the entry point,
+   so there is no constant table. A nibble table is built on the stack
+   which is small enough for the plugin stack and still quick.
+ */
+uint32_t
+flashcrc32(uint32_t crc, const unsigned char *data, uint32_t len)
+{
+  uint32_t table[16];
+  uint32_t i, c;
+  int bit;
+
+  for (i = 0; i < 16; i++) {
+    c = i;
+    for (bit = 0; bit < 4; bit++)
+      c = (c & 1) ? (c >> 1) ^ FLASHCRC_POLY : c >> 1;
+    table[i] = c;
+  }
+
+  crc = ~crc;
+  while (len--) {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ table[crc & 15];
+    crc = (crc >> 4) ^ table[crc & 15];
+  }
+  return ~crc;
+}
+
+#if !HOST_FLASHING
+
+/* We need a unique symbol to associate a (target-based) plugin with its
+   (host-based) driver.
+*/
+char driver_magic[] = FLASHCRC_MAGIC;
+
+/* Plugin entry. The arguments follow the flash plugins, the chip
+   descriptor is not used.
+ */
+uint32_t
+flashcrc_prog(void *chip_descr, uint32_t adr, unsigned char *data,
+              uint32_t cnt)
+{
+  return flashcrc32(0, (const unsigned char *) adr, cnt);
+}
+
+#endif
@@ -0,0 +1,44 @@
+/* $Id:
+ *
+ * Portions of this program which I authored may be used for any purpose
+ * so long as this notice is left intact. 
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * CRC32 (as used by zlib and ethernet) for verifying target memory.
+ *
+ * The same code is built for the host and as a target plugin. Load the
+ * plugin with flash_plugin like the flash plugins and flash_crc32_verify
+ * runs it over the target memory instead of reading the memory back.
+ */
+
+#ifndef _FLASHCRC_H_
+# define _FLASHCRC_H_
+
+# include <stdint.h>
+
+/* Driver magic and entry point of the plugin.
+ */
+# define FLASHCRC_MAGIC "flashcrc"
+# define FLASHCRC_ENTRY "flashcrc_prog"
+
+/* Update CRC with LEN bytes at DATA. Start with a CRC of 0.
+ */
+uint32_t flashcrc32 (uint32_t crc, const unsigned char *data, uint32_t len);
+
+/* The plugin entry, returns the CRC of CNT bytes at ADR.
+ */
+uint32_t flashcrc_prog (void *chip_descr, uint32_t adr, unsigned char *data,
+                        uint32_t cnt);
+
+#endif
@@ -391,6 +391,31 @@ download_struct(void *chip_descr, uint32_t adr)
   return adr;
 }
 
+/* Look up the sector holding ADR. The erase waits for the sector.
+ */
+static int
+flashintelc3_sector(void *chip_descr, uint32_t adr, flash_sector_t *sec)
+{
+  chiptype_t *ct = (chiptype_t *) chip_descr;
+  int i;
+
+  for(i = 0; i < ct->num_sectors; ++i) {
+    uint32_t off = flashintelc3_sector_offset(ct, i);
+    uint32_t size = flashintelc3_sector_size(ct, i);
+    if((adr >= ct->flash_address + off) &&
+       (adr < ct->flash_address + off + size)) {
+      sec->start = ct->flash_address + off;
+      sec->size = size;
+      sec->erase_arg = i;
+      sec->erase_wait = 0;
+      sec->blank_chk = 0;
+      sec->no_reprogram = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 void
 init_flashintelc3(int num)
 {
@@ -400,6 +425,7 @@ init_flashintelc3(int num)
                      flashintelc3_erase,
                      flashintelc3_blank_chk,
                      flashintelc3_erase_wait, flashintelc3_prog, prog_entry);
+  register_sector_map(num, flashintelc3_sector);
 }
 
 #else
@@ -226,6 +226,73 @@ flashintelp30_lock(void *chip_descr, uint32_t start, uint32_t bytes, int cmd)
   }
 }
 
+#if HOST_FLASHING
+
+/* Buffered programming for host mode. The data of each write buffer goes
+ * over BDM as one block write instead of a word access per word, and the
+ * status is polled with plain reads since the chip stays in read status
+ * mode after the confirm. The buffer available check after the setup is
+ * only needed before the WSM has been seen ready.
+ */
+static uint32_t
+flashintelp30_prog_host(chiptype_t *ct,
+                        uint32_t pos, unsigned char *data, uint32_t cnt)
+{
+  uint32_t word_cnt = (cnt + 1) / 2;
+  uint32_t n = 0;
+  uint16_t status = 0;
+  int ready = 0;
+
+  while (n < word_cnt) {
+    uint32_t sa = flashintelp30_sector_address(ct, pos);
+    uint32_t maxcnt, blk;
+
+    chip_wr_word(sa, 0xe8);
+    while (!ready && !(chip_rd_word(sa) & 0x80))
+      ;
+
+    maxcnt = ct->wbuf_mask + 1 - ((pos / 2) & ct->wbuf_mask);
+    if (maxcnt > word_cnt - n)
+      maxcnt = word_cnt - n;
+    chip_wr_word(sa, maxcnt - 1);
+
+    /* An odd byte at the end is padded with 0xff in its own write.
+     */
+    blk = maxcnt;
+    if ((cnt & 1) && n + maxcnt == word_cnt)
+      blk -= 1;
+    if (blk && bdmWriteMemory(pos, data + n * 2, blk * 2) < 0) {
+      printf("bdmWriteMemory(0x%08lx,xxx,0x%x): %s\n",
+             (unsigned long) pos, blk * 2, bdmErrorString());
+      chip_wr_word(ct->flash_address, 0xff);
+      return 0;
+    }
+    if (blk != maxcnt)
+      chip_wr_word(pos + blk * 2, (data[cnt - 1] << 8) | 0xff);
+
+    chip_wr_word(sa, 0xd0);
+    do {
+      status = chip_rd_word(sa);
+    }
+    while (!(status & 0x80));
+    if (status != 0x80) {
+      printf("unexpected status %x\n", status);
+      chip_wr_word(ct->flash_address, 0xff);
+      return status;
+    }
+    ready = 1;
+
+    pos += maxcnt * 2;
+    n += maxcnt;
+  }
+
+  chip_wr_word(ct->flash_address, 0xff);
+
+  return cnt;
+}
+
+#endif
+
 /* The actual programming function.
  * NOTE: pos need to be 2 byte aligned!
  */
@@ -241,6 +308,10 @@ flashintelp30_prog(void *chip_descr,
 #define USE_BUFFERED_PROGRAM
   flashintelp30_lock(ct, pos, cnt, 0);
 
+#if HOST_FLASHING && defined(USE_BUFFERED_PROGRAM)
+  return flashintelp30_prog_host(ct, pos, data, cnt);
+#endif
+
   word_cnt = (cnt + 1) / 2;
   for (n = 0; n < word_cnt; ++n) {
     uint16_t d = ((uint16_t *) (void*) data)[n];
@@ -492,6 +563,31 @@ download_struct(void *chip_descr, uint32_t adr)
   return adr;
 }
 
+/* Look up the sector holding ADR. The erase waits for the sector.
+ */
+static int
+flashintelp30_sector(void *chip_descr, uint32_t adr, flash_sector_t *sec)
+{
+  chiptype_t *ct = (chiptype_t *) chip_descr;
+  int i;
+
+  for(i = 0; i < ct->num_sectors; ++i) {
+    uint32_t off = flashintelp30_sector_offset(ct, i);
+    uint32_t size = flashintelp30_sector_size(ct, i);
+    if((adr >= ct->flash_address + off) &&
+       (adr < ct->flash_address + off + size)) {
+      sec->start = ct->flash_address + off;
+      sec->size = size;
+      sec->erase_arg = i;
+      sec->erase_wait = 0;
+      sec->blank_chk = 0;
+      sec->no_reprogram = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
 void
 init_flashintelp30(int num)
 {
@@ -501,6 +597,7 @@ init_flashintelp30(int num)
                      flashintelp30_erase,
                      flashintelp30_blank_chk,
                      flashintelp30_erase_wait, flashintelp30_prog, prog_entry);
+  register_sector_map(num, flashintelp30_sector);
 }
 
 #else
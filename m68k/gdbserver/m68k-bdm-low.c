@@ -40,6 +40,10 @@
 
 #include "m68k-bdm-low.h"
 
+#if M68K_BDM_FLASH
+#include "flash_filter.h"
+#endif
+
 /*
  * Compare a string with a constant string.
  */
@@ -263,6 +267,50 @@ static int m68k_bdm_use_error;
  */
 static int m68k_bdm_breakpoints_hard;
 
+/*
+ * Register snapshot. The register file is read with one batched BDM
+ * request the first time a register is needed after the target stops
+ * and single register fetches are served from it. Any register write
+ * or resume of the target invalidates it.
+ */
+static unsigned long*     m68k_bdm_snapshot;
+static char*              m68k_bdm_snapshot_have;
+static struct BDMbatchOp* m68k_bdm_snapshot_ops;
+static int*               m68k_bdm_snapshot_op_reg;
+static int                m68k_bdm_snapshot_valid;
+
+/*
+ * Target memory cache. GDB reads the same stack frames, strings and
+ * code many times while the target is stopped when it unwinds and
+ * disassembles. Memory is read a page at a time and a page is only used
+ * in the stop epoch it was read in. Resuming the target starts a new
+ * epoch. Writes go through to the target and update the cached pages.
+ * Address ranges such as peripheral space can be made uncacheable.
+ */
+#define M68K_BDM_MEM_PAGE_SIZE (256)
+#define M68K_BDM_MEM_PAGES     (64)
+
+struct m68k_bdm_mem_page {
+  CORE_ADDR     addr;
+  unsigned int  epoch;
+  unsigned int  used;
+  unsigned char data[M68K_BDM_MEM_PAGE_SIZE];
+};
+
+struct m68k_bdm_mem_range {
+  CORE_ADDR start;
+  CORE_ADDR end;
+};
+
+static struct m68k_bdm_mem_page   m68k_bdm_mem_pages[M68K_BDM_MEM_PAGES];
+static unsigned int               m68k_bdm_mem_epoch = 1;
+static unsigned int               m68k_bdm_mem_clock;
+static int                        m68k_bdm_mem_cache_on = 0;
+static struct m68k_bdm_mem_range* m68k_bdm_mem_nocache;
+static int                        m68k_bdm_mem_nocache_count;
+static unsigned long              m68k_bdm_mem_hits;
+static unsigned long              m68k_bdm_mem_misses;
+
 /*
  * Display error message and jump back to main input loop
  */
@@ -292,6 +340,12 @@ m68k_bdm_help (void)
               "\t-t time\tDelay timing for the parallel ports.\n" \
               "\tdevice\tThe device to connect to such as /dev/bdmcf0.\n",
               PACKAGE_STRING, PACKAGE_NAME);
+#if M68K_BDM_FLASH
+  printf_filtered ("\t-s name=value\tSet a flash library variable.\n" \
+                   "\t-p adr,len,plugin[,plugin...]\n" \
+                   "\t\tLoad flash plugins to run in target RAM at adr.\n" \
+                   "\t-f adr[,driver]\tRegister the flash at adr.\n");
+#endif
 }
 
 static void
@@ -363,6 +417,22 @@ m68k_bdm_init_registers (void)
     regs[reg].flags  = M68K_BDM_REG_FLAGS (reg);
   }
 
+  free (m68k_bdm_snapshot);
+  free (m68k_bdm_snapshot_have);
+  free (m68k_bdm_snapshot_ops);
+  free (m68k_bdm_snapshot_op_reg);
+
+  m68k_bdm_snapshot = calloc (sizeof (unsigned long), M68K_BDM_NUM_REGS_BDM * 2);
+  m68k_bdm_snapshot_have = calloc (sizeof (char), M68K_BDM_NUM_REGS_BDM);
+  m68k_bdm_snapshot_ops = calloc (sizeof (struct BDMbatchOp),
+                                  M68K_BDM_NUM_REGS_BDM * 2);
+  m68k_bdm_snapshot_op_reg = calloc (sizeof (int), M68K_BDM_NUM_REGS_BDM * 2);
+  m68k_bdm_snapshot_valid = 0;
+
+  if (!m68k_bdm_snapshot || !m68k_bdm_snapshot_have ||
+      !m68k_bdm_snapshot_ops || !m68k_bdm_snapshot_op_reg)
+    fatal ("m68k-bdm: no memory for register snapshot");
+
   if (m68k_bdm_debug_level)
     printf_filtered ("m68k-bdm: registers xml:%s number:%d size:%d\n",
                 M68K_BDM_REG_XML(), M68K_BDM_NUM_REGS_BDM,
@@ -396,22 +466,120 @@ m68k_bdm_read_sys_ctl_reg (const char* name, int cregno, unsigned long* l)
 }
 
 /*
- * Write a system or control registers.
+ * Set up a batch operation to read or write a system or control register.
  */
-static int
-m68k_bdm_write_sys_ctl_reg (const char* name, int cregno, unsigned long l)
+static void
+m68k_bdm_sys_ctl_reg_op (int cregno, int write, unsigned long l,
+                         struct BDMbatchOp* op)
 {
-  int ret;
+  if (cregno & BDM_REG_CONTROL_REG) {
+    op->code = write ? BDM_WRITE_CTLREG : BDM_READ_CTLREG;
+    op->ioc.address = cregno & BDM_REG_CONTROL_REG_MASK;
+  }
+  else if (cregno & BDM_REG_DEBUG_REG) {
+    op->code = write ? BDM_WRITE_DBREG : BDM_READ_DBREG;
+    op->ioc.address = cregno & BDM_REG_DEBUG_REG_MASK;
+  }
+  else {
+    op->code = write ? BDM_WRITE_SYSREG : BDM_READ_SYSREG;
+    op->ioc.address = cregno;
+  }
+  op->ioc.value = l;
+}
+
+/*
+ * Invalidate the register snapshot.
+ */
+static void
+m68k_bdm_snapshot_invalidate (void)
+{
+  m68k_bdm_snapshot_valid = 0;
+}
+
+/*
+ * Start a new memory cache epoch. All cached pages become stale.
+ */
+static void
+m68k_bdm_mem_invalidate (void)
+{
+  m68k_bdm_mem_epoch++;
+  if (m68k_bdm_mem_epoch == 0) {
+    memset (m68k_bdm_mem_pages, 0, sizeof (m68k_bdm_mem_pages));
+    m68k_bdm_mem_epoch = 1;
+  }
+}
+
+/*
+ * Read the register file into the snapshot with a single batch. If an
+ * operation fails the registers after it are not in the snapshot and
+ * are read one at a time so the error is reported for the register.
+ */
+static void
+m68k_bdm_snapshot_take (void)
+{
+  struct BDMbatchOp* ops = m68k_bdm_snapshot_ops;
+  int                count = 0;
+  int                regno;
+  int                op;
+
+  memset (m68k_bdm_snapshot_have, 0, M68K_BDM_NUM_REGS_BDM);
+
+  for (regno = 0; regno < M68K_BDM_NUM_REGS_BDM; regno++) {
+    int code;
+
+    if (M68K_BDM_REG_FLAGS (regno) & (REG_NOT_ACCESSABLE | REG_WRITE_ONLY))
+      continue;
+
+    m68k_bdm_snapshot[regno * 2] = 0;
+    m68k_bdm_snapshot[(regno * 2) + 1] = 0;
+
+    if (regno < 16) {
+      ops[count].code = BDM_READ_REG;
+      ops[count].ioc.address = regno & 0xf;
+      ops[count].ioc.value = 0;
+      m68k_bdm_snapshot_op_reg[count++] = regno * 2;
+      continue;
+    }
+
+    code = M68K_BDM_REG_CODE (regno);
+
+    if (code & BDM_REG_VIRTUAL_REG) {
+      unsigned long l;
+      m68k_bdm_read_sys_ctl_reg (M68K_BDM_REG_NAME (regno), code, &l);
+      m68k_bdm_snapshot[regno * 2] = l;
+      m68k_bdm_snapshot_have[regno] = 1;
+      continue;
+    }
+
+    m68k_bdm_sys_ctl_reg_op (code, 0, 0, &ops[count]);
+    m68k_bdm_snapshot_op_reg[count++] = regno * 2;
+
+    if (M68K_BDM_REG_TYPE (regno) == M68K_BDM_REG_TYPE_M68881_EXT) {
+      m68k_bdm_sys_ctl_reg_op (code + 1, 0, 0, &ops[count]);
+      m68k_bdm_snapshot_op_reg[count++] = (regno * 2) + 1;
+    }
+  }
+
   if (m68k_bdm_debug_level)
-    printf_filtered ("m68k_bdm_write_sys_ctl_reg: %s (0x%03x)\n",
-                name, cregno & BDM_REG_CONTROL_REG_MASK);
-  if (cregno & BDM_REG_CONTROL_REG)
-    ret = bdmWriteControlRegister (cregno & BDM_REG_CONTROL_REG_MASK, l);
-  else if (cregno & BDM_REG_DEBUG_REG)
-    ret = bdmWriteDebugRegister (cregno & BDM_REG_DEBUG_REG_MASK, l);
-  else
-    ret = bdmWriteSystemRegister (cregno, l);
-  return ret;
+    printf_filtered ("m68k-bdm: register snapshot: %d operations\n", count);
+
+  if ((bdmExecBatch (ops, count) < 0) && m68k_bdm_debug_level)
+    printf_filtered ("m68k-bdm: register snapshot: %s\n", bdmErrorString ());
+
+  for (op = 0; op < count; op++) {
+    int slot = m68k_bdm_snapshot_op_reg[op];
+    if (ops[op].error)
+      break;
+    m68k_bdm_snapshot[slot] = ops[op].ioc.value;
+    /*
+     * An extended register is complete when its second word is read.
+     */
+    if (((slot & 1) == 1) ||
+        (M68K_BDM_REG_TYPE (slot / 2) != M68K_BDM_REG_TYPE_M68881_EXT))
+      m68k_bdm_snapshot_have[slot / 2] = 1;
+  }
+
+  m68k_bdm_snapshot_valid = 1;
 }
 
 /*
@@ -1025,6 +1193,12 @@ m68k_bdm_insert_point (char type, CORE_ADDR addr, int len)
   if (m68k_bdm_debug_level)
     printf_filtered ("m68k-bdm: inserting type:%c @0x%08lx %i\n",
                      type, (unsigned long) addr, len);
+  /*
+   * The debug module registers or the memory under a software
+   * breakpoint change.
+   */
+  m68k_bdm_snapshot_invalidate ();
+  m68k_bdm_mem_invalidate ();
   if ((type == M68K_BDM_WP_TYPE_BREAK) || (type == M68K_BDM_WP_TYPE_HBREAK))
     return m68k_bdm_insert_breakpoint (type, addr, len);
   return m68k_bdm_insert_watchpoint (type, addr, len);
@@ -1036,6 +1210,12 @@ m68k_bdm_remove_point (char type, CORE_ADDR addr, int len)
   if (m68k_bdm_debug_level)
     printf_filtered ("m68k-bdm: removing type:%c @0x%08lx %i\n",
                      type, (unsigned long) addr, len);
+  /*
+   * The debug module registers or the memory under a software
+   * breakpoint change.
+   */
+  m68k_bdm_snapshot_invalidate ();
+  m68k_bdm_mem_invalidate ();
   if ((type == M68K_BDM_WP_TYPE_BREAK) || (type == M68K_BDM_WP_TYPE_HBREAK))
     return m68k_bdm_remove_breakpoint (type, addr, len);
   return m68k_bdm_remove_watchpoint (type, addr, len);
@@ -1173,6 +1353,8 @@ m68k_bdm_reset (void)
 {
   m68k_bdm_have_atemp = 0;
   m68k_bdm_ptid = null_ptid;
+  m68k_bdm_snapshot_invalidate ();
+  m68k_bdm_mem_invalidate ();
   if (bdmReset () < 0)
     m68k_bdm_report_error ();
   m68k_bdm_nap (M68K_BDM_TIME_TO_COME_UP);
@@ -1391,6 +1573,9 @@ savestring (const char *ptr, size_t size)
   return p;
 }
 static void m68k_bdm_close (void);
+#if M68K_BDM_FLASH
+static void m68k_bdm_flash_setup (char* argv[]);
+#endif
 
 /* Start an inferior process and returns its pid.
    ALLARGS is a vector of program-name and args. */
@@ -1428,6 +1613,18 @@ m68k_bdm_create_inferior (char *program, char *argv[])
             fatal ("m68k-bdm: no delay timeout argument found");
           delay = strtoul (argv[arg], 0, 0);
           break;
+#if M68K_BDM_FLASH
+        case 's':
+        case 'p':
+        case 'f':
+          /*
+           * Flash options are handled once the target is open.
+           */
+          arg++;
+          if (!argv[arg])
+            fatal ("m68k-bdm: no argument found for %s", argv[arg - 1]);
+          break;
+#endif
         case 'v':
           m68k_bdm_debug_level++;
           break;
@@ -1650,6 +1847,10 @@ m68k_bdm_create_inferior (char *program, char *argv[])
 
   set_breakpoint_data (m68k_bdm_breakpoint_code, m68k_bdm_breakpoint_size);
 
+#if M68K_BDM_FLASH
+  m68k_bdm_flash_setup (argv);
+#endif
+
   add_thread (m68k_bdm_ptid, NULL, m68k_bdm_ptid);
 
   return m68k_bdm_ptid;
@@ -1745,6 +1946,8 @@ m68k_bdm_resume (struct thread_resume *resume_info)
    * Invalidate the reigsters in the register cache.
    */
   regcache_invalidate ();
+  m68k_bdm_snapshot_invalidate ();
+  m68k_bdm_mem_invalidate ();
   
   if (resume_info->step)
     m68k_bdm_step_chip ();
@@ -1810,6 +2013,13 @@ m68k_bdm_analyze_exception (char* status)
  *       process.
  */
 
+static int
+m68k_bdm_wait_poll (void *arg)
+{
+  check_remote_input_interrupt_request ();
+  return m68k_bdm_get_status ();
+}
+
 static unsigned char
 m68k_bdm_wait (char* status)
 {
@@ -1828,12 +2038,11 @@ m68k_bdm_wait (char* status)
     m68k_bdm_nap (10000);
 
   /*
-   * Wait here till the target requires service
+   * Wait here till the target requires service. Input from GDB wakes
+   * the poller so an interrupt request is handled at once.
    */
-  while ((bdm_stat = m68k_bdm_get_status ()) == 0) {
-    check_remote_input_interrupt_request ();
-    m68k_bdm_nap (20000);
-  }
+  bdm_stat = bdmPollWait (m68k_bdm_wait_poll, NULL,
+                          remote_input_descriptor ());
 
   /*
    * Determine why the target stopped
@@ -1914,6 +2123,8 @@ m68k_bdm_wait (char* status)
       break;
   }
   m68k_bdm_have_atemp = 0;
+  m68k_bdm_snapshot_invalidate ();
+  m68k_bdm_mem_invalidate ();
   return signal;
 }
 
@@ -1932,6 +2143,9 @@ m68k_bdm_fetch_registers (int regno)
   if (regno == 0)
     regno = -1;
 
+  if (!m68k_bdm_snapshot_valid)
+    m68k_bdm_snapshot_take ();
+
   if (regno < 0) {
     for (regno = 1; regno <= M68K_BDM_NUM_REGS_BDM; regno++)
       m68k_bdm_fetch_registers (regno);
@@ -1958,7 +2172,12 @@ m68k_bdm_fetch_registers (int regno)
       return;
     }
     
-    if (regno < 16) {
+    if (m68k_bdm_snapshot_have[regno]) {
+      lu = m68k_bdm_snapshot[regno * 2];
+      ll = m68k_bdm_snapshot[(regno * 2) + 1];
+      ret = 0;
+    }
+    else if (regno < 16) {
       ret = bdmReadRegister (regno, &lu);
     }
     else {
@@ -2003,112 +2222,295 @@ m68k_bdm_fetch_registers (int regno)
 }
 
 /*
- * Store register REGNO, or all user registers if REGNO == -1.
+ * Add the operations that write register REGNO to the batch if GDB has
+ * changed it. Returns the number of operations added.
+ */
+static int
+m68k_bdm_store_register_ops (int regno, struct BDMbatchOp* ops, int* op_reg)
+{
+  unsigned char cbuf[8];
+  unsigned long lu;
+  unsigned long ll;
+  int           code;
+
+  if (M68K_BDM_REG_FLAGS (regno) & REG_NOT_ACCESSABLE) {
+    if (m68k_bdm_debug_level) {
+      printf_filtered ("m68k-bdm: store reg:%s(%i) is not accessable\n",
+                       M68K_BDM_REG_NAME (regno), regno);
+    }
+    return 0;
+  }
+
+  if (M68K_BDM_REG_FLAGS (regno) & REG_READ_ONLY) {
+    if (m68k_bdm_debug_level) {
+      printf_filtered ("m68k-bdm: store reg:%s(%i) is read only\n",
+                       M68K_BDM_REG_NAME (regno), regno);
+    }
+    return 0;
+  }
+
+  if (!collect_register (regno, (char*) cbuf)) {
+    if (m68k_bdm_debug_level) {
+      printf_filtered ("m68k-bdm: store reg:%s(%i) is clean\n",
+                       M68K_BDM_REG_NAME (regno), regno);
+    }
+    return 0;
+  }
+
+  lu = ((unsigned long) cbuf[0] << 24) | ((unsigned long) cbuf[1] << 16) |
+    ((unsigned long) cbuf[2] << 8) | cbuf[3];
+  ll = ((unsigned long) cbuf[4] << 24) | ((unsigned long) cbuf[5] << 16) |
+    ((unsigned long) cbuf[6] << 8) | cbuf[7];
+
+  if (m68k_bdm_debug_level) {
+    if (M68K_BDM_REG_TYPE (regno) == M68K_BDM_REG_TYPE_M68881_EXT)
+      printf_filtered ("m68k-bdm: store reg:%s(%i) = 0x%08lx%08lx\n",
+                       M68K_BDM_REG_NAME (regno), regno, lu, ll);
+    else
+      printf_filtered ("m68k-bdm: store reg:%s(%i) = 0x%08lx\n",
+                       M68K_BDM_REG_NAME (regno), regno, lu);
+  }
+
+  if (regno < 16) {
+    ops[0].code = BDM_WRITE_REG;
+    ops[0].ioc.address = regno;
+    ops[0].ioc.value = lu;
+    op_reg[0] = regno;
+    return 1;
+  }
+
+  code = M68K_BDM_REG_CODE (regno);
+
+  if (code & BDM_REG_VIRTUAL_REG) {
+    if (m68k_bdm_debug_level) {
+      printf_filtered ("m68k-bdm: store reg:%s(%i) is virtual\n",
+                       M68K_BDM_REG_NAME (regno), regno);
+    }
+    return 0;
+  }
+
+  m68k_bdm_sys_ctl_reg_op (code, 1, lu, &ops[0]);
+  op_reg[0] = regno;
+
+  if (M68K_BDM_REG_TYPE (regno) == M68K_BDM_REG_TYPE_M68881_EXT) {
+    m68k_bdm_sys_ctl_reg_op (code + 1, 1, ll, &ops[1]);
+    op_reg[1] = regno;
+    return 2;
+  }
+
+  return 1;
+}
+
+/*
+ * Store register REGNO, or all user registers if REGNO == -1. Only the
+ * registers GDB has changed are written and they are written with a
+ * single batch. The regcache stores all registers when it is invalidated
+ * just before the target is resumed or stepped so the changes from any
+ * number of packets reach the target together.
  */
 void
 m68k_bdm_store_registers (int regno)
 {
+  struct BDMbatchOp* ops = m68k_bdm_snapshot_ops;
+  int*               op_reg = m68k_bdm_snapshot_op_reg;
+  int                count = 0;
+  int                first;
+  int                last;
+  int                op;
+
   /* ??? Some callers use 0 to mean all registers.  */
   if (regno == 0)
     regno = -1;
 
   if (regno == -1) {
-    for (regno = 1; regno <= M68K_BDM_NUM_REGS_BDM; regno++)
-      m68k_bdm_store_registers (regno);
+    first = 0;
+    last = M68K_BDM_NUM_REGS_BDM - 1;
   }
   else {
-    unsigned char cbuf[8];
-
     /*
      * Drop down to be from 0..M68K_BDM_NUM_REGS_BDM.
      */
-    regno--;
-    
-    if (M68K_BDM_REG_FLAGS (regno) & REG_NOT_ACCESSABLE) {
-      if (m68k_bdm_debug_level) {
-        printf_filtered ("m68k-bdm: store reg:%s(%i) is not accessable\n",
-                         M68K_BDM_REG_NAME (regno), regno);
-      }
+    first = last = regno - 1;
+    if (last >= M68K_BDM_NUM_REGS_BDM) {
+      error ("m68k-bdm: bad register number (%d)", last);
       return;
     }
-    
-    if (M68K_BDM_REG_FLAGS (regno) & REG_READ_ONLY) {
-      if (m68k_bdm_debug_level) {
-        printf_filtered ("m68k-bdm: store reg:%s(%i) is read only\n",
-                         M68K_BDM_REG_NAME (regno), regno);
-      }
-      return;
-    }
-    
-    if (collect_register (regno, (char*) cbuf)) {
-      int ret;
-
-      unsigned long lu = 0;
-      unsigned long ll = 0;
-      
-      lu = (cbuf[0] << 24) | (cbuf[1] << 16) | (cbuf[2] << 8) | cbuf[3];
-      ll = (cbuf[4] << 24) | (cbuf[5] << 16) | (cbuf[6] << 8) | cbuf[7];
-    
-      if (m68k_bdm_debug_level) {
-      if (M68K_BDM_REG_TYPE (regno) == M68K_BDM_REG_TYPE_M68881_EXT)
-        printf_filtered ("m68k-bdm: store reg:%s(%i) = 0x%08lx%08lx\n",
-                         M68K_BDM_REG_NAME (regno), regno, lu, ll);
-      else
-        printf_filtered ("m68k-bdm: store reg:%s(%i) = 0x%08lx\n",
-                         M68K_BDM_REG_NAME (regno), regno, lu);
-      }
+  }
 
-      if (regno < 16) {
-        ret = bdmWriteRegister (regno, lu);
-      }
-      else {
-        if (regno < M68K_BDM_NUM_REGS_BDM) {
-          ret = m68k_bdm_write_sys_ctl_reg (M68K_BDM_REG_NAME (regno),
-                                            M68K_BDM_REG_CODE (regno),
-                                            lu);
-          if ((ret == 0) ||
-              (M68K_BDM_REG_TYPE (regno) == M68K_BDM_REG_TYPE_M68881_EXT))
-            ret = m68k_bdm_write_sys_ctl_reg (M68K_BDM_REG_NAME (regno),
-                                              M68K_BDM_REG_CODE (regno) + 1,
-                                              ll);
-        }
-        else {
-          error ("m68k-bdm: bad register number (%d)", regno);
-          return;
-        }
-      }
-      if (ret < 0)
-        m68k_bdm_report_error ();
+  /*
+   * The snapshot's batch buffers are big enough for every register
+   * and the snapshot is stale once anything is written.
+   */
+  for (regno = first; regno <= last; regno++)
+    count += m68k_bdm_store_register_ops (regno, &ops[count], &op_reg[count]);
+
+  if (count == 0)
+    return;
+
+  m68k_bdm_snapshot_invalidate ();
+
+  /*
+   * Control registers such as MBAR, RAMBAR, FLASHBAR or VBR can move
+   * what is seen at an address, and on the CPU32 the SFC and DFC select
+   * the address space, so the cached pages are stale once they change.
+   */
+  for (op = 0; op < count; op++)
+    if ((ops[op].code == BDM_WRITE_CTLREG) ||
+        ((ops[op].code == BDM_WRITE_SYSREG) &&
+         (ops[op].ioc.address != BDM_REG_RPC) &&
+         (ops[op].ioc.address != BDM_REG_SR)))
+      break;
+  if (op < count)
+    m68k_bdm_mem_invalidate ();
+
+  if (m68k_bdm_debug_level)
+    printf_filtered ("m68k-bdm: store registers: %d operations\n", count);
+
+  if (bdmExecBatch (ops, count) < 0) {
+    for (op = 0; op < count; op++)
+      if (ops[op].error)
+        break;
+    if (op < count)
+      printf_filtered ("m68k-bdm: store reg:%s(%i) failed\n",
+                       M68K_BDM_REG_NAME (op_reg[op]), op_reg[op]);
+    m68k_bdm_report_error ();
+  }
+}
+
+/*
+ * Is any part of the page at ADDR uncacheable ?
+ */
+static int
+m68k_bdm_mem_cacheable (CORE_ADDR addr)
+{
+  int r;
+  if (!m68k_bdm_mem_cache_on)
+    return 0;
+  for (r = 0; r < m68k_bdm_mem_nocache_count; r++)
+    if ((addr <= m68k_bdm_mem_nocache[r].end) &&
+        ((addr + M68K_BDM_MEM_PAGE_SIZE - 1) >= m68k_bdm_mem_nocache[r].start))
+      return 0;
+  return 1;
+}
+
+/*
+ * Find the page at ADDR if it is valid in this epoch.
+ */
+static struct m68k_bdm_mem_page*
+m68k_bdm_mem_find (CORE_ADDR addr)
+{
+  int p;
+  for (p = 0; p < M68K_BDM_MEM_PAGES; p++)
+    if ((m68k_bdm_mem_pages[p].epoch == m68k_bdm_mem_epoch) &&
+        (m68k_bdm_mem_pages[p].addr == addr)) {
+      m68k_bdm_mem_pages[p].used = ++m68k_bdm_mem_clock;
+      return &m68k_bdm_mem_pages[p];
     }
-    else {
-      if (m68k_bdm_debug_level) {
-        printf_filtered ("m68k-bdm: store reg:%s(%i) is clean\n",
-                         M68K_BDM_REG_NAME (regno), regno);
-      }
+  return NULL;
+}
+
+/*
+ * Read the page at ADDR into a stale or the least recently used page.
+ * Returns NULL if the page cannot be read as a whole.
+ */
+static struct m68k_bdm_mem_page*
+m68k_bdm_mem_fill (CORE_ADDR addr)
+{
+  struct m68k_bdm_mem_page* page = &m68k_bdm_mem_pages[0];
+  int                       p;
+
+  for (p = 0; p < M68K_BDM_MEM_PAGES; p++) {
+    if (m68k_bdm_mem_pages[p].epoch != m68k_bdm_mem_epoch) {
+      page = &m68k_bdm_mem_pages[p];
+      break;
     }
+    if (m68k_bdm_mem_pages[p].used < page->used)
+      page = &m68k_bdm_mem_pages[p];
   }
+
+  page->epoch = 0;
+
+  if (bdmReadMemory (addr, page->data, M68K_BDM_MEM_PAGE_SIZE) < 0)
+    return NULL;
+
+  page->addr = addr;
+  page->epoch = m68k_bdm_mem_epoch;
+  page->used = ++m68k_bdm_mem_clock;
+  return page;
 }
 
 static int
 m68k_bdm_read_memory (CORE_ADDR memaddr, unsigned char *myaddr, int len)
 {
-  int ret = 0;
-  if (bdmReadMemory (memaddr, myaddr, len) < 0) {
-    m68k_bdm_report_error ();
-    ret = EIO;
+  while (len > 0) {
+    CORE_ADDR                 addr = memaddr & ~(M68K_BDM_MEM_PAGE_SIZE - 1);
+    int                       offset = memaddr - addr;
+    int                       size = M68K_BDM_MEM_PAGE_SIZE - offset;
+    struct m68k_bdm_mem_page* page = NULL;
+
+    if (size > len)
+      size = len;
+
+    if (m68k_bdm_mem_cacheable (addr)) {
+      page = m68k_bdm_mem_find (addr);
+      if (page)
+        m68k_bdm_mem_hits++;
+      else {
+        m68k_bdm_mem_misses++;
+        page = m68k_bdm_mem_fill (addr);
+      }
+    }
+
+    /*
+     * Uncacheable memory or a page that cannot be read as a whole, for
+     * example at the end of a memory region, is read as asked for.
+     */
+    if (page)
+      memcpy (myaddr, page->data + offset, size);
+    else if (bdmReadMemory (memaddr, myaddr, size) < 0) {
+      m68k_bdm_report_error ();
+      return EIO;
+    }
+
+    memaddr += size;
+    myaddr += size;
+    len -= size;
   }
-  return ret;
+  return 0;
 }
 
 static int
 m68k_bdm_write_memory (CORE_ADDR memaddr, const unsigned char *myaddr, int len)
 {
-  int ret = 0;
+  int p;
+
   if (bdmWriteMemory (memaddr, (unsigned char*) myaddr, len) < 0) {
     m68k_bdm_report_error ();
-    ret = EIO;
+    m68k_bdm_mem_invalidate ();
+    return EIO;
   }
-  return ret;
+
+  /*
+   * Write through to any cached pages the data overlaps.
+   */
+  for (p = 0; p < M68K_BDM_MEM_PAGES; p++) {
+    struct m68k_bdm_mem_page* page = &m68k_bdm_mem_pages[p];
+    CORE_ADDR                 start;
+    CORE_ADDR                 end;
+
+    if (page->epoch != m68k_bdm_mem_epoch)
+      continue;
+
+    start = memaddr > page->addr ? memaddr : page->addr;
+    end = memaddr + len;
+    if (end > (page->addr + M68K_BDM_MEM_PAGE_SIZE))
+      end = page->addr + M68K_BDM_MEM_PAGE_SIZE;
+
+    if (start < end)
+      memcpy (page->data + (start - page->addr),
+              myaddr + (start - memaddr), end - start);
+  }
+  return 0;
 }
 
 static void
@@ -2214,6 +2616,25 @@ m68k_bdm_cmd_help (void)
   monitor_output ("    Reset the BDM pod\n");
   monitor_output ("  bdm-sleep\n");
   monitor_output ("    Sleep the require number of milliseconds.\n");
+  monitor_output ("  bdm-mem-cache [on|off|flush]\n");
+  monitor_output ("    Control the target memory cache. It is off by " \
+                  "default. With no\n");
+  monitor_output ("    argument show the cache state and the uncacheable " \
+                  "ranges.\n");
+  monitor_output ("  bdm-mem-nocache <addr> <length>|clear\n");
+  monitor_output ("    Do not cache the memory range, for example " \
+                  "peripheral or\n");
+  monitor_output ("    MBAR space. clear removes all ranges.\n");
+  monitor_output ("  bdm-poll [<min-usecs> <max-usecs> <tight>]\n");
+  monitor_output ("    Set how the running target's status is polled. The " \
+                  "first <tight>\n");
+  monitor_output ("    polls are <min-usecs> apart, then the interval " \
+                  "doubles up to\n");
+  monitor_output ("    <max-usecs>. With no arguments show the policy.\n");
+  monitor_output ("  bdm-stats [reset]\n");
+  monitor_output ("    Show the count, errors, bytes and latency of each " \
+                  "kind of BDM\n");
+  monitor_output ("    request since the BDM was opened, or reset them.\n");
 }
 
 static int
@@ -2262,6 +2683,8 @@ m68k_bdm_commands (const char* command, int len)
     if (m68k_bdm_debug_level)
       printf_filtered ("m68k-bdm: set control reg: 0x%03x = %ld (0x%0lx)\n",
                        reg, value, value);
+    m68k_bdm_snapshot_invalidate ();
+    m68k_bdm_mem_invalidate ();
     if (bdmWriteControlRegister (reg, value) < 0)
       monitor_output ("m68k-bdm: error: %s\n", bdmErrorString ());
   }
@@ -2286,6 +2709,8 @@ m68k_bdm_commands (const char* command, int len)
     if (m68k_bdm_debug_level)
       printf_filtered ("m68k-bdm: set debug reg: 0x%03x = %ld (0x%0lx)\n",
                        reg, value, value);
+    m68k_bdm_snapshot_invalidate ();
+    m68k_bdm_mem_invalidate ();
     if (bdmWriteDebugRegister (reg, value) < 0)
       monitor_output ("m68k-bdm: error: %s\n", bdmErrorString ());
   }
@@ -2307,7 +2732,145 @@ m68k_bdm_commands (const char* command, int len)
       select (0, NULL, NULL, NULL, &tv);
     }
 #endif    
-  }  else {
+  }
+  else if (M68K_BDM_STR_IS (command, "bdm-mem-cache")) {
+    const char* arg = command + sizeof ("bdm-mem-cache") - 1;
+    while (*arg == ' ')
+      arg++;
+    if (M68K_BDM_STR_IS (arg, "on"))
+      m68k_bdm_mem_cache_on = 1;
+    else if (M68K_BDM_STR_IS (arg, "off"))
+      m68k_bdm_mem_cache_on = 0;
+    else if (M68K_BDM_STR_IS (arg, "flush"))
+      ;
+    else if (*arg == '\0') {
+      int r;
+      monitor_output ("m68k-bdm: memory cache: %s, hits:%lu misses:%lu\n",
+                      m68k_bdm_mem_cache_on ? "on" : "off",
+                      m68k_bdm_mem_hits, m68k_bdm_mem_misses);
+      for (r = 0; r < m68k_bdm_mem_nocache_count; r++)
+        monitor_output ("m68k-bdm: uncacheable: 0x%08lx - 0x%08lx\n",
+                        (unsigned long) m68k_bdm_mem_nocache[r].start,
+                        (unsigned long) m68k_bdm_mem_nocache[r].end);
+    }
+    else {
+      monitor_output ("m68k-bdm: invalid command format: %s\n", arg);
+      return 0;
+    }
+    m68k_bdm_mem_invalidate ();
+  }
+  else if (M68K_BDM_STR_IS (command, "bdm-mem-nocache")) {
+    const char*   arg = command + sizeof ("bdm-mem-nocache") - 1;
+    char*         end;
+    unsigned long addr;
+    unsigned long length;
+    while (*arg == ' ')
+      arg++;
+    if (M68K_BDM_STR_IS (arg, "clear")) {
+      free (m68k_bdm_mem_nocache);
+      m68k_bdm_mem_nocache = NULL;
+      m68k_bdm_mem_nocache_count = 0;
+      return 1;
+    }
+    addr = strtoul (arg, &end, 0);
+    if (end == arg) {
+      monitor_output ("m68k-bdm: invalid command format: no address found\n");
+      return 0;
+    }
+    arg = end;
+    length = strtoul (arg, &end, 0);
+    if ((end == arg) || (length == 0)) {
+      monitor_output ("m68k-bdm: invalid command format: no length found\n");
+      return 0;
+    }
+    m68k_bdm_mem_nocache =
+      realloc (m68k_bdm_mem_nocache,
+               (m68k_bdm_mem_nocache_count + 1) *
+               sizeof (struct m68k_bdm_mem_range));
+    if (!m68k_bdm_mem_nocache)
+      fatal ("m68k-bdm: no memory for uncacheable ranges");
+    m68k_bdm_mem_nocache[m68k_bdm_mem_nocache_count].start = addr;
+    m68k_bdm_mem_nocache[m68k_bdm_mem_nocache_count].end =
+      (CORE_ADDR) addr + length - 1;
+    m68k_bdm_mem_nocache_count++;
+    if (m68k_bdm_debug_level)
+      printf_filtered ("m68k-bdm: uncacheable: 0x%08lx - 0x%08lx\n",
+                       addr, addr + length - 1);
+    m68k_bdm_mem_invalidate ();
+  }
+  else if (M68K_BDM_STR_IS (command, "bdm-poll")) {
+    const char*   arg = command + sizeof ("bdm-poll") - 1;
+    char*         end;
+    unsigned long min_usecs;
+    unsigned long max_usecs;
+    unsigned int  tight;
+    while (*arg == ' ')
+      arg++;
+    if (*arg) {
+      min_usecs = strtoul (arg, &end, 0);
+      if (end == arg) {
+        monitor_output ("m68k-bdm: invalid command format: no minimum found\n");
+        return 0;
+      }
+      arg = end;
+      max_usecs = strtoul (arg, &end, 0);
+      if (end == arg) {
+        monitor_output ("m68k-bdm: invalid command format: no maximum found\n");
+        return 0;
+      }
+      arg = end;
+      tight = strtoul (arg, &end, 0);
+      if (end == arg) {
+        monitor_output ("m68k-bdm: invalid command format: no tight count found\n");
+        return 0;
+      }
+      if (bdmSetPollPolicy (min_usecs, max_usecs, tight) < 0) {
+        monitor_output ("m68k-bdm: error: %s\n", bdmErrorString ());
+        return 0;
+      }
+    }
+    bdmGetPollPolicy (&min_usecs, &max_usecs, &tight);
+    monitor_output ("m68k-bdm: poll: %u polls %lu usecs apart, " \
+                    "backing off to %lu usecs\n",
+                    tight, min_usecs, max_usecs);
+  }
+  else if (M68K_BDM_STR_IS (command, "bdm-stats")) {
+    const char*        arg = command + sizeof ("bdm-stats") - 1;
+    unsigned long long elapsed;
+    unsigned long long busy;
+    bdmStats           stats;
+    int                slot;
+    while (*arg == ' ')
+      arg++;
+    if (M68K_BDM_STR_IS (arg, "reset")) {
+      bdmResetStats ();
+      return 1;
+    }
+    if (*arg) {
+      monitor_output ("m68k-bdm: invalid command format: %s\n", arg);
+      return 0;
+    }
+    bdmGetStatsTimes (&elapsed, &busy);
+    monitor_output ("m68k-bdm: stats: %.3f secs, %.3f secs in the BDM " \
+                    "interface (%.0f%%)\n",
+                    elapsed / 1000000.0, busy / 1000000.0,
+                    elapsed ? (busy * 100.0) / elapsed : 0.0);
+    monitor_output ("m68k-bdm: %-12s %9s %7s %11s %10s %8s %8s %8s\n",
+                    "request", "calls", "errors", "bytes", "total ms",
+                    "p50 us", "p99 us", "max us");
+    for (slot = 0; bdmGetStats (slot, &stats) == 0; slot++) {
+      if (!stats.calls)
+        continue;
+      monitor_output ("m68k-bdm: %-12s %9lu %7lu %11llu %10.1f %8lu " \
+                      "%8lu %8lu\n",
+                      stats.name, stats.calls, stats.errors, stats.bytes,
+                      stats.usecs / 1000.0,
+                      bdmStatsPercentile (&stats, 50),
+                      bdmStatsPercentile (&stats, 99),
+                      stats.maxUsecs);
+    }
+  }
+  else {
     monitor_output ("Unknown monitor command.\n\n");
     m68k_bdm_cmd_help ();
     return 0;
@@ -2315,6 +2878,447 @@ m68k_bdm_commands (const char* command, int len)
   return 1;
 }
 
+#if M68K_BDM_FLASH
+/*
+ * Flash programming. The memory map GDB is given comes from the flash
+ * library's memory areas so GDB knows where flash is and loads it with
+ * the vFlash packets. Erases and writes are held on the host until
+ * vFlashDone, when the erased sectors are erased and the data is
+ * programmed in as few runs as possible so the plugins get large
+ * blocks to work on.
+ */
+
+/*
+ * Written bytes this close together are programmed as one run. The
+ * bytes between are erased so programming them changes nothing.
+ */
+#define M68K_BDM_FLASH_GAP 64
+
+struct m68k_bdm_flash_block
+{
+  uint32_t                     start;
+  uint32_t                     length;
+  unsigned char*               data;
+  unsigned char*               written;
+  struct m68k_bdm_flash_block* next;
+};
+
+static struct m68k_bdm_flash_block* m68k_bdm_flash_blocks;
+
+/*
+ * Handle the -s, -p and -f options once the target is open. They are
+ * applied in the order given, so variables come before the flash that
+ * uses them.
+ */
+static void
+m68k_bdm_flash_setup (char* argv[])
+{
+  int arg;
+
+  for (arg = 0; argv[arg]; arg++) {
+    char* opt = argv[arg];
+    char* value;
+    char* p;
+
+    if (opt[0] != '-')
+      continue;
+    if (opt[1] == 't') {
+      arg++;
+      continue;
+    }
+    if ((opt[1] != 's') && (opt[1] != 'p') && (opt[1] != 'f'))
+      continue;
+
+    arg++;
+    if (!argv[arg][0])
+      fatal ("m68k-bdm: empty argument for %s", opt);
+    value = savestring (argv[arg], strlen (argv[arg]));
+
+    if (opt[1] == 's') {
+      p = strchr (value, '=');
+      if (!p)
+        fatal ("m68k-bdm: flash variable not NAME=VALUE: %s", value);
+      *p++ = '\0';
+      flash_set_var (value, strtoul (p, 0, 0));
+    }
+    else if (opt[1] == 'p') {
+      char*         plugins[64];
+      int           count = 0;
+      unsigned long addr = strtoul (strtok (value, ","), 0, 0);
+      unsigned long len;
+
+      p = strtok (NULL, ",");
+      if (!p)
+        fatal ("m68k-bdm: no flash plugin RAM length found");
+      len = strtoul (p, 0, 0);
+      while ((count < 63) && ((p = strtok (NULL, ",")) != NULL))
+        plugins[count++] = p;
+      plugins[count] = NULL;
+      flash_plugin (m68k_bdm_debug_level ? printf_filtered : NULL,
+                    addr, len, plugins);
+      if (m68k_bdm_debug_level)
+        printf_filtered ("\n");
+    }
+    else {
+      char          name[1024];
+      unsigned long addr = strtoul (strtok (value, ","), 0, 0);
+
+      name[0] = '\0';
+      if (flash_register (name, addr, strtok (NULL, ",")))
+        printf_filtered ("m68k-bdm: flash at 0x%08lx: %s\n", addr, name);
+      else
+        warning ("m68k-bdm: no flash found at 0x%08lx", addr);
+    }
+
+    free (value);
+  }
+}
+
+/*
+ * Add a line to the memory map document at DOC, which holds SIZE
+ * bytes.
+ */
+static char*
+m68k_bdm_memory_map_add (char* doc, int* size, const char* line)
+{
+  int len = doc ? strlen (doc) : 0;
+  int need = len + strlen (line) + 1;
+
+  if (need > *size) {
+    *size = need + 1024;
+    doc = realloc (doc, *size);
+    if (!doc)
+      error ("m68k-bdm: no memory for the memory map");
+    doc[len] = '\0';
+  }
+  strcat (doc, line);
+  return doc;
+}
+
+/*
+ * Build the memory map from the flash library's memory areas. Flash is
+ * split into regions of equal sized sectors as GDB erases a region's
+ * blocks by its one block size. A flash without a known sector layout
+ * is one block.
+ */
+static char*
+m68k_bdm_memory_map (void)
+{
+  char*    doc = NULL;
+  int      size = 0;
+  char     line[256];
+  int      index;
+  uint32_t adr;
+  uint32_t end;
+  int      flash;
+
+  doc = m68k_bdm_memory_map_add (doc, &size,
+                                 "<?xml version=\"1.0\"?>\n" \
+                                 "<!DOCTYPE memory-map\n" \
+                                 "  PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\"\n" \
+                                 "  \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n" \
+                                 "<memory-map>\n");
+
+  for (index = 0; flash_area (index, &adr, &end, &flash); index++) {
+    unsigned long long pos = adr;
+
+    if (!flash) {
+      snprintf (line, sizeof (line),
+                "  <memory type=\"ram\" start=\"0x%08lx\" length=\"0x%llx\"/>\n",
+                (unsigned long) adr, ((unsigned long long) end - adr) + 1);
+      doc = m68k_bdm_memory_map_add (doc, &size, line);
+      continue;
+    }
+
+    while (pos <= end) {
+      flash_sector_t     sec;
+      unsigned long long start = pos;
+      uint32_t           blocksize;
+
+      if (!flash_sector (pos, &sec) || (sec.start != pos) || !sec.size ||
+          ((pos + (sec.size - 1)) > end))
+        blocksize = (end - pos) + 1;
+      else {
+        blocksize = sec.size;
+        while (((pos + (2ULL * blocksize) - 1) <= end) &&
+               flash_sector (pos + blocksize, &sec) &&
+               (sec.start == (pos + blocksize)) && (sec.size == blocksize))
+          pos += blocksize;
+      }
+      pos += blocksize;
+
+      snprintf (line, sizeof (line),
+                "  <memory type=\"flash\" start=\"0x%08lx\" length=\"0x%llx\">\n" \
+                "    <property name=\"blocksize\">0x%lx</property>\n" \
+                "  </memory>\n",
+                (unsigned long) start, pos - start,
+                (unsigned long) blocksize);
+      doc = m68k_bdm_memory_map_add (doc, &size, line);
+    }
+  }
+
+  return m68k_bdm_memory_map_add (doc, &size, "</memory-map>\n");
+}
+
+/*
+ * Is the whole of ADDR to ADDR + LEN flash?
+ */
+static int
+m68k_bdm_flash_is_flash (CORE_ADDR addr, unsigned int len)
+{
+  int      index;
+  uint32_t adr;
+  uint32_t end;
+  int      flash;
+
+  for (index = 0; flash_area (index, &adr, &end, &flash); index++)
+    if ((adr <= addr) && (addr <= end))
+      return flash && ((addr + (len - 1)) <= end);
+  return 0;
+}
+
+static void
+m68k_bdm_flash_free (void)
+{
+  while (m68k_bdm_flash_blocks) {
+    struct m68k_bdm_flash_block* block = m68k_bdm_flash_blocks;
+    m68k_bdm_flash_blocks = block->next;
+    free (block->data);
+    free (block->written);
+    free (block);
+  }
+}
+
+/*
+ * Note the erase and hold a block of erased flash for the writes.
+ */
+static int
+m68k_bdm_flash_erase (CORE_ADDR addr, unsigned int len)
+{
+  struct m68k_bdm_flash_block*  block;
+  struct m68k_bdm_flash_block** prev;
+
+  if (m68k_bdm_debug_level)
+    printf_filtered ("m68k-bdm: flash erase: 0x%08lx %u\n",
+                     (unsigned long) addr, len);
+
+  if (!len || !m68k_bdm_flash_is_flash (addr, len))
+    return -1;
+
+  for (prev = &m68k_bdm_flash_blocks; *prev; prev = &(*prev)->next) {
+    if ((addr + (len - 1)) < (*prev)->start)
+      break;
+    if (addr <= ((*prev)->start + ((*prev)->length - 1)))
+      return -1;
+  }
+
+  block = calloc (1, sizeof (*block));
+  if (!block)
+    return -1;
+  block->data = malloc (len);
+  block->written = calloc (len, 1);
+  if (!block->data || !block->written) {
+    free (block->data);
+    free (block->written);
+    free (block);
+    return -1;
+  }
+  memset (block->data, 0xff, len);
+  block->start = addr;
+  block->length = len;
+  block->next = *prev;
+  *prev = block;
+  return 0;
+}
+
+/*
+ * Copy written data into the erased blocks.
+ */
+static int
+m68k_bdm_flash_write (CORE_ADDR addr, const unsigned char *myaddr,
+                      unsigned int len)
+{
+  struct m68k_bdm_flash_block* block = m68k_bdm_flash_blocks;
+
+  while (len) {
+    unsigned int offset;
+    unsigned int size;
+
+    while (block && ((block->start + (block->length - 1)) < addr))
+      block = block->next;
+    if (!block || (addr < block->start))
+      return -1;
+
+    offset = addr - block->start;
+    size = block->length - offset;
+    if (size > len)
+      size = len;
+
+    memcpy (block->data + offset, myaddr, size);
+    memset (block->written + offset, 1, size);
+
+    addr += size;
+    myaddr += size;
+    len -= size;
+  }
+  return 0;
+}
+
+/*
+ * Erase the sectors of BLOCK. Sectors the chip can check and reports
+ * blank are left alone.
+ */
+static int
+m68k_bdm_flash_erase_block (struct m68k_bdm_flash_block* block)
+{
+  uint32_t       pos = block->start;
+  uint32_t       end = block->start + (block->length - 1);
+  flash_sector_t sec;
+
+  while (pos <= end) {
+    if (!flash_sector (pos, &sec)) {
+      sec.start = pos;
+      sec.size = (end - pos) + 1;
+      sec.erase_arg = -1;
+      sec.erase_wait = 1;
+      sec.blank_chk = 0;
+      sec.no_reprogram = 0;
+    }
+
+    if ((sec.start != pos) || ((sec.start + (sec.size - 1)) > end)) {
+      warning ("m68k-bdm: flash erase 0x%08lx not on a sector boundary",
+               (unsigned long) pos);
+      return -1;
+    }
+
+    if (!sec.blank_chk || (flash_blank_chk (pos, sec.erase_arg) != 1)) {
+      if (m68k_bdm_debug_level)
+        printf_filtered ("m68k-bdm: flash erase sector: 0x%08lx %lu\n",
+                         (unsigned long) sec.start,
+                         (unsigned long) sec.size);
+      if (!flash_erase (pos, sec.erase_arg))
+        return -1;
+      if (sec.erase_wait && !flash_erase_wait (pos))
+        return -1;
+    }
+
+    if ((sec.start + (sec.size - 1)) >= end)
+      break;
+    pos += sec.size;
+  }
+  return 0;
+}
+
+/*
+ * Program the written runs of BLOCK. Runs start and end on long words
+ * and a small gap is programmed with the erased value rather than
+ * starting another run.
+ */
+static int
+m68k_bdm_flash_program_block (struct m68k_bdm_flash_block* block)
+{
+  uint32_t offset = 0;
+
+  while (offset < block->length) {
+    uint32_t first;
+    uint32_t last;
+    uint32_t count;
+
+    while ((offset < block->length) && !block->written[offset])
+      offset++;
+    if (offset == block->length)
+      break;
+
+    first = offset & ~3;
+    last = offset;
+    while ((offset < block->length) &&
+           ((offset - last) <= M68K_BDM_FLASH_GAP)) {
+      if (block->written[offset])
+        last = offset;
+      offset++;
+    }
+    last |= 3;
+    if (last >= block->length)
+      last = block->length - 1;
+
+    count = (last - first) + 1;
+    if (m68k_bdm_debug_level)
+      printf_filtered ("m68k-bdm: flash program: 0x%08lx %lu\n",
+                       (unsigned long) (block->start + first),
+                       (unsigned long) count);
+    if (write_memory (block->start + first, block->data + first,
+                      count) != count)
+      return -1;
+  }
+  return 0;
+}
+
+/*
+ * Registers the plugins can change.
+ */
+#define M68K_BDM_FLASH_REGS (16 + 2)
+
+static void
+m68k_bdm_flash_regs (struct BDMbatchOp* ops, int write)
+{
+  int r;
+  for (r = 0; r < 16; r++) {
+    ops[r].code = write ? BDM_WRITE_REG : BDM_READ_REG;
+    ops[r].ioc.address = r;
+  }
+  ops[16].code = write ? BDM_WRITE_SYSREG : BDM_READ_SYSREG;
+  ops[16].ioc.address = BDM_REG_RPC;
+  ops[17].code = write ? BDM_WRITE_SYSREG : BDM_READ_SYSREG;
+  ops[17].ioc.address = BDM_REG_SR;
+}
+
+/*
+ * Erase and program everything held. The plugins run on the target so
+ * the registers they use are saved and put back after.
+ */
+static int
+m68k_bdm_flash_done (void)
+{
+  struct m68k_bdm_flash_block* block;
+  struct BDMbatchOp            regs[M68K_BDM_FLASH_REGS];
+  int                          ret = 0;
+
+  if (!m68k_bdm_flash_blocks)
+    return 0;
+
+  regcache_invalidate ();
+  m68k_bdm_snapshot_invalidate ();
+
+  memset (regs, 0, sizeof (regs));
+  m68k_bdm_flash_regs (regs, 0);
+  if (bdmExecBatch (regs, M68K_BDM_FLASH_REGS) < 0) {
+    m68k_bdm_report_error ();
+    m68k_bdm_flash_free ();
+    return -1;
+  }
+
+  for (block = m68k_bdm_flash_blocks; block && !ret; block = block->next)
+    ret = m68k_bdm_flash_erase_block (block);
+
+  for (block = m68k_bdm_flash_blocks; block && !ret; block = block->next)
+    ret = m68k_bdm_flash_program_block (block);
+
+  if (ret)
+    warning ("m68k-bdm: flash programming failed");
+
+  m68k_bdm_flash_regs (regs, 1);
+  if (bdmExecBatch (regs, M68K_BDM_FLASH_REGS) < 0) {
+    m68k_bdm_report_error ();
+    ret = -1;
+  }
+
+  m68k_bdm_snapshot_invalidate ();
+  m68k_bdm_mem_invalidate ();
+  m68k_bdm_flash_free ();
+  return ret;
+}
+#endif
+
 static struct target_ops m68k_bdm_target_ops = {
   m68k_bdm_create_inferior,
   m68k_bdm_attach,
@@ -2340,7 +3344,18 @@ static struct target_ops m68k_bdm_target_ops = {
   m68k_bdm_arch_string,
   NULL,
   m68k_bdm_xml,
-  m68k_bdm_commands
+  m68k_bdm_commands,
+#if M68K_BDM_FLASH
+  m68k_bdm_memory_map,
+  m68k_bdm_flash_erase,
+  m68k_bdm_flash_write,
+  m68k_bdm_flash_done
+#else
+  NULL,
+  NULL,
+  NULL,
+  NULL
+#endif
 };
 
 int using_threads;
@@ -188,7 +188,7 @@ registers_to_string (char *buf)
             {
               if (remote_debug)
                 printf_filtered ("m68k-bdm: adding register %d to response\n", i);
-              fetch_inferior_registers (i);
+              fetch_inferior_registers (i + 1);
             }
         }
       convert_int_to_ascii(regptr, bufptr, reg_defs[i].size / 8);
@@ -223,7 +223,7 @@ registers_from_string (char *buf)
     if (register_dirty (i) &&
         (reg_defs[i].flags & REG_NON_CACHEABLE) &&
         ((reg_defs[i].flags & (REG_NOT_ACCESSABLE | REG_READ_ONLY)) == 0))
-        store_inferior_registers (i);
+        store_inferior_registers (i + 1);
 }
 
 struct reg *
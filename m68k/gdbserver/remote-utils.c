@@ -97,6 +97,10 @@ static int remote_desc = INVALID_DESCRIPTOR;
 
 static int remote_piping;
 
+/* Set once GDB's side of the connection has been found closed.  It
+   stays readable, so it is not checked for interrupts again.  */
+static int remote_input_closed;
+
 /* FIXME headerize? */
 extern int using_threads;
 extern int debug_threads;
@@ -126,6 +130,7 @@ remote_open (char *name)
 #endif
   char *port_str;
   
+  remote_input_closed = 0;
   port_str = strchr (name, ':');
   
   if ((port_str == NULL) || (strcmp (name, "pipe") == 0))
@@ -616,13 +621,13 @@ putpkt_binary (char *buf, int cnt)
 	{
 	  printf_filtered ("putpkt (\"%s\"); [looking for ack]\n", buf2);
 	}
-      cc = remote_read (remote_desc, buf3, 1);
-      if (remote_debug)
-	{
-          printf_filtered ("putpkt [received '%c' (0x%x)]\n", buf3[0], buf3[0]);
-	}
+      /* An interrupted read is retried.  Sending the packet again
+	 could repeat one GDB has already received.  */
+      do
+	cc = remote_read (remote_desc, buf3, 1);
+      while (cc < 0 && (errno == EINTR || errno == EAGAIN));
 
-      if (cc <= 0)
+      if (cc != 1)
 	{
 	  if (cc == 0)
 	    printf_filtered ("putpkt(read): Got EOF\n");
@@ -633,6 +638,11 @@ putpkt_binary (char *buf, int cnt)
 	  return -1;
 	}
 
+      if (remote_debug)
+	{
+          printf_filtered ("putpkt [received '%c' (0x%x)]\n", buf3[0], buf3[0]);
+	}
+
       /* Check for an input interrupt while we're here.  */
       if (buf3[0] == '\003')
 	(*the_target->request_interrupt) ();
@@ -667,6 +677,9 @@ input_interrupt (int unused)
   fd_set readset;
   struct timeval immediate = { 0, 0 };
 
+  if (remote_input_closed)
+    return;
+
   /* Protect against spurious interrupts.  This has been observed to
      be a problem under NetBSD 1.4 and 1.5.  */
 
@@ -679,6 +692,16 @@ input_interrupt (int unused)
 
       cc = remote_read (remote_desc, &c, 1);
 
+      if (cc < 0 && (errno == EINTR || errno == EAGAIN))
+	return;
+
+      if (cc <= 0)
+	{
+	  warning ("input_interrupt, remote connection closed\n");
+	  remote_input_closed = 1;
+	  return;
+	}
+
       if (cc != 1 || c != '\003')
 	{
 	  warning ("input_interrupt, count = %d c = %d ('%c')\n",
@@ -703,6 +726,17 @@ check_remote_input_interrupt_request (void)
   input_interrupt (0);
 }
 
+/* The descriptor GDB's input arrives on, or -1 if there is none or it
+   can not be waited on.  */
+int
+remote_input_descriptor (void)
+{
+  if (remote_desc == INVALID_DESCRIPTOR || remote_input_closed)
+    return -1;
+
+  return remote_desc;
+}
+
 /* Asynchronous I/O support.  SIGIO must be enabled when waiting, in order to
    accept Control-C from the client, and must be disabled when talking to
    the client.  */
@@ -1145,6 +1179,34 @@ decode_xfer_write (char *buf, int packet_len, char **annex, CORE_ADDR *offset,
   return 0;
 }
 
+/* Decode a vFlashWrite request.  BUF points after the "vFlashWrite:"
+   and PACKET_LEN is the length of the data from BUF on.  */
+int
+decode_flash_write (char *buf, int packet_len, CORE_ADDR *addr,
+		    unsigned int *len, unsigned char *data)
+{
+  char *start = buf;
+  char ch;
+
+  /* Extract the address.  */
+  *addr = 0;
+  while (1)
+    {
+      if (buf - start >= packet_len)
+	return -1;
+      if ((ch = *buf++) == ':')
+	break;
+      *addr = *addr << 4;
+      *addr |= fromhex (ch) & 0x0f;
+    }
+
+  /* Get encoded data.  */
+  packet_len -= buf - start;
+  *len = remote_unescape_input ((const gdb_byte *) buf, packet_len,
+				data, packet_len);
+  return 0;
+}
+
 /* Ask GDB for the address of NAME, and return it in ADDRP if found.
    Returns 1 if the symbol is found, 0 if it is not, -1 on error.  */
 
@@ -531,6 +531,46 @@ handle_query (char *own_buf, int packet_len, int *new_packet_len_p)
       return;
     }
 
+  if (the_target->memory_map != NULL
+      && strncmp ("qXfer:memory-map:read:", own_buf, 22) == 0)
+    {
+      CORE_ADDR ofs;
+      unsigned int len, total_len;
+      char *document;
+      char *annex;
+
+      /* Reject any annex; grab the offset and length.  */
+      if (decode_xfer_read (own_buf + 22, &annex, &ofs, &len) < 0
+	  || annex[0] != '\0')
+	{
+	  strcpy (own_buf, "E00");
+	  return;
+	}
+
+      document = (*the_target->memory_map) ();
+      if (document == NULL)
+	{
+	  strcpy (own_buf, "E00");
+	  return;
+	}
+
+      total_len = strlen (document);
+      if (len > PBUFSIZ - 2)
+	len = PBUFSIZ - 2;
+
+      if (ofs > total_len)
+	write_enn (own_buf);
+      else if (len < total_len - ofs)
+	*new_packet_len_p = write_qxfer_response (own_buf, document + ofs,
+						  len, 1);
+      else
+	*new_packet_len_p = write_qxfer_response (own_buf, document + ofs,
+						  total_len - ofs, 0);
+
+      free (document);
+      return;
+    }
+
   /* Protocol features query.  */
   if (strncmp ("qSupported", own_buf, 10) == 0
       && (own_buf[10] == ':' || own_buf[10] == '\0'))
@@ -544,8 +584,9 @@ handle_query (char *own_buf, int packet_len, int *new_packet_len_p)
 	 supports qXfer:libraries:read, so always report it.  */
 	strcat (own_buf, ";qXfer:libraries:read+");
 #endif
-      strcat (own_buf, ";qXfer:memory map:read+");
-      
+      if (the_target->memory_map != NULL)
+	strcat (own_buf, ";qXfer:memory-map:read+");
+
       if (the_target->read_auxv != NULL)
 	strcat (own_buf, ";qXfer:auxv:read+");
      
@@ -790,9 +831,66 @@ err:
   return;
 }
 
+/* Handle the vFlash packets.  GDB sends them when it loads into memory
+   the memory map says is flash.  */
+static void
+handle_v_flash (char *own_buf, int packet_len)
+{
+  CORE_ADDR addr;
+  unsigned int len;
+
+  if (strncmp (own_buf, "vFlashErase:", 12) == 0)
+    {
+      char *p = strchr (own_buf + 12, ',');
+      CORE_ADDR length;
+
+      /* The length is often more than the 4 digits decode_m_packet
+	 takes.  */
+      if (p == NULL)
+	{
+	  write_enn (own_buf);
+	  return;
+	}
+      decode_address (&addr, own_buf + 12, p - (own_buf + 12));
+      decode_address (&length, p + 1, strlen (p + 1));
+      if ((*the_target->flash_erase) (addr, length) == 0)
+	write_ok (own_buf);
+      else
+	write_enn (own_buf);
+      return;
+    }
+
+  if (strncmp (own_buf, "vFlashWrite:", 12) == 0)
+    {
+      unsigned char *data = malloc (packet_len);
+
+      if (data == NULL
+	  || decode_flash_write (own_buf + 12, packet_len - 12,
+				 &addr, &len, data) < 0)
+	write_enn (own_buf);
+      else if ((*the_target->flash_write) (addr, data, len) == 0)
+	write_ok (own_buf);
+      else
+	strcpy (own_buf, "E.memtype");
+      free (data);
+      return;
+    }
+
+  if (strcmp (own_buf, "vFlashDone") == 0)
+    {
+      if ((*the_target->flash_done) () == 0)
+	write_ok (own_buf);
+      else
+	write_enn (own_buf);
+      return;
+    }
+
+  own_buf[0] = 0;
+}
+
 /* Handle all of the extended 'v' packets.  */
 void
-handle_v_requests (char *own_buf, char *status, int *signal)
+handle_v_requests (char *own_buf, int packet_len, char *status, int *signal)
 {
   if (strncmp (own_buf, "vCont;", 6) == 0)
     {
@@ -806,6 +904,13 @@ handle_v_requests (char *own_buf, char *status, int *signal)
       return;
     }
 
+  if (the_target->flash_erase != NULL
+      && strncmp (own_buf, "vFlash", 6) == 0)
+    {
+      handle_v_flash (own_buf, packet_len);
+      return;
+    }
+
   /* Otherwise we didn't know what packet it was.  Say we didn't
      understand it.  */
   own_buf[0] = 0;
@@ -1232,7 +1337,7 @@ main (int argc, char *argv[])
 		}
 	    case 'v':
 	      /* Extended (long) request.  */
-	      handle_v_requests (own_buf, &status, &signal);
+	      handle_v_requests (own_buf, packet_len, &status, &signal);
 	      break;
 	    default:
 	      /* It is a request we don't understand.  Respond with an
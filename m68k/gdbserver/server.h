@@ -181,6 +181,7 @@ void disable_async_io (void);
 void unblock_async_io (void);
 void block_async_io (void);
 void check_remote_input_interrupt_request (void);
+int remote_input_descriptor (void);
 void convert_ascii_to_int (char *from, unsigned char *to, int n);
 void convert_int_to_ascii (unsigned char *from, char *to, int n);
 void new_thread_notify (int id);
@@ -198,6 +199,8 @@ int decode_X_packet (char *from, int packet_len, CORE_ADDR * mem_addr_ptr,
 int decode_xfer_write (char *buf, int packet_len, char **annex,
 		       CORE_ADDR *offset, unsigned int *len,
 		       unsigned char *data);
+int decode_flash_write (char *buf, int packet_len, CORE_ADDR *addr,
+			unsigned int *len, unsigned char *data);
 
 int unhexify (char *bin, const char *hex, int count);
 int hexify (char *hex, const char *bin, int count);
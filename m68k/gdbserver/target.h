@@ -195,6 +195,19 @@ struct target_ops
   /* If set the target can accept monitor commands. Return false
      to return an error code. */
   int (*commands) (const char *cmd, int len);
+
+  /* Return the memory map as a malloc'ed XML document, or NULL if
+     there is no map.  */
+  char *(*memory_map) (void);
+
+  /* Flash programming for the vFlash packets.  Erase LEN bytes at
+     ADDR, then write LEN bytes from MYADDR to ADDR.  The target may
+     hold on to both until flash_done is called.  All return 0 on
+     success and -1 on failure.  */
+  int (*flash_erase) (CORE_ADDR addr, unsigned int len);
+  int (*flash_write) (CORE_ADDR addr, const unsigned char *myaddr,
+		      unsigned int len);
+  int (*flash_done) (void);
 };
 
 extern struct target_ops *the_target;
@@ -105,6 +105,67 @@ int bdmGetInterface (int *iface);
 int bdmColdfireGetPST (int *pst);
 int bdmColdfireSetPST (int pst);
 
+/*
+ * Measure the serial clock rate of a bit-banged interface in bits per
+ * second. The frame count is doubled until a run takes long enough to
+ * time. Interfaces that do not clock frames on the host fail with EINVAL.
+ */
+int bdmClockBench (unsigned long *bitsPerSec);
+
+/*
+ * Wait for the target after resuming it. The poll function is called
+ * until it returns non-zero, which is returned. Polling is tight for
+ * the first `tight' polls at minUsecs apart, then backs off doubling the
+ * interval up to maxUsecs. Input on wakeFd (-1 for none) ends a sleep
+ * at once and restarts the tight polls.
+ */
+int bdmSetPollPolicy (unsigned long minUsecs, unsigned long maxUsecs,
+                      unsigned int tight);
+int bdmGetPollPolicy (unsigned long *minUsecs, unsigned long *maxUsecs,
+                      unsigned int *tight);
+int bdmPollWait (int (*poll) (void *arg), void *arg, int wakeFd);
+
+/*
+ * Statistics of the requests made of the interface since the BDM was
+ * opened or the statistics reset. Slots are the ioctls by number then
+ * BDM_STATS_OTHER for any ioctl past them, block reads and writes and
+ * status watches. Bucket n of the latency histogram counts requests
+ * that took less than 2^n usecs, the last bucket any that took longer.
+ * A percentile is the upper bound of the bucket it falls in, limited
+ * to the slowest request.
+ *
+ * The elapsed time is since the statistics started and the busy time
+ * is the part of it spent in the interface, the rest is the caller's.
+ *
+ * If M68K_BDM_STATS is set the statistics are printed when the BDM is
+ * closed, to stderr if set to "-" or empty, else appended to the file
+ * named.
+ */
+#define BDM_STATS_IOCTLS  ((BDM_CLOCK_BENCH & 0xff) + 1)
+#define BDM_STATS_OTHER   (BDM_STATS_IOCTLS)
+#define BDM_STATS_READ    (BDM_STATS_IOCTLS + 1)
+#define BDM_STATS_WRITE   (BDM_STATS_IOCTLS + 2)
+#define BDM_STATS_WATCH   (BDM_STATS_IOCTLS + 3)
+#define BDM_STATS_SLOTS   (BDM_STATS_IOCTLS + 4)
+#define BDM_STATS_BUCKETS (24)
+
+typedef struct bdmStats_s
+{
+  const char         *name;
+  unsigned long      calls;
+  unsigned long      errors;
+  unsigned long long bytes;
+  unsigned long long usecs;
+  unsigned long      maxUsecs;
+  unsigned long      buckets[BDM_STATS_BUCKETS];
+} bdmStats;
+
+int bdmGetStats (int slot, bdmStats *stats);
+int bdmGetStatsTimes (unsigned long long *elapsedUsecs,
+                      unsigned long long *busyUsecs);
+int bdmResetStats (void);
+unsigned long bdmStatsPercentile (const bdmStats *stats, unsigned int percent);
+
 /*
  * The following routines control execution of the target machine
  */
@@ -129,9 +190,78 @@ int bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nb
 int bdmIoctlInt (int code, int *var);
 int bdmIoctlCommand (int code);
 int bdmIoctlIo (int code, struct BDMioctl *ioc);
+int bdmExecBatch (struct BDMbatchOp *ops, int count);
 int bdmRead (unsigned char *cbuf, unsigned long nbytes);
 int bdmWrite (unsigned char *cbuf, unsigned long nbytes);
 
+/*
+ * A context holds one open BDM. The calls above work on a default
+ * context and so are limited to one BDM per process. The bdmCtx calls
+ * take the context to use, letting a process drive several BDMs, each
+ * from its own thread if wanted. Opening and closing contexts must not
+ * run concurrently, and the remote (network) backend keeps per-process
+ * state so it is limited to one connection.
+ */
+typedef struct bdmContext_s bdmContext;
+
+bdmContext *bdmCtxCreate (void);
+void        bdmCtxDestroy (bdmContext *ctx);
+
+int bdmCtxCheck (bdmContext *ctx);
+int bdmCtxIoctlInt (bdmContext *ctx, int code, int *var);
+int bdmCtxIoctlCommand (bdmContext *ctx, int code);
+int bdmCtxIoctlIo (bdmContext *ctx, int code, struct BDMioctl *ioc);
+int bdmCtxExecBatch (bdmContext *ctx, struct BDMbatchOp *ops, int count);
+int bdmCtxRead (bdmContext *ctx, unsigned char *cbuf, unsigned long nbytes);
+int bdmCtxWrite (bdmContext *ctx, unsigned char *cbuf, unsigned long nbytes);
+const char *bdmCtxErrorString (bdmContext *ctx);
+int bdmCtxOpen (bdmContext *ctx, const char *name);
+int bdmCtxClose (bdmContext *ctx);
+int bdmCtxIsOpen (bdmContext *ctx);
+int bdmCtxStatus (bdmContext *ctx);
+int bdmCtxSetDelay (bdmContext *ctx, int delay);
+int bdmCtxSetDriverDebugFlag (bdmContext *ctx, int flag);
+int bdmCtxColdfireGetPST (bdmContext *ctx, int *pst);
+int bdmCtxColdfireSetPST (bdmContext *ctx, int pst);
+int bdmCtxClockBench (bdmContext *ctx, unsigned long *bitsPerSec);
+int bdmCtxSetPollPolicy (bdmContext *ctx, unsigned long minUsecs,
+                         unsigned long maxUsecs, unsigned int tight);
+int bdmCtxGetPollPolicy (bdmContext *ctx, unsigned long *minUsecs,
+                         unsigned long *maxUsecs, unsigned int *tight);
+int bdmCtxPollWait (bdmContext *ctx, int (*poll) (void *arg), void *arg,
+                    int wakeFd);
+int bdmCtxGetStats (bdmContext *ctx, int slot, bdmStats *stats);
+int bdmCtxGetStatsTimes (bdmContext *ctx, unsigned long long *elapsedUsecs,
+                         unsigned long long *busyUsecs);
+int bdmCtxResetStats (bdmContext *ctx);
+int bdmCtxReadControlRegister (bdmContext *ctx, int code, unsigned long *lp);
+int bdmCtxReadDebugRegister (bdmContext *ctx, int code, unsigned long *lp);
+int bdmCtxReadSystemRegister (bdmContext *ctx, int code, unsigned long *lp);
+int bdmCtxReadRegister (bdmContext *ctx, int code, unsigned long *lp);
+int bdmCtxWriteControlRegister (bdmContext *ctx, int code, unsigned long l);
+int bdmCtxWriteDebugRegister (bdmContext *ctx, int code, unsigned long l);
+int bdmCtxWriteSystemRegister (bdmContext *ctx, int code, unsigned long l);
+int bdmCtxWriteRegister (bdmContext *ctx, int code, unsigned long l);
+int bdmCtxReadLongWord (bdmContext *ctx, unsigned long address, unsigned long *lp);
+int bdmCtxReadWord (bdmContext *ctx, unsigned long address, unsigned short *sp);
+int bdmCtxReadByte (bdmContext *ctx, unsigned long address, unsigned char *cp);
+int bdmCtxWriteLongWord (bdmContext *ctx, unsigned long address, unsigned long l);
+int bdmCtxWriteWord (bdmContext *ctx, unsigned long address, unsigned short s);
+int bdmCtxWriteByte (bdmContext *ctx, unsigned long address, unsigned char c);
+int bdmCtxReadMBAR (bdmContext *ctx, unsigned long *lp);
+int bdmCtxWriteMBAR (bdmContext *ctx, unsigned long l);
+int bdmCtxRelease (bdmContext *ctx);
+int bdmCtxReset (bdmContext *ctx);
+int bdmCtxRestart (bdmContext *ctx);
+int bdmCtxGo (bdmContext *ctx);
+int bdmCtxStop (bdmContext *ctx);
+int bdmCtxStep (bdmContext *ctx);
+int bdmCtxReadMemory (bdmContext *ctx, unsigned long address, unsigned char *cbuf, unsigned long nbytes);
+int bdmCtxWriteMemory (bdmContext *ctx, unsigned long address, unsigned char *cbuf, unsigned long nbytes);
+int bdmCtxGetDrvVersion (bdmContext *ctx, unsigned int *ver);
+int bdmCtxGetProcessor (bdmContext *ctx, int *processor);
+int bdmCtxGetInterface (bdmContext *ctx, int *iface);
+
 /*
  * BDM Configuration file support.
  */
@@ -43,8 +43,29 @@ extern "C"
      * Can be NULL.
      */
     const char* (*error_str)(int error_no);
+
+    /*
+     * Run a vector of BDMioctl requests. Returns -1 with errno set
+     * when an operation fails. Can be NULL, the library then loops
+     * over ioctl_io.
+     */
+    int (*exec_batch)(int fd, struct BDMbatchOp *ops, int count);
+
+    /*
+     * Block until the status has a bit of mask set or there is input
+     * on wakeFd (-1 for none) and return the status. Returns -1 with
+     * errno set to ENOSYS or EINVAL when the link cannot watch. Can be
+     * NULL, the library then polls.
+     */
+    int (*status_wait)(int fd, int mask, int wakeFd);
   } bdm_iface;
 
+/*
+ * Returns 1 if a wakeFd select reports readable is at end of file or
+ * has an error. It stays readable and should not be waited on again.
+ */
+  int bdmWakeFdClosed (int wakeFd);
+
 #if __cplusplus
 }
 #endif
@@ -50,7 +50,7 @@
  * If no remote/local directive is supplied, default to the
  * existing local only mode.
  */
-#if !defined (BDM_DEVICE_REMOTE) && !defined (BDM_DEVICE_USB) && !defined (BDM_DEVICE_LOCAL)
+#if !defined (BDM_DEVICE_REMOTE) && !defined (BDM_DEVICE_USB) && !defined (BDM_DEVICE_LOCAL) && !defined (BDM_DEVICE_SIM)
 #error "No interface defined. A configuration error. Please report."
 #endif
 
@@ -61,7 +61,15 @@
 #include <string.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/time.h>
 #include "config.h"
+#if defined (__WIN32__)
+#include <winsock2.h>
+#else
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#endif
 #include "bdm-iface.h"
 
 /*
@@ -110,12 +118,57 @@
 #endif
 
 /*
- * Limit of one BDM per process
+ * The simulated target.
+ */
+#if defined (BDM_DEVICE_SIM)
+#include "simIface.h"
+#endif
+
+/*
+ * The state of an open BDM. A process can have a BDM open in each
+ * context. Different contexts can be used from different threads as
+ * long as their backends allow it, opening and closing cannot as the
+ * configuration data is shared.
  */
-static int       bdm_fd = -1;
-static int       cpu    = BDM_CPU32;
-static int       pod    = BDM_CPU32_PD;
-static bdm_iface *iface = NULL;
+struct bdmContext_s
+{
+  int           fd;
+  int           cpu;
+  int           pod;
+  bdm_iface     *iface;
+  const char    *lastErrorString;
+  unsigned long pollMin;
+  unsigned long pollMax;
+  unsigned int  pollTight;
+  int           pollWatch;
+  struct timeval     statsStart;
+  unsigned long long statsBusy;
+  bdmStats           stats[BDM_STATS_SLOTS];
+};
+
+/*
+ * The status polling policy defaults. Short steps and breakpoints near
+ * the resume point are caught by the tight polls, a long running target
+ * costs a status request every BDM_POLL_MAX_USECS at most.
+ */
+#define BDM_POLL_MIN_USECS (1000)
+#define BDM_POLL_MAX_USECS (50000)
+#define BDM_POLL_TIGHT     (10)
+
+/*
+ * The context used by the original single BDM interface.
+ */
+static bdmContext bdm_default_context = {
+  .fd              = -1,
+  .cpu             = BDM_CPU32,
+  .pod             = BDM_CPU32_PD,
+  .iface           = NULL,
+  .lastErrorString = NULL,
+  .pollMin         = BDM_POLL_MIN_USECS,
+  .pollMax         = BDM_POLL_MAX_USECS,
+  .pollTight       = BDM_POLL_TIGHT,
+  .pollWatch       = 1
+};
 
 /*
  * The configuration data read from the configuration file.
@@ -127,7 +180,6 @@ static size_t config_buffer_size = 0;
  * Have to make global to allow access.
  */
 const char *bdmNoError = "No BDM error";
-const char *bdmIO_lastErrorString;
 
 /*
  * Debugging
@@ -240,18 +292,47 @@ bdmGetDebugFlag (void)
   return debugFlag;
 }
 
+/*
+ * Create a context with no BDM open.
+ */
+bdmContext *
+bdmCtxCreate (void)
+{
+  bdmContext *ctx = malloc (sizeof (bdmContext));
+  if (!ctx)
+    return NULL;
+  *ctx = bdm_default_context;
+  ctx->fd = -1;
+  ctx->iface = NULL;
+  ctx->lastErrorString = bdmNoError;
+  return ctx;
+}
+
+/*
+ * Close the context's BDM if open and free the context.
+ */
+void
+bdmCtxDestroy (bdmContext *ctx)
+{
+  if (!ctx)
+    return;
+  if (bdmCtxIsOpen (ctx))
+    bdmCtxClose (ctx);
+  free (ctx);
+}
+
 /*
  * Verify that device is open
  */
 int
-bdmCheck (void)
+bdmCtxCheck (bdmContext *ctx)
 {
-  if (bdm_fd < 0) {
-    bdmIO_lastErrorString = "BDM not open";
+  if (ctx->fd < 0) {
+    ctx->lastErrorString = "BDM not open";
     return 0;
   }
-  if (!iface) {
-    bdmIO_lastErrorString = "BDM no iface";
+  if (!ctx->iface) {
+    ctx->lastErrorString = "BDM no iface";
     return 0;
   }
   return 1;
@@ -261,7 +342,7 @@ bdmCheck (void)
  * Like strerror(), but knows about BDM driver errors, too.
  */
 static const char *
-bdmStrerror (int error_no)
+bdmStrerror (bdmContext *ctx, int error_no)
 {
   if (error_no == 0)
     return bdmNoError;
@@ -275,21 +356,223 @@ bdmStrerror (int error_no)
     case BDM_FAULT_NVC:       return "Invalid target command";
     case BDM_FAULT_FORCED_TA: return "Invalid target command - Forced TA";
   }
-  if (iface && iface->error_str)
-    return iface->error_str(error_no);
+  if (ctx->iface && ctx->iface->error_str)
+    return ctx->iface->error_str(error_no);
   return strerror (error_no);
 }
 
+/*
+ * The names of the statistics slots. The ioctls are by number.
+ */
+static const char *const statsName[BDM_STATS_SLOTS] = {
+  "init",        "reset",       "restart",      "stop",
+  "step",        "status",      "speed",        "debug",
+  "release",     "go",          NULL,           NULL,
+  NULL,          NULL,          NULL,           NULL,
+  "read-ctlreg", "write-ctlreg", "read-dbreg",  "write-dbreg",
+  "read-reg",    "read-sysreg", "read-long",    "read-word",
+  "read-byte",   "write-reg",   "write-sysreg", "write-long",
+  "write-word",  "write-byte",  "drv-version",  "cpu-type",
+  "if-type",     "get-pst",     "set-pst",      "batch",
+  "clock-bench", "other",       "read",         "write",
+  "watch"
+};
+
+/*
+ * The statistics slot of an ioctl.
+ */
+static int
+bdmStatsSlot (int code)
+{
+  int nr = code & 0xff;
+  return nr < BDM_STATS_IOCTLS ? nr : BDM_STATS_OTHER;
+}
+
+/*
+ * The target data a BDMioctl-argument request moves.
+ */
+static unsigned long
+bdmStatsIoBytes (int code)
+{
+  switch (code) {
+    case BDM_READ_BYTE:
+    case BDM_WRITE_BYTE:
+      return 1;
+    case BDM_READ_WORD:
+    case BDM_WRITE_WORD:
+      return 2;
+  }
+  return 4;
+}
+
+/*
+ * Account a request that started at start. This is on every request
+ * so it is kept to a clock read and a few adds. The errno of the
+ * request is kept.
+ */
+static void
+bdmStatsAdd (bdmContext *ctx, int slot, struct timeval *start,
+             unsigned long bytes, int failed)
+{
+  bdmStats       *stats = &ctx->stats[slot];
+  struct timeval end;
+  unsigned long  usecs;
+  int            bucket = 0;
+  int            error_no = errno;
+
+  gettimeofday (&end, NULL);
+  usecs = ((end.tv_sec - start->tv_sec) * 1000000) +
+    (end.tv_usec - start->tv_usec);
+  if (usecs > (1UL << 31))
+    usecs = 0;
+
+  stats->calls++;
+  if (failed)
+    stats->errors++;
+  else
+    stats->bytes += bytes;
+  stats->usecs += usecs;
+  if (usecs > stats->maxUsecs)
+    stats->maxUsecs = usecs;
+  while ((bucket < (BDM_STATS_BUCKETS - 1)) && (usecs >> bucket))
+    bucket++;
+  stats->buckets[bucket]++;
+  ctx->statsBusy += usecs;
+
+  errno = error_no;
+}
+
+/*
+ * Get the statistics of a slot.
+ */
+int
+bdmCtxGetStats (bdmContext *ctx, int slot, bdmStats *stats)
+{
+  if ((slot < 0) || (slot >= BDM_STATS_SLOTS)) {
+    errno = EINVAL;
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
+    return -1;
+  }
+  *stats = ctx->stats[slot];
+  stats->name = statsName[slot] ? statsName[slot] : "unused";
+  return 0;
+}
+
+/*
+ * Get the time since the statistics started and the time spent in the
+ * interface.
+ */
+int
+bdmCtxGetStatsTimes (bdmContext *ctx, unsigned long long *elapsedUsecs,
+                     unsigned long long *busyUsecs)
+{
+  struct timeval now;
+  gettimeofday (&now, NULL);
+  *elapsedUsecs = ((now.tv_sec - ctx->statsStart.tv_sec) * 1000000ULL) +
+    (now.tv_usec - ctx->statsStart.tv_usec);
+  *busyUsecs = ctx->statsBusy;
+  return 0;
+}
+
+/*
+ * Clear the statistics.
+ */
+int
+bdmCtxResetStats (bdmContext *ctx)
+{
+  memset (ctx->stats, 0, sizeof (ctx->stats));
+  ctx->statsBusy = 0;
+  gettimeofday (&ctx->statsStart, NULL);
+  return 0;
+}
+
+/*
+ * The latency a percent of a slot's requests took no longer than.
+ */
+unsigned long
+bdmStatsPercentile (const bdmStats *stats, unsigned int percent)
+{
+  unsigned long long want;
+  unsigned long long seen = 0;
+  int                bucket;
+
+  if (!stats->calls)
+    return 0;
+  want = ((unsigned long long) stats->calls * percent + 99) / 100;
+  for (bucket = 0; bucket < (BDM_STATS_BUCKETS - 1); bucket++) {
+    seen += stats->buckets[bucket];
+    if (seen >= want)
+      break;
+  }
+  if ((bucket == (BDM_STATS_BUCKETS - 1)) ||
+      ((1UL << bucket) > stats->maxUsecs))
+    return stats->maxUsecs;
+  return 1UL << bucket;
+}
+
+/*
+ * Print the statistics if M68K_BDM_STATS asks for them.
+ */
+static void
+bdmStatsDump (bdmContext *ctx)
+{
+  const char         *env = getenv ("M68K_BDM_STATS");
+  FILE               *out = stderr;
+  unsigned long long elapsed;
+  unsigned long long busy;
+  int                slot;
+
+  if (!env)
+    return;
+  if (*env && (strcmp (env, "-") != 0)) {
+    if (!(out = fopen (env, "a"))) {
+      bdmInfo ("BDM: stats: %s: %s\n", env, strerror (errno));
+      return;
+    }
+  }
+
+  bdmCtxGetStatsTimes (ctx, &elapsed, &busy);
+  fprintf (out, "BDM stats: %.3f secs open, %.3f secs in the interface (%.0f%%)\n",
+           elapsed / 1000000.0, busy / 1000000.0,
+           elapsed ? (busy * 100.0) / elapsed : 0.0);
+  fprintf (out, "%-12s %9s %7s %11s %10s %8s %8s %8s %8s\n",
+           "request", "calls", "errors", "bytes", "total ms",
+           "mean us", "p50 us", "p99 us", "max us");
+  for (slot = 0; slot < BDM_STATS_SLOTS; slot++) {
+    bdmStats stats;
+    bdmCtxGetStats (ctx, slot, &stats);
+    if (!stats.calls)
+      continue;
+    fprintf (out, "%-12s %9lu %7lu %11llu %10.1f %8.1f %8lu %8lu %8lu\n",
+             stats.name, stats.calls, stats.errors, stats.bytes,
+             stats.usecs / 1000.0, (double) stats.usecs / stats.calls,
+             bdmStatsPercentile (&stats, 50),
+             bdmStatsPercentile (&stats, 99),
+             stats.maxUsecs);
+  }
+
+  if (out != stderr)
+    fclose (out);
+  else
+    fflush (out);
+}
+
 /*
  * Do an int-argument BDM ioctl
  */
 int
-bdmIoctlInt (int code, int *var)
+bdmCtxIoctlInt (bdmContext *ctx, int code, int *var)
 {
-  if (!bdmCheck ())
+  struct timeval start;
+  int            ret;
+
+  if (!bdmCtxCheck (ctx))
     return -1;
-  if (iface->ioctl_int (bdm_fd, code, var) < 0) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
+  gettimeofday (&start, NULL);
+  ret = ctx->iface->ioctl_int (ctx->fd, code, var);
+  bdmStatsAdd (ctx, bdmStatsSlot (code), &start, 0, ret < 0);
+  if (ret < 0) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
     return -1;
   }
   return 0;
@@ -299,12 +582,18 @@ bdmIoctlInt (int code, int *var)
  * Do a command (no-argument) BDM ioctl
  */
 int
-bdmIoctlCommand (int code)
+bdmCtxIoctlCommand (bdmContext *ctx, int code)
 {
-  if (!bdmCheck ())
+  struct timeval start;
+  int            ret;
+
+  if (!bdmCtxCheck (ctx))
     return -1;
-  if (iface->ioctl_cmd (bdm_fd, code) < 0) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
+  gettimeofday (&start, NULL);
+  ret = ctx->iface->ioctl_cmd (ctx->fd, code);
+  bdmStatsAdd (ctx, bdmStatsSlot (code), &start, 0, ret < 0);
+  if (ret < 0) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
     return -1;
   }
   return 0;
@@ -314,14 +603,62 @@ bdmIoctlCommand (int code)
  * Do a BDMioctl-argument BDM ioctl
  */
 int
-bdmIoctlIo (int code, struct BDMioctl *ioc)
+bdmCtxIoctlIo (bdmContext *ctx, int code, struct BDMioctl *ioc)
 {
-  if (!bdmCheck ())
+  struct timeval start;
+  int            ret;
+
+  if (!bdmCtxCheck (ctx))
     return -1;
-  if (iface->ioctl_io (bdm_fd, code, ioc) < 0) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
+  gettimeofday (&start, NULL);
+  ret = ctx->iface->ioctl_io (ctx->fd, code, ioc);
+  bdmStatsAdd (ctx, bdmStatsSlot (code), &start,
+               bdmStatsIoBytes (code), ret < 0);
+  if (ret < 0) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Run a batch of BDMioctl-argument requests. The error field of each
+ * operation is 0 once it has run, the error code if it failed and -1
+ * if it was not run.
+ */
+int
+bdmCtxExecBatch (bdmContext *ctx, struct BDMbatchOp *ops, int count)
+{
+  struct timeval start;
+  unsigned long  bytes = 0;
+  int            op;
+
+  if (!bdmCtxCheck (ctx))
     return -1;
+  for (op = 0; op < count; op++) {
+    ops[op].error = -1;
+    bytes += bdmStatsIoBytes (ops[op].code);
   }
+  gettimeofday (&start, NULL);
+  if (ctx->iface->exec_batch) {
+    int ret = ctx->iface->exec_batch (ctx->fd, ops, count);
+    bdmStatsAdd (ctx, bdmStatsSlot (BDM_EXEC_BATCH), &start, bytes, ret < 0);
+    if (ret < 0) {
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
+      return -1;
+    }
+    return 0;
+  }
+  for (op = 0; op < count; op++) {
+    if (ctx->iface->ioctl_io (ctx->fd, ops[op].code, &ops[op].ioc) < 0) {
+      ops[op].error = errno;
+      bdmStatsAdd (ctx, bdmStatsSlot (BDM_EXEC_BATCH), &start, 0, 1);
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
+      return -1;
+    }
+    ops[op].error = 0;
+  }
+  bdmStatsAdd (ctx, bdmStatsSlot (BDM_EXEC_BATCH), &start, bytes, 0);
   return 0;
 }
 
@@ -329,12 +666,18 @@ bdmIoctlIo (int code, struct BDMioctl *ioc)
  * Do a BDM read
  */
 int
-bdmRead (unsigned char *cbuf, unsigned long nbytes)
+bdmCtxRead (bdmContext *ctx, unsigned char *cbuf, unsigned long nbytes)
 {
-  if (!bdmCheck ())
+  struct timeval start;
+  int            ret;
+
+  if (!bdmCtxCheck (ctx))
     return -1;
-  if (iface->read (bdm_fd, cbuf, nbytes) != nbytes) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
+  gettimeofday (&start, NULL);
+  ret = ctx->iface->read (ctx->fd, cbuf, nbytes);
+  bdmStatsAdd (ctx, BDM_STATS_READ, &start, nbytes, ret != nbytes);
+  if (ret != nbytes) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
     return -1;
   }
   return nbytes;
@@ -344,12 +687,18 @@ bdmRead (unsigned char *cbuf, unsigned long nbytes)
  * Do a BDM write
  */
 int
-bdmWrite (unsigned char *cbuf, unsigned long nbytes)
+bdmCtxWrite (bdmContext *ctx, unsigned char *cbuf, unsigned long nbytes)
 {
-  if (!bdmCheck ())
+  struct timeval start;
+  int            ret;
+
+  if (!bdmCtxCheck (ctx))
     return -1;
-  if (iface->write (bdm_fd, cbuf, nbytes) != nbytes) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
+  gettimeofday (&start, NULL);
+  ret = ctx->iface->write (ctx->fd, cbuf, nbytes);
+  bdmStatsAdd (ctx, BDM_STATS_WRITE, &start, nbytes, ret != nbytes);
+  if (ret != nbytes) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
     return -1;
   }
   return nbytes;
@@ -359,12 +708,12 @@ bdmWrite (unsigned char *cbuf, unsigned long nbytes)
  * Read from the target
  */
 static int
-readTarget (int command, unsigned long address, unsigned long *lp)
+readTarget (bdmContext *ctx, int command, unsigned long address, unsigned long *lp)
 {
   struct BDMioctl ioc;
   ioc.address = address;
   ioc.value = 0;
-  if (bdmIoctlIo (command, &ioc) < 0)
+  if (bdmCtxIoctlIo (ctx, command, &ioc) < 0)
     return -1;
   *lp = ioc.value;
   return 0;
@@ -374,12 +723,12 @@ readTarget (int command, unsigned long address, unsigned long *lp)
  * Write to the target
  */
 static int
-writeTarget (int command, unsigned long address, unsigned long l)
+writeTarget (bdmContext *ctx, int command, unsigned long address, unsigned long l)
 {
   struct BDMioctl ioc;
   ioc.address = address;
   ioc.value = l;
-  if (bdmIoctlIo (command, &ioc) < 0)
+  if (bdmCtxIoctlIo (ctx, command, &ioc) < 0)
     return -1;
   return 0;
 }
@@ -388,18 +737,18 @@ writeTarget (int command, unsigned long address, unsigned long l)
  * Return string describing most recent error
  */
 const char *
-bdmErrorString (void)
+bdmCtxErrorString (bdmContext *ctx)
 {
-  return bdmIO_lastErrorString;
+  return ctx->lastErrorString;
 }
 
 /*
  * Return true is no last error.
  */
-const int
-bdmNoLastError (void)
+static int
+bdmNoLastError (bdmContext *ctx)
 {
-  return bdmIO_lastErrorString == bdmNoError;
+  return ctx->lastErrorString == bdmNoError;
 }
 
 /*
@@ -594,53 +943,66 @@ bdmConfigGet (const char* label, const char* last)
 }
 
 static int
-remoteOpen (const char *name)
+simOpen (bdmContext *ctx, const char *name)
+{
+  int fd = -1;
+#if defined (BDM_DEVICE_SIM)
+  if (bdmSimName (name)) {
+    if ((fd = bdmSimOpen (name, &ctx->iface)) < 0)
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
+  }
+#endif
+  return fd;
+}
+
+static int
+remoteOpen (bdmContext *ctx, const char *name)
 {
   int fd = -1;
 #if defined (BDM_DEVICE_REMOTE)
-  if (bdmRemoteName (name)) {
-    if ((fd = bdmRemoteOpen (name, &iface)) < 0)
-      bdmIO_lastErrorString = bdmStrerror (errno);
+  if (bdmNoLastError (ctx) && bdmRemoteName (name)) {
+    if ((fd = bdmRemoteOpen (name, &ctx->iface)) < 0)
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
   }
 #endif
   return fd;
 }
 
 static int
-usbOpen (const char *name)
+usbOpen (bdmContext *ctx, const char *name)
 {
   int fd = -1;
 #if defined (BDM_DEVICE_USB)
   bdm_usb_set_options(&usbdm_config_options);
   bdm_usb_set_target(target_type);
 
-  if (bdmNoLastError () && ((fd = bdm_usb_open (name, &iface)) < 0))
+  if (bdmNoLastError (ctx) && ((fd = bdm_usb_open (name, &ctx->iface)) < 0))
     if (errno != ENOENT)
-      bdmIO_lastErrorString = bdmStrerror (errno);
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
 #endif
   return fd;
 }
 
 static int
-iopermOpen (const char *name)
+iopermOpen (bdmContext *ctx, const char *name)
 {
   int fd = -1;
 #if defined (BDM_DEVICE_IOPERM)
-  if (bdmNoLastError () && ((fd = bdm_ioperm_open (name, &iface)) < 0))
+  if (bdmNoLastError (ctx) && ((fd = bdm_ioperm_open (name, &ctx->iface)) < 0))
     if (errno != ENOENT)
-      bdmIO_lastErrorString = bdmStrerror (errno);
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
 #endif
   return fd;
 }
 
 static int
-localOpen(const char* name)
+localOpen(bdmContext *ctx, const char* name)
 {
   int fd = -1;
 #if defined (BDM_DEVICE_LOCAL)
-  if (bdmNoLastError () && ((fd = bdmLocalOpen (name, &iface)) < 0))
+  if (bdmNoLastError (ctx) && ((fd = bdmLocalOpen (name, &ctx->iface)) < 0))
     if (errno != ENOENT)
-      bdmIO_lastErrorString = bdmStrerror (errno);
+      ctx->lastErrorString = bdmStrerror (ctx, errno);
 #endif
   return fd;
 }
@@ -649,7 +1011,7 @@ localOpen(const char* name)
  * Open the specified BDM device
  */
 int
-bdmOpen (const char *user_name)
+bdmCtxOpen (bdmContext *ctx, const char *user_name)
 {
 #if defined (BDM_LIB_CHECKS_VERSION)
   unsigned int ver;
@@ -658,7 +1020,7 @@ bdmOpen (const char *user_name)
   const char* mapping = NULL;
   usbdm_options_type_e *config_options = &usbdm_config_options;
 
-  bdmIO_lastErrorString = bdmNoError;
+  ctx->lastErrorString = bdmNoError;
 
   /*
    * Load the configurations.
@@ -689,7 +1051,7 @@ bdmOpen (const char *user_name)
 
   if (!name)
   {
-    bdmIO_lastErrorString = bdmStrerror (ENOMEM);
+    ctx->lastErrorString = bdmStrerror (ctx, ENOMEM);
     return -1;
   }
   
@@ -941,24 +1303,29 @@ bdmOpen (const char *user_name)
    *
    * First we try to open a remote connection if remote is
    * supported. If this fails we attempt to open the driver.
+   * A "sim:" name is the simulated target and is never remote.
    */
 
-  if (iface && (bdm_fd >= 0)) {
-    iface->close (bdm_fd);
+  if (ctx->iface && (ctx->fd >= 0)) {
+    ctx->iface->close (ctx->fd);
   }
 
-  bdm_fd = -1;
-
-  if ((bdm_fd = remoteOpen (name)) < 0) {
-    if ((bdm_fd = usbOpen(name)) < 0) {
-      if ((bdm_fd = iopermOpen(name)) < 0) {
-        if ((bdm_fd = localOpen (name)) < 0) {
-          if (bdmNoLastError ())
-            bdmIO_lastErrorString = bdmStrerror (2);
-          else
-            bdmIO_lastErrorString = bdmStrerror (errno);
-          free (name);
-          return -1;
+  ctx->fd = -1;
+  ctx->pollWatch = 1;
+  bdmCtxResetStats (ctx);
+
+  if ((ctx->fd = simOpen (ctx, name)) < 0) {
+    if ((ctx->fd = remoteOpen (ctx, name)) < 0) {
+      if ((ctx->fd = usbOpen(ctx, name)) < 0) {
+        if ((ctx->fd = iopermOpen(ctx, name)) < 0) {
+          if ((ctx->fd = localOpen (ctx, name)) < 0) {
+            if (bdmNoLastError (ctx))
+              ctx->lastErrorString = bdmStrerror (ctx, 2);
+            else
+              ctx->lastErrorString = bdmStrerror (ctx, errno);
+            free (name);
+            return -1;
+          }
         }
       }
     }
@@ -974,14 +1341,14 @@ bdmOpen (const char *user_name)
   /*
    * Check the driver version.
    */
-  if (bdmGetDrvVersion (&ver) < 0) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
-    bdmClose ();
+  if (bdmCtxGetDrvVersion (ctx, &ver) < 0) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
+    bdmCtxClose (ctx);
     return -1;
   }
   if ((ver & 0xff00) != (BDM_DRV_VERSION & 0xff00)) {
-    bdmIO_lastErrorString = "invalid driver version";
-    bdmClose ();
+    ctx->lastErrorString = "invalid driver version";
+    bdmCtxClose (ctx);
     return -1;
   }
 #endif
@@ -989,25 +1356,25 @@ bdmOpen (const char *user_name)
   /*
    * Get the processor and interface type
    */
-  if (bdmGetProcessor (&cpu) < 0) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
-    bdmClose ();
+  if (bdmCtxGetProcessor (ctx, &ctx->cpu) < 0) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
+    bdmCtxClose (ctx);
     return -1;
   }
-  if (bdmGetInterface (&pod) < 0) {
-    bdmIO_lastErrorString = bdmStrerror (errno);
-    bdmClose ();
+  if (bdmCtxGetInterface (ctx, &ctx->pod) < 0) {
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
+    bdmCtxClose (ctx);
     return -1;
   }
 
-  return bdm_fd;
+  return ctx->fd;
 }
 
 /*
  * Close the specified BDM device
  */
 int
-bdmClose (void)
+bdmCtxClose (bdmContext *ctx)
 {
   if (config)
   {
@@ -1016,15 +1383,16 @@ bdmClose (void)
     config_buffer_size = 0;
   }
 
-  if (!bdmCheck ())
+  if (!bdmCtxCheck (ctx))
     return -1;
-  if (iface->close (bdm_fd) < 0) {
-    bdm_fd = -1;
-    bdmIO_lastErrorString = bdmStrerror (errno);
+  bdmStatsDump (ctx);
+  if (ctx->iface->close (ctx->fd) < 0) {
+    ctx->fd = -1;
+    ctx->lastErrorString = bdmStrerror (ctx, errno);
     return -1;
   }
 
-  bdm_fd = -1;
+  ctx->fd = -1;
   return 0;
 }
 
@@ -1032,31 +1400,190 @@ bdmClose (void)
  * Tell if interface is open
  */
 int
-bdmIsOpen (void)
+bdmCtxIsOpen (bdmContext *ctx)
 {
-  return iface && (bdm_fd >= 0);
+  return ctx->iface && (ctx->fd >= 0);
 }
 
 /*
  * Return the status of the BDM interface
  */
 int
-bdmStatus (void)
+bdmCtxStatus (bdmContext *ctx)
 {
   int status = 0;
-  if (bdmIoctlInt (BDM_GET_STATUS, &status) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_GET_STATUS, &status) < 0)
     return -1;
   PRINTF ("Status %#x\n", status);
   return status;
 }
 
+/*
+ * Set the status polling policy.
+ */
+int
+bdmCtxSetPollPolicy (bdmContext *ctx, unsigned long minUsecs,
+                     unsigned long maxUsecs, unsigned int tight)
+{
+  if ((minUsecs == 0) || (maxUsecs < minUsecs)) {
+    ctx->lastErrorString = bdmStrerror (ctx, EINVAL);
+    return -1;
+  }
+  ctx->pollMin = minUsecs;
+  ctx->pollMax = maxUsecs;
+  ctx->pollTight = tight;
+  PRINTF ("Poll policy min %lu, max %lu usecs, %u tight polls\n",
+          minUsecs, maxUsecs, tight);
+  return 0;
+}
+
+/*
+ * Get the status polling policy.
+ */
+int
+bdmCtxGetPollPolicy (bdmContext *ctx, unsigned long *minUsecs,
+                     unsigned long *maxUsecs, unsigned int *tight)
+{
+  *minUsecs = ctx->pollMin;
+  *maxUsecs = ctx->pollMax;
+  *tight = ctx->pollTight;
+  return 0;
+}
+
+/*
+ * Peek at a readable wakeFd. A socket is tested with recv, anything
+ * else, such as a pipe, by the count of bytes waiting.
+ */
+int
+bdmWakeFdClosed (int wakeFd)
+{
+  char c;
+  int  n;
+
+#if defined (__WIN32__)
+  n = recv (wakeFd, &c, 1, MSG_PEEK);
+  return n <= 0;
+#else
+  n = recv (wakeFd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n > 0)
+    return 0;
+  if (n == 0)
+    return 1;
+  if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+    return 0;
+  if (errno == ENOTSOCK) {
+    int avail = 0;
+    if (ioctl (wakeFd, FIONREAD, &avail) < 0)
+      return 1;
+    return avail == 0;
+  }
+  return 1;
+#endif
+}
+
+/*
+ * Sleep up to usecs. Returns 1 if there is input on wakeFd and -1 if
+ * wakeFd is at end of file or has an error.
+ */
+static int
+bdmPollSleep (unsigned long usecs, int wakeFd)
+{
+  struct timeval tv;
+  fd_set         readset;
+
+  tv.tv_sec = usecs / 1000000;
+  tv.tv_usec = usecs % 1000000;
+
+  FD_ZERO (&readset);
+  if (wakeFd < 0) {
+#if defined (__WIN32__)
+    Sleep (usecs / 1000);
+#else
+    select (0, NULL, NULL, NULL, &tv);
+#endif
+    return 0;
+  }
+
+  FD_SET (wakeFd, &readset);
+  if (select (wakeFd + 1, &readset, NULL, NULL, &tv) <= 0)
+    return 0;
+  return bdmWakeFdClosed (wakeFd) ? -1 : 1;
+}
+
+/*
+ * The status bits a watch ends on. Anything the poll function could
+ * be waiting for changes one of these.
+ */
+#define BDM_WATCH_MASK \
+  (BDM_TARGETRESET | BDM_TARGETHALT | BDM_TARGETSTOPPED | \
+   BDM_TARGETPOWER | BDM_TARGETNC)
+
+/*
+ * Wait until poll returns non-zero and return that value. Call it right
+ * after resuming the target. The first polls follow each other closely,
+ * then the interval doubles up to the maximum. Input on wakeFd (-1 for
+ * none) makes poll run at once and restarts the tight polling. Once
+ * wakeFd is at end of file it is no longer watched.
+ *
+ * If the interface can watch the status itself, as a remote server
+ * can, each poll that returns zero is followed by a watch instead of a
+ * sleep so nothing crosses the link while the target runs. An interface
+ * that turns the watch down is polled as usual from then on.
+ */
+int
+bdmCtxPollWait (bdmContext *ctx, int (*poll) (void *arg), void *arg,
+                int wakeFd)
+{
+  unsigned long interval = ctx->pollMin;
+  unsigned int  polls = 0;
+  int           watched = 0;
+  int           ret;
+
+  while ((ret = poll (arg)) == 0) {
+    if (!watched && ctx->pollWatch &&
+        ctx->iface && ctx->iface->status_wait) {
+      struct timeval start;
+      int            status;
+      watched = 1;
+      gettimeofday (&start, NULL);
+      status = ctx->iface->status_wait (ctx->fd, BDM_WATCH_MASK, wakeFd);
+      bdmStatsAdd (ctx, BDM_STATS_WATCH, &start, 0, status < 0);
+      if (status >= 0)
+        continue;
+      if ((errno == ENOSYS) || (errno == EINVAL))
+        ctx->pollWatch = 0;
+    }
+    watched = 0;
+    switch (bdmPollSleep (interval, wakeFd)) {
+      case 1:
+        interval = ctx->pollMin;
+        polls = 0;
+        continue;
+      case -1:
+        /*
+         * The other end has gone. Stop waking on it so the wait does
+         * not spin.
+         */
+        PRINTF ("Poll wait: wake fd %d closed\n", wakeFd);
+        wakeFd = -1;
+        break;
+    }
+    if (++polls >= ctx->pollTight) {
+      interval *= 2;
+      if (interval > ctx->pollMax)
+        interval = ctx->pollMax;
+    }
+  }
+  return ret;
+}
+
 /*
  * Set the delay time
  */
 int
-bdmSetDelay (int delay)
+bdmCtxSetDelay (bdmContext *ctx, int delay)
 {
-  if (bdmIoctlInt (BDM_SPEED, &delay) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_SPEED, &delay) < 0)
     return -1;
   PRINTF ("Set delay %d\n", delay);
   return 0;
@@ -1066,9 +1593,9 @@ bdmSetDelay (int delay)
  * Set the driver debug flag
  */
 int
-bdmSetDriverDebugFlag (int debugFlag)
+bdmCtxSetDriverDebugFlag (bdmContext *ctx, int debugFlag)
 {
-  if (bdmIoctlInt (BDM_DEBUG, &debugFlag) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_DEBUG, &debugFlag) < 0)
     return -1;
   PRINTF ("Set driver debug flag %d\n", debugFlag);
   return 0;
@@ -1078,9 +1605,9 @@ bdmSetDriverDebugFlag (int debugFlag)
  * Get the Coldfire PST enable state.
  */
 int
-bdmColdfireGetPST (int *pst)
+bdmCtxColdfireGetPST (bdmContext *ctx, int *pst)
 {
-  if (bdmIoctlInt (BDM_GET_CF_PST, pst) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_GET_CF_PST, pst) < 0)
     return -1;
   PRINTF ("Get Coldfire PST state: %d\n", *pst);
   return 0;
@@ -1090,22 +1617,58 @@ bdmColdfireGetPST (int *pst)
  * Set the Coldfire PST enable state.
  */
 int
-bdmColdfireSetPST (int pst)
+bdmCtxColdfireSetPST (bdmContext *ctx, int pst)
 {
-  if (bdmIoctlInt (BDM_SET_CF_PST, &pst) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_SET_CF_PST, &pst) < 0)
     return -1;
   PRINTF ("Set Coldfire PST state: %d\n", pst);
   return 0;
 }
 
+/*
+ * Time NOP frames clocked by the driver. Start small and double the
+ * count until a run takes at least BDM_CLOCK_BENCH_USECS.
+ */
+#define BDM_CLOCK_BENCH_USECS      (500000)
+
+int
+bdmCtxClockBench (bdmContext *ctx, unsigned long *bitsPerSec)
+{
+  struct timeval start, end;
+  double         usecs = 0;
+  int            frames = 64;
+
+  while (1) {
+    int count = frames;
+    gettimeofday (&start, NULL);
+    if (bdmCtxIoctlInt (ctx, BDM_CLOCK_BENCH, &count) < 0)
+      return -1;
+    gettimeofday (&end, NULL);
+    usecs = ((end.tv_sec - start.tv_sec) * 1000000.0) +
+      (end.tv_usec - start.tv_usec);
+    if ((usecs >= BDM_CLOCK_BENCH_USECS) ||
+        (frames >= BDM_CLOCK_BENCH_MAX_FRAMES))
+      break;
+    frames <<= 1;
+  }
+
+  if (usecs < 1)
+    usecs = 1;
+
+  *bitsPerSec = (unsigned long) ((frames * 17.0 * 1000000.0) / usecs);
+  PRINTF ("Clock bench: %d frames in %.0f usecs, %lu bits/sec\n",
+          frames, usecs, *bitsPerSec);
+  return 0;
+}
+
 /*
  * Read a control register
  */
 int
-bdmReadControlRegister (int code, unsigned long *lp)
+bdmCtxReadControlRegister (bdmContext *ctx, int code, unsigned long *lp)
 {
   unsigned long ltmp = 0;
-  if (readTarget (BDM_READ_CTLREG, code, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_CTLREG, code, &ltmp) < 0)
     return -1;
   PRINTF ("Read control register 0x%04x: %#8lx\n", code, ltmp);
   *lp = ltmp;
@@ -1116,10 +1679,10 @@ bdmReadControlRegister (int code, unsigned long *lp)
  * Read a debug register
  */
 int
-bdmReadDebugRegister (int code, unsigned long *lp)
+bdmCtxReadDebugRegister (bdmContext *ctx, int code, unsigned long *lp)
 {
   unsigned long ltmp = 0;
-  if (readTarget (BDM_READ_DBREG, code, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_DBREG, code, &ltmp) < 0)
     return -1;
   PRINTF ("Read debug register 0x%04x: %#8lx\n", code, ltmp);
   *lp = ltmp;
@@ -1130,10 +1693,10 @@ bdmReadDebugRegister (int code, unsigned long *lp)
  * Read a system register
  */
 int
-bdmReadSystemRegister (int code, unsigned long *lp)
+bdmCtxReadSystemRegister (bdmContext *ctx, int code, unsigned long *lp)
 {
   unsigned long ltmp = 0;
-  if (readTarget (BDM_READ_SYSREG, code, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_SYSREG, code, &ltmp) < 0)
     return -1;
   PRINTF ("Read system register %s: %#8lx\n", sysregName[code], ltmp);
   *lp = ltmp;
@@ -1144,11 +1707,11 @@ bdmReadSystemRegister (int code, unsigned long *lp)
  * Read a register
  */
 int
-bdmReadRegister (int code, unsigned long *lp)
+bdmCtxReadRegister (bdmContext *ctx, int code, unsigned long *lp)
 {
   unsigned long ltmp = 0;
   code &= 0xF;
-  if (readTarget (BDM_READ_REG, code, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_REG, code, &ltmp) < 0)
     return -1;
   PRINTF ("Read register %s: %#8lx\n", regName[code], ltmp);
   *lp = ltmp;
@@ -1159,9 +1722,9 @@ bdmReadRegister (int code, unsigned long *lp)
  * Write a control register
  */
 int
-bdmWriteControlRegister (int code, unsigned long l)
+bdmCtxWriteControlRegister (bdmContext *ctx, int code, unsigned long l)
 {
-  if (writeTarget (BDM_WRITE_CTLREG, code, l) < 0)
+  if (writeTarget (ctx, BDM_WRITE_CTLREG, code, l) < 0)
     return -1;
   PRINTF ("Write control register 0x%04x: %#8lx\n", code, l);
   return 0;
@@ -1171,9 +1734,9 @@ bdmWriteControlRegister (int code, unsigned long l)
  * Write a debug register
  */
 int
-bdmWriteDebugRegister (int code, unsigned long l)
+bdmCtxWriteDebugRegister (bdmContext *ctx, int code, unsigned long l)
 {
-  if (writeTarget (BDM_WRITE_DBREG, code, l) < 0)
+  if (writeTarget (ctx, BDM_WRITE_DBREG, code, l) < 0)
     return -1;
   PRINTF ("Write debug register 0x%04x: %#8lx\n", code, l);
   return 0;
@@ -1183,9 +1746,9 @@ bdmWriteDebugRegister (int code, unsigned long l)
  * Write a system register
  */
 int
-bdmWriteSystemRegister (int code, unsigned long l)
+bdmCtxWriteSystemRegister (bdmContext *ctx, int code, unsigned long l)
 {
-  if (writeTarget (BDM_WRITE_SYSREG, code, l) < 0)
+  if (writeTarget (ctx, BDM_WRITE_SYSREG, code, l) < 0)
     return -1;
   PRINTF ("Write system register %s: %#8lx\n",
           sysregName[code], l);
@@ -1196,9 +1759,9 @@ bdmWriteSystemRegister (int code, unsigned long l)
  * Write a register
  */
 int
-bdmWriteRegister (int code, unsigned long l)
+bdmCtxWriteRegister (bdmContext *ctx, int code, unsigned long l)
 {
-  if (writeTarget (BDM_WRITE_REG, code, l) < 0)
+  if (writeTarget (ctx, BDM_WRITE_REG, code, l) < 0)
     return -1;
   PRINTF ("Write register %s: %#8lx\n", regName[code], l);
   return 0;
@@ -1208,11 +1771,11 @@ bdmWriteRegister (int code, unsigned long l)
  * Read a long word
  */
 int
-bdmReadLongWord (unsigned long address, unsigned long *lp)
+bdmCtxReadLongWord (bdmContext *ctx, unsigned long address, unsigned long *lp)
 {
   unsigned long ltmp;
 
-  if (readTarget (BDM_READ_LONGWORD, address, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_LONGWORD, address, &ltmp) < 0)
     return -1;
   PRINTF ("Read %#8.8lx @ %#8lx\n", ltmp, address);
   *lp = ltmp;
@@ -1223,11 +1786,11 @@ bdmReadLongWord (unsigned long address, unsigned long *lp)
  * Read a word
  */
 int
-bdmReadWord (unsigned long address, unsigned short *sp)
+bdmCtxReadWord (bdmContext *ctx, unsigned long address, unsigned short *sp)
 {
   unsigned long ltmp;
 
-  if (readTarget (BDM_READ_WORD, address, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_WORD, address, &ltmp) < 0)
     return -1;
   *sp = ltmp;
   PRINTF ("Read %#4.4x @ %#8lx\n", (unsigned short) ltmp, address);
@@ -1238,11 +1801,11 @@ bdmReadWord (unsigned long address, unsigned short *sp)
  * Read a byte
  */
 int
-bdmReadByte (unsigned long address, unsigned char *cp)
+bdmCtxReadByte (bdmContext *ctx, unsigned long address, unsigned char *cp)
 {
   unsigned long ltmp;
 
-  if (readTarget (BDM_READ_BYTE, address, &ltmp) < 0)
+  if (readTarget (ctx, BDM_READ_BYTE, address, &ltmp) < 0)
     return -1;
   *cp = ltmp;
   PRINTF ("Read %#2.2x @ %#8lx\n", (unsigned char)ltmp, address);
@@ -1253,108 +1816,108 @@ bdmReadByte (unsigned long address, unsigned char *cp)
  * Write a long word
  */
 int
-bdmWriteLongWord (unsigned long address, unsigned long l)
+bdmCtxWriteLongWord (bdmContext *ctx, unsigned long address, unsigned long l)
 {
   PRINTF ("Write %#8.8lx @ %#8lx\n", l, address);
-  return writeTarget (BDM_WRITE_LONGWORD, address, l);
+  return writeTarget (ctx, BDM_WRITE_LONGWORD, address, l);
 }
 
 /*
  * Write a word
  */
 int
-bdmWriteWord (unsigned long address, unsigned short s)
+bdmCtxWriteWord (bdmContext *ctx, unsigned long address, unsigned short s)
 {
   PRINTF ("Write %#4.4x @ %#8lx\n", s, address);
-  return writeTarget (BDM_WRITE_WORD, address, s);
+  return writeTarget (ctx, BDM_WRITE_WORD, address, s);
 }
 
 /*
  * Write a byte
  */
 int
-bdmWriteByte (unsigned long address, unsigned char c)
+bdmCtxWriteByte (bdmContext *ctx, unsigned long address, unsigned char c)
 {
   PRINTF ("Write %#2.2x @ %#8lx\n", c, address);
-  return writeTarget (BDM_WRITE_BYTE, address, c);
+  return writeTarget (ctx, BDM_WRITE_BYTE, address, c);
 }
 
 /*
  * Read the Module Base Address Register
  */
 int
-bdmReadMBAR (unsigned long *lp)
+bdmCtxReadMBAR (bdmContext *ctx, unsigned long *lp)
 {
-  return bdmReadSystemRegister (BDM_REG_MBAR, lp);
+  return bdmCtxReadSystemRegister (ctx, BDM_REG_MBAR, lp);
 }
 
 /*
  * Write the Module Base Address Register
  */
 int
-bdmWriteMBAR (unsigned long l)
+bdmCtxWriteMBAR (bdmContext *ctx, unsigned long l)
 {
-  return bdmWriteSystemRegister (BDM_REG_MBAR, l);
+  return bdmCtxWriteSystemRegister (ctx, BDM_REG_MBAR, l);
 }
 
 /*
  * Reset the target and disable BDM operation
  */
 int
-bdmRelease (void)
+bdmCtxRelease (bdmContext *ctx)
 {
   PRINTF ("Release\n");
-  return bdmIoctlCommand (BDM_RELEASE_CHIP);
+  return bdmCtxIoctlCommand (ctx, BDM_RELEASE_CHIP);
 }
 
 /*
  * Reset the target, enable BDM operation, enter BDM
  */
 int
-bdmReset (void)
+bdmCtxReset (bdmContext *ctx)
 {
   PRINTF ("Reset\n");
-  return bdmIoctlCommand (BDM_RESET_CHIP);
+  return bdmCtxIoctlCommand (ctx, BDM_RESET_CHIP);
 }
 
 /*
  * Restart the chip.
  */
 int
-bdmRestart (void)
+bdmCtxRestart (bdmContext *ctx)
 {
   PRINTF ("Restart\n");
-  return bdmIoctlCommand (BDM_RESTART_CHIP);
+  return bdmCtxIoctlCommand (ctx, BDM_RESTART_CHIP);
 }
 
 /*
  * Restart target execution
  */
 int
-bdmGo (void)
+bdmCtxGo (bdmContext *ctx)
 {
   PRINTF ("Go\n");
-  return bdmIoctlCommand (BDM_GO);
+  return bdmCtxIoctlCommand (ctx, BDM_GO);
 }
 
 /*
  * Stop the target
  */
 int
-bdmStop (void)
+bdmCtxStop (bdmContext *ctx)
 {
   PRINTF ("Stop\n");
-  return bdmIoctlCommand (BDM_STOP_CHIP);
+  return bdmCtxIoctlCommand (ctx, BDM_STOP_CHIP);
 }
 
 /*
  * Single-step the target
  */
 int
-bdmStep (void)
+bdmCtxStep (bdmContext *ctx)
 {
   PRINTF ("Step\n");
-  return bdmIoctlCommand (BDM_STEP_CHIP);
+  return bdmCtxIoctlCommand (ctx, BDM_STEP_CHIP);
 }
 
 /*
@@ -1362,12 +1925,12 @@ bdmStep (void)
  * `cbuf' is in target byte order
  */
 int
-bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
+bdmCtxReadMemory (bdmContext *ctx, unsigned long address, unsigned char *cbuf, unsigned long nbytes)
 {
   if (nbytes == 0)
     return 0;
 
-  if (!bdmCheck ())
+  if (!bdmCtxCheck (ctx))
     return -1;
 
   /*
@@ -1376,7 +1939,7 @@ bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
   if (((address & 0x3) == 0) && (nbytes >= 4)) {
     unsigned long l;
 
-    if (bdmReadLongWord (address, &l) < 0)
+    if (bdmCtxReadLongWord (ctx, address, &l) < 0)
       return -1;
     *cbuf++ = l >> 24;
     *cbuf++ = l >> 16;
@@ -1388,7 +1951,7 @@ bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
   else if (((address & 0x1) == 0) && (nbytes >= 2)) {
     unsigned short s;
 
-    if (bdmReadWord (address, &s) < 0)
+    if (bdmCtxReadWord (ctx, address, &s) < 0)
       return -1;
     *cbuf++ = s >> 8;
     *cbuf++ = s;
@@ -1397,7 +1960,7 @@ bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
   }
   else {
     do {
-      if (bdmReadByte (address, cbuf) < 0)
+      if (bdmCtxReadByte (ctx, address, cbuf) < 0)
         return -1;
       cbuf++;
       address++;
@@ -1406,7 +1969,7 @@ bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
   }
   if (nbytes == 0)
     return 0;
-  if (bdmRead (cbuf, nbytes) < 0)
+  if (bdmCtxRead (ctx, cbuf, nbytes) < 0)
     return -1;
   PRINTF ("Read %d byte%s\n", nbytes, nbytes == 1 ? "" : "s");
   return 0;
@@ -1417,14 +1980,14 @@ bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
  * `cbuf' is in target byte order
  */
 int
-bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
+bdmCtxWriteMemory (bdmContext *ctx, unsigned long address, unsigned char *cbuf, unsigned long nbytes)
 {
   int ret;
 
   if (nbytes == 0)
     return 0;
 
-  if (!bdmCheck ())
+  if (!bdmCtxCheck (ctx))
     return -1;
 
   /*
@@ -1437,7 +2000,7 @@ bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes
     l |= (unsigned long)*cbuf++ << 16;
     l |= (unsigned long)*cbuf++ << 8;
     l |= (unsigned long)*cbuf++;
-    if (bdmWriteLongWord (address, l) < 0)
+    if (bdmCtxWriteLongWord (ctx, address, l) < 0)
       return -1;
     address += 4;
     nbytes -= 4;
@@ -1447,14 +2010,14 @@ bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes
 
     s = (unsigned short)*cbuf++ << 8;
     s |= (unsigned short)*cbuf++;
-    if (bdmWriteWord (address, s) < 0)
+    if (bdmCtxWriteWord (ctx, address, s) < 0)
       return -1;
     address += 2;
     nbytes -= 2;
   }
   else {
     do {
-      if (bdmWriteByte (address, *cbuf) < 0)
+      if (bdmCtxWriteByte (ctx, address, *cbuf) < 0)
         return -1;
       cbuf++;
       address++;
@@ -1463,7 +2026,7 @@ bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes
   }
   if (nbytes == 0)
     return 0;
-  ret = bdmWrite (cbuf, nbytes);
+  ret = bdmCtxWrite (ctx, cbuf, nbytes);
   if (ret < 0)
     return -1;
   PRINTF ("Wrote %d byte%s\n", nbytes, nbytes == 1 ? "" : "s");
@@ -1474,9 +2037,9 @@ bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes
  * Get Driver version
  */
 int
-bdmGetDrvVersion (unsigned int *ver)
+bdmCtxGetDrvVersion (bdmContext *ctx, unsigned int *ver)
 {
-  if (bdmIoctlInt (BDM_GET_DRV_VER, (int*) ver) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_GET_DRV_VER, (int*) ver) < 0)
     return -1;
   PRINTF ("Driver version: %d.%d\n", *ver >> 8, *ver & 0xff);
   return 0;
@@ -1486,9 +2049,9 @@ bdmGetDrvVersion (unsigned int *ver)
  * Get Processor type
  */
 int
-bdmGetProcessor (int *processor)
+bdmCtxGetProcessor (bdmContext *ctx, int *processor)
 {
-  if (bdmIoctlInt (BDM_GET_CPU_TYPE, processor) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_GET_CPU_TYPE, processor) < 0)
     return -1;
   PRINTF ("CPU type: %d\n", *processor);
   return 0;
@@ -1498,10 +2061,318 @@ bdmGetProcessor (int *processor)
  * Get Interface type
  */
 int
-bdmGetInterface (int *pod)
+bdmCtxGetInterface (bdmContext *ctx, int *pod)
 {
-  if (bdmIoctlInt (BDM_GET_IF_TYPE, pod) < 0)
+  if (bdmCtxIoctlInt (ctx, BDM_GET_IF_TYPE, pod) < 0)
     return -1;
   PRINTF ("Interface type: %d\n", *pod);
   return 0;
 }
+
+/*
+ * The original interface to a single BDM per process. Each call is the
+ * context call made on the default context.
+ */
+
+int
+bdmCheck (void)
+{
+  return bdmCtxCheck (&bdm_default_context);
+}
+
+int
+bdmIoctlInt (int code, int *var)
+{
+  return bdmCtxIoctlInt (&bdm_default_context, code, var);
+}
+
+int
+bdmIoctlCommand (int code)
+{
+  return bdmCtxIoctlCommand (&bdm_default_context, code);
+}
+
+int
+bdmIoctlIo (int code, struct BDMioctl *ioc)
+{
+  return bdmCtxIoctlIo (&bdm_default_context, code, ioc);
+}
+
+int
+bdmExecBatch (struct BDMbatchOp *ops, int count)
+{
+  return bdmCtxExecBatch (&bdm_default_context, ops, count);
+}
+
+int
+bdmRead (unsigned char *cbuf, unsigned long nbytes)
+{
+  return bdmCtxRead (&bdm_default_context, cbuf, nbytes);
+}
+
+int
+bdmWrite (unsigned char *cbuf, unsigned long nbytes)
+{
+  return bdmCtxWrite (&bdm_default_context, cbuf, nbytes);
+}
+
+const char *
+bdmErrorString (void)
+{
+  return bdmCtxErrorString (&bdm_default_context);
+}
+
+int
+bdmOpen (const char *user_name)
+{
+  return bdmCtxOpen (&bdm_default_context, user_name);
+}
+
+int
+bdmClose (void)
+{
+  return bdmCtxClose (&bdm_default_context);
+}
+
+int
+bdmIsOpen (void)
+{
+  return bdmCtxIsOpen (&bdm_default_context);
+}
+
+int
+bdmStatus (void)
+{
+  return bdmCtxStatus (&bdm_default_context);
+}
+
+int
+bdmSetPollPolicy (unsigned long minUsecs, unsigned long maxUsecs,
+                  unsigned int tight)
+{
+  return bdmCtxSetPollPolicy (&bdm_default_context, minUsecs, maxUsecs, tight);
+}
+
+int
+bdmGetPollPolicy (unsigned long *minUsecs, unsigned long *maxUsecs,
+                  unsigned int *tight)
+{
+  return bdmCtxGetPollPolicy (&bdm_default_context, minUsecs, maxUsecs, tight);
+}
+
+int
+bdmPollWait (int (*poll) (void *arg), void *arg, int wakeFd)
+{
+  return bdmCtxPollWait (&bdm_default_context, poll, arg, wakeFd);
+}
+
+int
+bdmGetStats (int slot, bdmStats *stats)
+{
+  return bdmCtxGetStats (&bdm_default_context, slot, stats);
+}
+
+int
+bdmGetStatsTimes (unsigned long long *elapsedUsecs,
+                  unsigned long long *busyUsecs)
+{
+  return bdmCtxGetStatsTimes (&bdm_default_context, elapsedUsecs, busyUsecs);
+}
+
+int
+bdmResetStats (void)
+{
+  return bdmCtxResetStats (&bdm_default_context);
+}
+
+int
+bdmSetDelay (int delay)
+{
+  return bdmCtxSetDelay (&bdm_default_context, delay);
+}
+
+int
+bdmSetDriverDebugFlag (int debugFlag)
+{
+  return bdmCtxSetDriverDebugFlag (&bdm_default_context, debugFlag);
+}
+
+int
+bdmColdfireGetPST (int *pst)
+{
+  return bdmCtxColdfireGetPST (&bdm_default_context, pst);
+}
+
+int
+bdmColdfireSetPST (int pst)
+{
+  return bdmCtxColdfireSetPST (&bdm_default_context, pst);
+}
+
+int
+bdmClockBench (unsigned long *bitsPerSec)
+{
+  return bdmCtxClockBench (&bdm_default_context, bitsPerSec);
+}
+
+int
+bdmReadControlRegister (int code, unsigned long *lp)
+{
+  return bdmCtxReadControlRegister (&bdm_default_context, code, lp);
+}
+
+int
+bdmReadDebugRegister (int code, unsigned long *lp)
+{
+  return bdmCtxReadDebugRegister (&bdm_default_context, code, lp);
+}
+
+int
+bdmReadSystemRegister (int code, unsigned long *lp)
+{
+  return bdmCtxReadSystemRegister (&bdm_default_context, code, lp);
+}
+
+int
+bdmReadRegister (int code, unsigned long *lp)
+{
+  return bdmCtxReadRegister (&bdm_default_context, code, lp);
+}
+
+int
+bdmWriteControlRegister (int code, unsigned long l)
+{
+  return bdmCtxWriteControlRegister (&bdm_default_context, code, l);
+}
+
+int
+bdmWriteDebugRegister (int code, unsigned long l)
+{
+  return bdmCtxWriteDebugRegister (&bdm_default_context, code, l);
+}
+
+int
+bdmWriteSystemRegister (int code, unsigned long l)
+{
+  return bdmCtxWriteSystemRegister (&bdm_default_context, code, l);
+}
+
+int
+bdmWriteRegister (int code, unsigned long l)
+{
+  return bdmCtxWriteRegister (&bdm_default_context, code, l);
+}
+
+int
+bdmReadLongWord (unsigned long address, unsigned long *lp)
+{
+  return bdmCtxReadLongWord (&bdm_default_context, address, lp);
+}
+
+int
+bdmReadWord (unsigned long address, unsigned short *sp)
+{
+  return bdmCtxReadWord (&bdm_default_context, address, sp);
+}
+
+int
+bdmReadByte (unsigned long address, unsigned char *cp)
+{
+  return bdmCtxReadByte (&bdm_default_context, address, cp);
+}
+
+int
+bdmWriteLongWord (unsigned long address, unsigned long l)
+{
+  return bdmCtxWriteLongWord (&bdm_default_context, address, l);
+}
+
+int
+bdmWriteWord (unsigned long address, unsigned short s)
+{
+  return bdmCtxWriteWord (&bdm_default_context, address, s);
+}
+
+int
+bdmWriteByte (unsigned long address, unsigned char c)
+{
+  return bdmCtxWriteByte (&bdm_default_context, address, c);
+}
+
+int
+bdmReadMBAR (unsigned long *lp)
+{
+  return bdmCtxReadMBAR (&bdm_default_context, lp);
+}
+
+int
+bdmWriteMBAR (unsigned long l)
+{
+  return bdmCtxWriteMBAR (&bdm_default_context, l);
+}
+
+int
+bdmRelease (void)
+{
+  return bdmCtxRelease (&bdm_default_context);
+}
+
+int
+bdmReset (void)
+{
+  return bdmCtxReset (&bdm_default_context);
+}
+
+int
+bdmRestart (void)
+{
+  return bdmCtxRestart (&bdm_default_context);
+}
+
+int
+bdmGo (void)
+{
+  return bdmCtxGo (&bdm_default_context);
+}
+
+int
+bdmStop (void)
+{
+  return bdmCtxStop (&bdm_default_context);
+}
+
+int
+bdmStep (void)
+{
+  return bdmCtxStep (&bdm_default_context);
+}
+
+int
+bdmReadMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
+{
+  return bdmCtxReadMemory (&bdm_default_context, address, cbuf, nbytes);
+}
+
+int
+bdmWriteMemory (unsigned long address, unsigned char *cbuf, unsigned long nbytes)
+{
+  return bdmCtxWriteMemory (&bdm_default_context, address, cbuf, nbytes);
+}
+
+int
+bdmGetDrvVersion (unsigned int *ver)
+{
+  return bdmCtxGetDrvVersion (&bdm_default_context, ver);
+}
+
+int
+bdmGetProcessor (int *processor)
+{
+  return bdmCtxGetProcessor (&bdm_default_context, processor);
+}
+
+int
+bdmGetInterface (int *pod)
+{
+  return bdmCtxGetInterface (&bdm_default_context, pod);
+}
@@ -65,6 +65,20 @@
  */
 static const char *hex = "0123456789abcdef";
 
+/*
+ * Binary framing state. Set when the server agrees to binary mode
+ * during the HELO handshake.
+ */
+static int           remote_binary;
+static unsigned int  remote_next_id;
+static unsigned char remote_frame_buf[BDM_REMOTE_BIN_HDR_SIZE +
+                                      BDM_REMOTE_BIN_MAX_PAYLOAD];
+
+/*
+ * The framing state is shared, so only one link is open at a time.
+ */
+static int           remote_connected;
+
 /*
  * Ioctl code translation.
  */
@@ -97,7 +111,8 @@ static const int ioctl_code_table[] = {
   BDM_READ_CTLREG,
   BDM_WRITE_CTLREG,
   BDM_READ_DBREG,
-  BDM_WRITE_DBREG
+  BDM_WRITE_DBREG,
+  BDM_CLOCK_BENCH
 };
 
 /*
@@ -237,6 +252,297 @@ bdmRemoteWait (int fd, char *buf, int buf_len)
   return -1;
 }
 
+/*
+ * Receive exactly nbytes from the link.
+ */
+static int
+bdmRemoteRecv (int fd, unsigned char *buf, int nbytes)
+{
+  int            numfds;
+  struct timeval tv;
+  fd_set         readfds;
+  int            cread;
+  int            got = 0;
+
+  while (got < nbytes) {
+    FD_ZERO (&readfds);
+    FD_SET (fd, &readfds);
+
+    tv.tv_sec  = BDM_REMOTE_TIMEOUT;
+    tv.tv_usec = 0;
+
+    numfds = select (fd + 1, &readfds, 0, 0, &tv);
+    if (numfds == 0) {
+      errno = BDM_FAULT_TIMEOUT;
+      return -1;
+    }
+    if (numfds < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+#if defined (__WIN32__)
+    cread = recv (fd, (char *) buf + got, nbytes - got, 0);
+#else
+    cread = read (fd, buf + got, nbytes - got);
+#endif
+
+    if (cread == 0) {
+      errno = EPIPE;
+      return -1;
+    }
+    if (cread < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    got += cread;
+  }
+  return got;
+}
+
+/*
+ * Send a binary frame. The header and payload go out in a single
+ * write so a small request is a single segment.
+ */
+static int
+bdmRemoteBinSend (int fd, bdm_remote_frame *frame, const unsigned char *payload)
+{
+  int len = BDM_REMOTE_BIN_HDR_SIZE + frame->length;
+  int sent = 0;
+  int wrote;
+
+#if BDM_REMOTE_TRACE
+  bdmPrint ("bdm-remote:bin-send: op:%d id:%d len:%lu\n",
+            frame->op, frame->id, frame->length);
+#endif
+
+  bdmRemoteFramePack (remote_frame_buf, frame);
+  if (frame->length)
+    memcpy (remote_frame_buf + BDM_REMOTE_BIN_HDR_SIZE, payload, frame->length);
+
+  while (sent < len) {
+#if defined (__WIN32__)
+    wrote = send (fd, (char *) remote_frame_buf + sent, len - sent, 0);
+#else
+    wrote = write (fd, remote_frame_buf + sent, len - sent);
+#endif
+    if (wrote < 0) {
+      if (errno == EINTR)
+        continue;
+      bdmPrint ("bdm-remote:bin-send: socket write failed: %s\n",
+                strerror (errno));
+      return -1;
+    }
+    sent += wrote;
+  }
+  return sent;
+}
+
+/*
+ * Receive the reply for the request id and op. The payload is placed in
+ * `payload' which can hold `max' bytes. A NULL payload discards the data.
+ */
+static int
+bdmRemoteBinRecv (int fd, bdm_remote_frame *frame, unsigned int id,
+                  unsigned int op, unsigned char *payload, int max)
+{
+  if (bdmRemoteRecv (fd, remote_frame_buf, BDM_REMOTE_BIN_HDR_SIZE) < 0)
+    return -1;
+
+  bdmRemoteFrameUnpack (remote_frame_buf, frame);
+
+#if BDM_REMOTE_TRACE
+  bdmPrint ("bdm-remote:bin-recv: op:%d id:%d len:%lu err:%lu\n",
+            frame->op, frame->id, frame->length, frame->error);
+#endif
+
+  if ((frame->id != id) || (frame->op != op) ||
+      (frame->length > BDM_REMOTE_BIN_MAX_PAYLOAD) ||
+      (payload && (frame->length > max))) {
+    bdmPrint ("bdm-remote:bin-recv: protocol error, op:%d id:%d len:%lu "
+              "(expected op:%d id:%d)\n",
+              frame->op, frame->id, frame->length, op, id);
+    errno = EIO;
+    return -1;
+  }
+
+  if (frame->length) {
+    if (!payload)
+      payload = remote_frame_buf;
+    if (bdmRemoteRecv (fd, payload, frame->length) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*
+ * A single request/reply exchange with no request payload.
+ */
+static int
+bdmRemoteBinTransact (int fd, bdm_remote_frame *frame)
+{
+  unsigned int id = remote_next_id++ & 0xffff;
+  unsigned int op = frame->op;
+
+  frame->id     = id;
+  frame->length = 0;
+  frame->error  = 0;
+
+  if (bdmRemoteBinSend (fd, frame, NULL) < 0)
+    return -1;
+
+  if (bdmRemoteBinRecv (fd, frame, id, op, NULL, 0) < 0)
+    return -1;
+
+  if (frame->error) {
+    errno = frame->error;
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Pipelined binary read. The request is split into frames and up to
+ * BDM_REMOTE_BIN_WINDOW are kept in flight. If a frame fails no more
+ * are sent and the outstanding replies are drained.
+ */
+static int
+bdmRemoteBinRead (int fd, unsigned char *cbuf, int nbytes)
+{
+  bdm_remote_frame frame;
+  int              requested = 0;
+  int              received = 0;
+  int              in_flight = 0;
+  int              error = 0;
+
+  while (1) {
+    while (!error && (requested < nbytes) &&
+           (in_flight < BDM_REMOTE_BIN_WINDOW)) {
+      int chunk = nbytes - requested;
+      if (chunk > BDM_REMOTE_BIN_MAX_PAYLOAD)
+        chunk = BDM_REMOTE_BIN_MAX_PAYLOAD;
+      memset (&frame, 0, sizeof (frame));
+      frame.op     = BDM_REMOTE_BIN_READ;
+      frame.id     = remote_next_id++ & 0xffff;
+      frame.arg[0] = chunk;
+      if (bdmRemoteBinSend (fd, &frame, NULL) < 0)
+        return -1;
+      requested += chunk;
+      in_flight++;
+    }
+
+    if (!in_flight)
+      break;
+
+    if (bdmRemoteBinRecv (fd, &frame, (remote_next_id - in_flight) & 0xffff,
+                          BDM_REMOTE_BIN_READ,
+                          error ? NULL : cbuf + received,
+                          nbytes - received) < 0)
+      return -1;
+
+    in_flight--;
+
+    if (!error) {
+      if (frame.error)
+        error = frame.error;
+      else
+        received += frame.length;
+    }
+  }
+
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return received;
+}
+
+/*
+ * Pipelined binary write. Same windowing as the read.
+ */
+static int
+bdmRemoteBinWrite (int fd, unsigned char *cbuf, int nbytes)
+{
+  bdm_remote_frame frame;
+  int              sent = 0;
+  int              written = 0;
+  int              in_flight = 0;
+  int              error = 0;
+
+  while (1) {
+    while (!error && (sent < nbytes) && (in_flight < BDM_REMOTE_BIN_WINDOW)) {
+      int chunk = nbytes - sent;
+      if (chunk > BDM_REMOTE_BIN_MAX_PAYLOAD)
+        chunk = BDM_REMOTE_BIN_MAX_PAYLOAD;
+      memset (&frame, 0, sizeof (frame));
+      frame.op     = BDM_REMOTE_BIN_WRITE;
+      frame.id     = remote_next_id++ & 0xffff;
+      frame.length = chunk;
+      if (bdmRemoteBinSend (fd, &frame, cbuf + sent) < 0)
+        return -1;
+      sent += chunk;
+      in_flight++;
+    }
+
+    if (!in_flight)
+      break;
+
+    if (bdmRemoteBinRecv (fd, &frame, (remote_next_id - in_flight) & 0xffff,
+                          BDM_REMOTE_BIN_WRITE, NULL, 0) < 0)
+      return -1;
+
+    in_flight--;
+
+    if (!error) {
+      if (frame.error)
+        error = frame.error;
+      else
+        written += frame.arg[0];
+    }
+  }
+
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return written;
+}
+
+/*
+ * Ask the server to switch to binary framing. Any failure leaves the
+ * link using the text protocol.
+ */
+static void
+bdmRemoteNegotiateBinary (int fd)
+{
+  char buf[BDM_REMOTE_BUF_SIZE];
+  int  buf_len;
+  char *s;
+
+  if (getenv ("BDM_REMOTE_TEXT"))
+    return;
+
+  buf_len = 1 + sprintf (buf, "BINARY 1");
+
+  if (bdmSocketSend (fd, buf, buf_len) != buf_len)
+    return;
+
+  if (bdmRemoteWait (fd, buf, BDM_REMOTE_BUF_SIZE) < 0)
+    return;
+
+  s = strstr (buf, "BINARY");
+
+  if (!s)
+    return;
+
+  s += sizeof "BINARY";
+
+  if (strtoul (s, NULL, 0) == 0)
+    remote_binary = 1;
+}
+
 int
 bdmRemoteName (const char *name)
 {
@@ -288,9 +594,20 @@ bdmRemoteClose (int fd)
 {
   char buf[BDM_REMOTE_BUF_SIZE];
 
-  strcpy (buf, "QUIT Later.");
-  bdmSocketSend (fd, buf, strlen (buf) + 1);
+  if (remote_binary) {
+    bdm_remote_frame frame;
+    memset (&frame, 0, sizeof (frame));
+    frame.op = BDM_REMOTE_BIN_QUIT;
+    frame.id = remote_next_id++ & 0xffff;
+    bdmRemoteBinSend (fd, &frame, NULL);
+    remote_binary = 0;
+  }
+  else {
+    strcpy (buf, "QUIT Later.");
+    bdmSocketSend (fd, buf, strlen (buf) + 1);
+  }
 
+  remote_connected = 0;
   return close (fd);
 }
 
@@ -316,6 +633,18 @@ bdmRemoteIoctlInt (int fd, int code, int *var)
     return -1;
   }
 
+  if (remote_binary) {
+    bdm_remote_frame frame;
+    memset (&frame, 0, sizeof (frame));
+    frame.op     = BDM_REMOTE_BIN_IOINT;
+    frame.arg[0] = id;
+    frame.arg[1] = *var;
+    if (bdmRemoteBinTransact (fd, &frame) < 0)
+      return -1;
+    *var = (int) frame.arg[1];
+    return 0;
+  }
+
   /*
    * Pack the message and send.
    */
@@ -375,6 +704,14 @@ bdmRemoteIoctlCommand (int fd, int code)
     return -1;
   }
 
+  if (remote_binary) {
+    bdm_remote_frame frame;
+    memset (&frame, 0, sizeof (frame));
+    frame.op     = BDM_REMOTE_BIN_IOCMD;
+    frame.arg[0] = id;
+    return bdmRemoteBinTransact (fd, &frame);
+  }
+
   /*
    * Pack the message and send.
    */
@@ -430,6 +767,20 @@ bdmRemoteIoctlIo (int fd, int code, struct BDMioctl *ioc)
     return -1;
   }
 
+  if (remote_binary) {
+    bdm_remote_frame frame;
+    memset (&frame, 0, sizeof (frame));
+    frame.op     = BDM_REMOTE_BIN_IOIO;
+    frame.arg[0] = id;
+    frame.arg[1] = ioc->address;
+    frame.arg[2] = ioc->value;
+    if (bdmRemoteBinTransact (fd, &frame) < 0)
+      return -1;
+    ioc->address = frame.arg[1];
+    ioc->value   = frame.arg[2];
+    return 0;
+  }
+
   /*
    * Pack the message and send.
    */
@@ -486,6 +837,9 @@ bdmRemoteRead (int fd, unsigned char *cbuf, int nbytes)
   unsigned char octet;
   char          *s;
 
+  if (remote_binary)
+    return bdmRemoteBinRead (fd, cbuf, nbytes);
+
   /*
    * Pack the message and send. For a read send the address and length.
    * The server will return a protocol status code, the read protocol
@@ -603,6 +957,9 @@ bdmRemoteWrite (int fd, unsigned char *cbuf, int nbytes)
   if (nbytes == 0)
     return 0;
 
+  if (remote_binary)
+    return bdmRemoteBinWrite (fd, cbuf, nbytes);
+
   buf_len = sprintf (buf, "WRITE %d,", nbytes);
   bytes = 0;
 
@@ -648,6 +1005,187 @@ bdmRemoteWrite (int fd, unsigned char *cbuf, int nbytes)
   return nbytes;
 }
 
+/*
+ * Run a batch of BDMioctl requests. In binary mode the operations are
+ * sent in as few frames as possible, otherwise one request per
+ * operation.
+ */
+static int
+bdmRemoteExecBatch (int fd, struct BDMbatchOp *ops, int count)
+{
+  static unsigned char payload[BDM_REMOTE_BIN_MAX_PAYLOAD];
+  bdm_remote_frame frame;
+  unsigned int     id;
+  int              done = 0;
+  int              batch;
+  int              op;
+  int              ioid;
+
+  if (!remote_binary) {
+    for (op = 0; op < count; op++) {
+      if (bdmRemoteIoctlIo (fd, ops[op].code, &ops[op].ioc) < 0) {
+        ops[op].error = errno;
+        return -1;
+      }
+      ops[op].error = 0;
+    }
+    return 0;
+  }
+
+  while (done < count) {
+    unsigned char *p = payload;
+
+    for (batch = 0;
+         (batch < BDM_REMOTE_BIN_BATCH_MAX) && ((done + batch) < count);
+         batch++) {
+      ioid = bdmGenerateIOId (ops[done + batch].code);
+      if (ioid < 0)
+        break;
+      bdmRemotePut32 (p, ioid);
+      bdmRemotePut32 (p + 4, (unsigned long) -1);
+      bdmRemotePut32 (p + 8, ops[done + batch].ioc.address);
+      bdmRemotePut32 (p + 12, ops[done + batch].ioc.value);
+      p += BDM_REMOTE_BIN_BATCH_OP_SIZE;
+    }
+
+    if (batch == 0) {
+      ops[done].error = EINVAL;
+      errno = EINVAL;
+      return -1;
+    }
+
+    id = remote_next_id++ & 0xffff;
+
+    memset (&frame, 0, sizeof (frame));
+    frame.op     = BDM_REMOTE_BIN_BATCH;
+    frame.id     = id;
+    frame.length = batch * BDM_REMOTE_BIN_BATCH_OP_SIZE;
+    frame.arg[0] = batch;
+
+    if (bdmRemoteBinSend (fd, &frame, payload) < 0)
+      return -1;
+
+    if (bdmRemoteBinRecv (fd, &frame, id, BDM_REMOTE_BIN_BATCH,
+                          payload, sizeof (payload)) < 0)
+      return -1;
+
+    if (frame.length != (batch * BDM_REMOTE_BIN_BATCH_OP_SIZE)) {
+      errno = EIO;
+      return -1;
+    }
+
+    for (op = 0, p = payload; op < batch; op++) {
+      ops[done + op].error       = (int) bdmRemoteGet32 (p + 4);
+      ops[done + op].ioc.address = bdmRemoteGet32 (p + 8);
+      ops[done + op].ioc.value   = bdmRemoteGet32 (p + 12);
+      p += BDM_REMOTE_BIN_BATCH_OP_SIZE;
+    }
+
+    if (frame.error) {
+      errno = frame.error;
+      return -1;
+    }
+
+    done += batch;
+  }
+
+  return 0;
+}
+
+/*
+ * Wait for input on the link or wakeFd with no timeout. Returns 1 for
+ * the link, 0 for wakeFd. A wakeFd at end of file is dropped and the
+ * wait carries on with the link.
+ */
+static int
+bdmRemoteSelect (int fd, int wakeFd)
+{
+  fd_set readfds;
+  int    numfds;
+
+  while (1) {
+    FD_ZERO (&readfds);
+    FD_SET (fd, &readfds);
+    if (wakeFd >= 0)
+      FD_SET (wakeFd, &readfds);
+
+    numfds = select ((fd > wakeFd ? fd : wakeFd) + 1, &readfds, 0, 0, 0);
+    if (numfds < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (FD_ISSET (fd, &readfds))
+      return 1;
+    if ((wakeFd >= 0) && FD_ISSET (wakeFd, &readfds)) {
+      if (!bdmWakeFdClosed (wakeFd))
+        return 0;
+      wakeFd = -1;
+    }
+  }
+}
+
+/*
+ * Have the server watch the target status. The link is quiet until the
+ * target needs attention. Input on wakeFd ends the watch with a status
+ * request.
+ */
+static int
+bdmRemoteStatusWait (int fd, int mask, int wakeFd)
+{
+  bdm_remote_frame frame;
+  unsigned int     id;
+  int              ready;
+
+  if (!remote_binary) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  memset (&frame, 0, sizeof (frame));
+  frame.op     = BDM_REMOTE_BIN_WATCH;
+  frame.id     = id = remote_next_id++ & 0xffff;
+  frame.arg[0] = mask;
+  if (bdmRemoteBinSend (fd, &frame, NULL) < 0)
+    return -1;
+
+  if ((ready = bdmRemoteSelect (fd, wakeFd)) < 0)
+    return -1;
+
+  /*
+   * The status request ends the watch. Its reply follows the watch's.
+   */
+  if (!ready) {
+    unsigned int status_id = remote_next_id++ & 0xffff;
+
+    memset (&frame, 0, sizeof (frame));
+    frame.op     = BDM_REMOTE_BIN_IOINT;
+    frame.id     = status_id;
+    frame.arg[0] = bdmGenerateIOId (BDM_GET_STATUS);
+    if (bdmRemoteBinSend (fd, &frame, NULL) < 0)
+      return -1;
+    if (bdmRemoteBinRecv (fd, &frame, id, BDM_REMOTE_BIN_WATCH, NULL, 0) < 0)
+      return -1;
+    if (bdmRemoteBinRecv (fd, &frame, status_id, BDM_REMOTE_BIN_IOINT,
+                          NULL, 0) < 0)
+      return -1;
+    if (frame.error) {
+      errno = frame.error;
+      return -1;
+    }
+    return (int) frame.arg[1];
+  }
+
+  if (bdmRemoteBinRecv (fd, &frame, id, BDM_REMOTE_BIN_WATCH, NULL, 0) < 0)
+    return -1;
+
+  if (frame.error) {
+    errno = frame.error;
+    return -1;
+  }
+  return (int) frame.arg[0];
+}
+
 /*
  * The remote interface handlers.
  */
@@ -659,7 +1197,9 @@ static bdm_iface remoteIface = {
   .ioctl_int = bdmRemoteIoctlInt,
   .ioctl_io = bdmRemoteIoctlIo,
   .ioctl_cmd = bdmRemoteIoctlCommand,
-  .error_str = bdmRemoteStrerror
+  .error_str = bdmRemoteStrerror,
+  .exec_batch = bdmRemoteExecBatch,
+  .status_wait = bdmRemoteStatusWait
 };
 
 /*
@@ -686,6 +1226,14 @@ bdmRemoteOpen (const char *name, bdm_iface** iface)
   char               *s;
 
   *iface = NULL;
+
+  if (remote_connected) {
+    bdmPrint ("bdm-remote:open: a remote link is already open\n");
+    errno = EBUSY;
+    return -1;
+  }
+
+  remote_binary = 0;
   
 #if defined (__WIN32__)
   if (!bdmInitWinSock ()) {
@@ -893,6 +1441,11 @@ bdmRemoteOpen (const char *name, bdm_iface** iface)
     fd = -1;
     errno = save_errno;
   }
+  else {
+    remote_connected = 1;
+    if (strstr (s, BDM_REMOTE_BIN_CAPABILITY))
+      bdmRemoteNegotiateBinary (fd);
+  }
 
   *iface = &remoteIface;
   
@@ -42,6 +42,109 @@ extern "C"
 int bdmRemoteName (const char *name);
 int bdmRemoteOpen (const char *name, bdm_iface** iface);
 
+/*
+ * Binary wire protocol shared by the client and bdmd.
+ *
+ * A server that supports binary framing appends BDM_REMOTE_BIN_CAPABILITY
+ * to its HELO reply. The client may then send the text message "BINARY 1"
+ * and once the server answers "BINARY 0" (errno 0) both ends only exchange
+ * frames. If the server does not advertise the capability the text
+ * protocol is used as before.
+ *
+ * A frame is a fixed size header in network byte order followed by
+ * `length' bytes of raw payload. The server answers every request, except
+ * QUIT, with a frame carrying the same op and id. Requests are handled in
+ * the order they arrive so a client can have several in flight.
+ *
+ *   op      request args              reply args           payload
+ *   IOINT   id, var                   id, var              -
+ *   IOCMD   id                        id                   -
+ *   IOIO    id, address, value        id, address, value   -
+ *   READ    nbytes                    nbytes read          reply data
+ *   WRITE   -                         nbytes written       request data
+ *   BATCH   count                     count                ops, see below
+ *   WATCH   status mask               status               -
+ *
+ * A BATCH payload is `count' BDM_REMOTE_BIN_BATCH_OP_SIZE entries of
+ * ioctl id, error, address and value, in both directions. The reply
+ * frame error is the error of the failed operation.
+ *
+ * A WATCH is answered once the target status has a bit of the mask set.
+ * The server polls its BDM meanwhile. The next request from the client
+ * ends the watch early, it is answered with the current status before
+ * that request is handled. Servers without WATCH fail it with EINVAL.
+ */
+#define BDM_REMOTE_BIN_CAPABILITY  "BIN1"
+#define BDM_REMOTE_BIN_HDR_SIZE    (24)
+#define BDM_REMOTE_BIN_MAX_PAYLOAD (64 * 1024)
+#define BDM_REMOTE_BIN_WINDOW      (8)
+#define BDM_REMOTE_BIN_BATCH_OP_SIZE (16)
+#define BDM_REMOTE_BIN_BATCH_MAX   (BDM_REMOTE_BIN_MAX_PAYLOAD / \
+                                    BDM_REMOTE_BIN_BATCH_OP_SIZE)
+
+enum bdm_remote_bin_op
+{
+  BDM_REMOTE_BIN_IOINT = 1,
+  BDM_REMOTE_BIN_IOCMD,
+  BDM_REMOTE_BIN_IOIO,
+  BDM_REMOTE_BIN_READ,
+  BDM_REMOTE_BIN_WRITE,
+  BDM_REMOTE_BIN_QUIT,
+  BDM_REMOTE_BIN_BATCH,
+  BDM_REMOTE_BIN_WATCH
+};
+
+typedef struct
+{
+  unsigned long  length;
+  unsigned int   id;
+  unsigned int   op;
+  unsigned long  error;
+  unsigned long  arg[3];
+} bdm_remote_frame;
+
+static inline void
+bdmRemotePut32 (unsigned char *p, unsigned long v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static inline unsigned long
+bdmRemoteGet32 (const unsigned char *p)
+{
+  return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) |
+    ((unsigned long) p[2] << 8) | p[3];
+}
+
+static inline void
+bdmRemoteFramePack (unsigned char *hdr, const bdm_remote_frame *frame)
+{
+  bdmRemotePut32 (hdr, frame->length);
+  hdr[4] = frame->id >> 8;
+  hdr[5] = frame->id;
+  hdr[6] = frame->op;
+  hdr[7] = 0;
+  bdmRemotePut32 (hdr + 8, frame->error);
+  bdmRemotePut32 (hdr + 12, frame->arg[0]);
+  bdmRemotePut32 (hdr + 16, frame->arg[1]);
+  bdmRemotePut32 (hdr + 20, frame->arg[2]);
+}
+
+static inline void
+bdmRemoteFrameUnpack (const unsigned char *hdr, bdm_remote_frame *frame)
+{
+  frame->length = bdmRemoteGet32 (hdr);
+  frame->id     = (hdr[4] << 8) | hdr[5];
+  frame->op     = hdr[6];
+  frame->error  = bdmRemoteGet32 (hdr + 8);
+  frame->arg[0] = bdmRemoteGet32 (hdr + 12);
+  frame->arg[1] = bdmRemoteGet32 (hdr + 16);
+  frame->arg[2] = bdmRemoteGet32 (hdr + 20);
+}
+
 #if __cplusplus
 }
 #endif
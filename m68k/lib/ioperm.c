@@ -305,15 +305,25 @@ bdm_ioperm_ioctl_io (int fd, int code, struct BDMioctl *ioc)
   return bdm_ioperm_ioctl (fd, code, ioc);
 }
 
+static int
+bdm_ioperm_exec_batch (int fd, struct BDMbatchOp *ops, int count)
+{
+  struct BDMbatch batch;
+  batch.count = count;
+  batch.ops = ops;
+  return bdm_ioperm_ioctl (fd, BDM_EXEC_BATCH, &batch);
+}
+
 static bdm_iface iopermIface = {
-  .open      = bdm_ioperm_open,
-  .close     = bdm_ioperm_close,
-  .read      = bdm_ioperm_read,
-  .write     = bdm_ioperm_write,
-  .ioctl_int = bdm_ioperm_ioctl_int,
-  .ioctl_io  = bdm_ioperm_ioctl_io,
-  .ioctl_cmd = bdm_ioperm_ioctl_command,
-  .error_str = NULL
+  .open       = bdm_ioperm_open,
+  .close      = bdm_ioperm_close,
+  .read       = bdm_ioperm_read,
+  .write      = bdm_ioperm_write,
+  .ioctl_int  = bdm_ioperm_ioctl_int,
+  .ioctl_io   = bdm_ioperm_ioctl_io,
+  .ioctl_cmd  = bdm_ioperm_ioctl_command,
+  .error_str  = NULL,
+  .exec_batch = bdm_ioperm_exec_batch
 };
 
 /*
@@ -16,6 +16,7 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -58,6 +59,40 @@ bdmLocalIoctlIo (int fd, int code, struct BDMioctl *ioc)
   return ioctl (fd, code, ioc);
 }
 
+/*
+ * Run a batch of BDMioctl requests. A driver that does not know the
+ * batch request fails without touching the first operation so fall
+ * back to one ioctl per operation.
+ */
+static int
+bdmLocalExecBatch (int fd, struct BDMbatchOp *ops, int count)
+{
+  struct BDMbatch batch;
+  int             op;
+
+  if (count <= 0)
+    return 0;
+
+  batch.count = count;
+  batch.ops = ops;
+  ops[0].error = -1;
+
+  if (ioctl (fd, BDM_EXEC_BATCH, &batch) == 0)
+    return 0;
+
+  if (ops[0].error != -1)
+    return -1;
+
+  for (op = 0; op < count; op++) {
+    if (ioctl (fd, ops[op].code, &ops[op].ioc) < 0) {
+      ops[op].error = errno;
+      return -1;
+    }
+    ops[op].error = 0;
+  }
+  return 0;
+}
+
 /*
  * Do a BDM read
  */
@@ -84,7 +119,8 @@ static bdm_iface localIface = {
   .ioctl_int = bdmLocalIoctlInt,
   .ioctl_io = bdmLocalIoctlIo,
   .ioctl_cmd = bdmLocalIoctlCommand,
-  .error_str = NULL
+  .error_str = NULL,
+  .exec_batch = bdmLocalExecBatch
 };
 
 int
@@ -0,0 +1,1309 @@
+/*
+ * Motorola Background Debug Mode Simulated Target
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * A software model of a pod and target so the library, the flash
+ * drivers, bdmctrl and the gdbserver can be run and profiled without
+ * hardware. The device name is:
+ *
+ *   sim:<target>[,<option>=<value>...]
+ *
+ * The targets are:
+ *
+ *   cf5282  A M5282EVB. 16M SDRAM at 0, the 64K SRAM at 0x20000000, the
+ *           512K CFM at 0xf0000000 (FLASHBAR 0xf0000061) with IPSBAR at
+ *           0x40000000, and a Am29PL160C on a 16 bit bus at 0xffe00000.
+ *   cpu32   A MC68332 board. A Am29F400BB on a 16 bit bus at 0, 1M RAM
+ *           at 0x100000 and the SIM registers at 0xfff000.
+ *
+ * The 29 series chips have uniform 64K sectors and the CFM 2K pages.
+ * The options are:
+ *
+ *   link=none|lpt|usb|net  The costs of a pod type, none by default.
+ *   op=<usecs>             The cost of a single request.
+ *   batch=<usecs>          The cost of each request in a batch.
+ *   byte=<nsecs>           The cost of a byte in a block transfer.
+ *   erase=<msecs>          The sector erase time. A chip erase takes
+ *                          eight times as long.
+ *   run=<msecs>            How long a resumed target runs before it
+ *                          halts. The default of 0 runs until stopped.
+ *
+ * The model has a clock each request moves on by its cost. When the
+ * clock gets ahead of the host's the request sleeps so a tool takes
+ * as long as it would over the link modelled. The flash state machines
+ * and the running target are timed by the same clock.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+#if defined (__WIN32__)
+#include <windows.h>
+#else
+#include <sys/select.h>
+#endif
+
+#include "simIface.h"
+
+#define SIM_MAX_DEVICES  (4)
+#define SIM_MAX_REGIONS  (16)
+#define SIM_MAX_CTLREGS  (32)
+#define SIM_MAX_DBREGS   (32)
+
+/*
+ * Sleep once the clock is this far ahead of the host. Shorter sleeps
+ * are lost in the scheduler's granularity.
+ */
+#define SIM_SLACK_NSECS  (1000000ULL)
+
+/*
+ * Flash timing.
+ */
+#define SIM_F29_PROGRAM_NSECS  (9000ULL)
+#define SIM_F29_SECTOR_NSECS   (700000000ULL)
+#define SIM_F29_SECTOR_SIZE    (0x10000)
+#define SIM_CFM_PROGRAM_NSECS  (40000ULL)
+#define SIM_CFM_PAGE_NSECS     (20000000ULL)
+#define SIM_CFM_VERIFY_NSECS   (10000ULL)
+#define SIM_CFM_PAGE_SIZE      (0x800)
+#define SIM_MASS_ERASE_FACTOR  (8)
+
+/*
+ * The CFM registers and bits.
+ */
+#define SIM_IPS_CFM      (0x1d0000)
+#define SIM_IPS_BACKDOOR (0x04000000)
+#define SIM_CFM_CLKD     (0x02)
+#define SIM_CFM_USTAT    (0x20)
+#define SIM_CFM_CMD      (0x24)
+#define SIM_CFM_DIVLD    (0x80)
+#define SIM_CFM_BLANK    (0x04)
+#define SIM_CFM_ACCERR   (0x10)
+#define SIM_CFM_PVIOL    (0x20)
+#define SIM_CFM_CCIF     (0x40)
+#define SIM_CFM_CBEIF    (0x80)
+
+/*
+ * The Coldfire CSR halt reasons, debug revision B, and the FLASHBAR
+ * control register.
+ */
+#define SIM_CSR_HALT     (0x02000000)
+#define SIM_CSR_BKPT     (0x01000000)
+#define SIM_CSR_STATUS   (0x0f000000)
+#define SIM_CSR_REVISION (0x00100000)
+#define SIM_CF_FLASHBAR  (0xc04)
+
+typedef enum
+{
+  SIM_RAM,
+  SIM_FLASH29,
+  SIM_CFM,
+  SIM_CFM_REGS,
+  SIM_CFM_BACKDOOR
+} sim_mem_type;
+
+typedef struct
+{
+  sim_mem_type  type;
+  unsigned long base;
+  unsigned long size;
+} sim_region;
+
+typedef struct
+{
+  const char       *name;
+  int              cpu;
+  int              iface;
+  const sim_region *regions;
+  unsigned long    flashbar;
+  unsigned int     f29_manufacturer;
+  unsigned int     f29_device;
+  int              f29_bypass;
+} sim_target;
+
+/*
+ * Rough per request costs of the pods. A parallel port pod clocks every
+ * bit from the host. A USB pod pays a round trip per request but packs
+ * batches. A server pays a network round trip on top of its own pod,
+ * so model it as a fast pod behind a LAN.
+ */
+typedef struct
+{
+  const char    *name;
+  unsigned long op_nsecs;
+  unsigned long batch_nsecs;
+  unsigned long byte_nsecs;
+} sim_link;
+
+static const sim_link sim_links[] = {
+  { "none", 0,       0,       0     },
+  { "lpt",  150000,  150000,  30000 },
+  { "usb",  1000000, 100000,  2000  },
+  { "net",  250000,  5000,    100   },
+  { NULL,   0,       0,       0     }
+};
+
+static const sim_region sim_cf5282_regions[] = {
+  { SIM_RAM,          0x00000000, 0x01000000 },
+  { SIM_RAM,          0x20000000, 0x00010000 },
+  { SIM_CFM_REGS,     0x40000000 + SIM_IPS_CFM, 0x30 },
+  { SIM_RAM,          0x40000000, 0x00200000 },
+  { SIM_CFM_BACKDOOR, 0x40000000 + SIM_IPS_BACKDOOR, 0x00080000 },
+  { SIM_CFM,          0xf0000000, 0x00080000 },
+  { SIM_FLASH29,      0xffe00000, 0x00200000 },
+  { SIM_RAM,          0,          0 }
+};
+
+static const sim_region sim_cpu32_regions[] = {
+  { SIM_FLASH29,      0x00000000, 0x00080000 },
+  { SIM_RAM,          0x00100000, 0x00100000 },
+  { SIM_RAM,          0x00fff000, 0x00001000 },
+  { SIM_RAM,          0,          0 }
+};
+
+static const sim_target sim_targets[] = {
+  { "cf5282", BDM_COLDFIRE, BDM_COLDFIRE_PE, sim_cf5282_regions,
+    0xf0000061, 0x01, 0x2245, 1 },
+  { "cpu32",  BDM_CPU32,    BDM_CPU32_PD,    sim_cpu32_regions,
+    0,          0x01, 0x22ab, 0 },
+  { NULL,     0,            0,               NULL,
+    0,          0,    0,      0 }
+};
+
+/*
+ * The 29 series command state machine.
+ */
+typedef enum
+{
+  SIM_F29_READ,
+  SIM_F29_UNLOCK1,
+  SIM_F29_UNLOCK2,
+  SIM_F29_AUTOSELECT,
+  SIM_F29_PROGRAM,
+  SIM_F29_ERASE,
+  SIM_F29_ERASE_UNLOCK1,
+  SIM_F29_ERASE_UNLOCK2,
+  SIM_F29_BYPASS,
+  SIM_F29_BYPASS_PROGRAM,
+  SIM_F29_BYPASS_RESET
+} sim_f29_state;
+
+typedef struct
+{
+  sim_f29_state state;
+  int           bypass;
+  uint64_t      busy_until;
+  unsigned int  busy_data;
+  unsigned int  toggle;
+} sim_flash29;
+
+/*
+ * The CFM runs one command while holding the next in its buffer.
+ */
+typedef struct
+{
+  int           cmd;
+  unsigned long offset;
+  unsigned long data;
+} sim_cfm_cmd;
+
+typedef struct
+{
+  unsigned char clkd;
+  unsigned char ustat;
+  unsigned char cmd;
+  int           latched;
+  unsigned long offset;
+  unsigned long data;
+  int           active;
+  int           queued;
+  sim_cfm_cmd   running;
+  sim_cfm_cmd   buffer;
+  uint64_t      done;
+} sim_cfm;
+
+typedef struct
+{
+  int              used;
+  const sim_target *target;
+  sim_link         link;
+  uint64_t         f29_erase_nsecs;
+  uint64_t         cfm_erase_nsecs;
+  uint64_t         run_nsecs;
+  uint64_t         clock;
+  struct timeval   start;
+  unsigned char    *mem[SIM_MAX_REGIONS];
+  unsigned char    *f29_array;
+  unsigned long    f29_size;
+  unsigned char    *cfm_array;
+  unsigned long    cfm_size;
+  sim_flash29      f29;
+  sim_cfm          cfm;
+  unsigned long    regs[16];
+  unsigned long    sysregs[BDM_MAX_SYSREG];
+  unsigned int     ctlreg_count;
+  unsigned int     ctlreg_num[SIM_MAX_CTLREGS];
+  unsigned long    ctlreg_val[SIM_MAX_CTLREGS];
+  unsigned long    dbregs[SIM_MAX_DBREGS];
+  int              running;
+  int              released;
+  uint64_t         halt_at;
+  int              stop_status;
+  unsigned long    next;
+  int              debug;
+  int              cf_pst;
+} sim_device;
+
+static sim_device sim_devices[SIM_MAX_DEVICES];
+
+static sim_device *
+sim_get (int fd)
+{
+  if ((fd < 0) || (fd >= SIM_MAX_DEVICES) || !sim_devices[fd].used) {
+    errno = EBADF;
+    return NULL;
+  }
+  return &sim_devices[fd];
+}
+
+/*
+ * The host's time since the device was opened.
+ */
+static uint64_t
+sim_host_nsecs (sim_device *sim)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return ((uint64_t) (now.tv_sec - sim->start.tv_sec) * 1000000000ULL) +
+    ((int64_t) (now.tv_usec - sim->start.tv_usec) * 1000LL);
+}
+
+/*
+ * Move the clock on by the cost of a request. The clock never falls
+ * behind the host so idle time counts, and the request sleeps when the
+ * clock is ahead.
+ */
+static void
+sim_charge (sim_device *sim, uint64_t nsecs)
+{
+  uint64_t host = sim_host_nsecs (sim);
+
+  if (sim->clock < host)
+    sim->clock = host;
+  sim->clock += nsecs;
+
+  if (sim->clock > (host + SIM_SLACK_NSECS)) {
+    uint64_t usecs = (sim->clock - host) / 1000;
+#if defined (__WIN32__)
+    Sleep (usecs / 1000);
+#else
+    struct timeval tv;
+    tv.tv_sec = usecs / 1000000;
+    tv.tv_usec = usecs % 1000000;
+    select (0, NULL, NULL, NULL, &tv);
+#endif
+  }
+}
+
+/*
+ * Halt a running target once its run time is up. It is an emulated
+ * HALT instruction.
+ */
+static void
+sim_run_update (sim_device *sim)
+{
+  if (sim->running && sim->halt_at && (sim->clock >= sim->halt_at)) {
+    sim->running = 0;
+    sim->sysregs[BDM_REG_CSR] |= SIM_CSR_HALT;
+    sim->stop_status = BDM_TARGETSTOPPED;
+    if (sim->target->cpu != BDM_CPU32)
+      sim->stop_status |= BDM_TARGETHALT;
+  }
+}
+
+static int
+sim_status (sim_device *sim)
+{
+  sim_run_update (sim);
+  if (sim->running || sim->released)
+    return 0;
+  return sim->stop_status;
+}
+
+/*
+ * Find the region holding size bytes at adr.
+ */
+static int
+sim_region_find (sim_device *sim, unsigned long adr, int size)
+{
+  const sim_region *region;
+  int              r;
+
+  for (r = 0, region = sim->target->regions; region->size; r++, region++)
+    if ((adr >= region->base) &&
+        ((adr + size - 1) <= (region->base + region->size - 1)))
+      return r;
+  return -1;
+}
+
+static unsigned long
+sim_get_be (unsigned char *p, int size)
+{
+  unsigned long value = 0;
+
+  while (size--)
+    value = (value << 8) | *p++;
+  return value;
+}
+
+static void
+sim_put_be (unsigned char *p, int size, unsigned long value)
+{
+  while (size--) {
+    p[size] = value;
+    value >>= 8;
+  }
+}
+
+/*
+ * The 29 series chip. The status read while it is busy toggles DQ6 and
+ * DQ2 and has the inverse of the data's DQ7.
+ */
+static int
+sim_f29_busy (sim_device *sim)
+{
+  sim_flash29 *f29 = &sim->f29;
+
+  if (f29->busy_until && (sim->clock >= f29->busy_until))
+    f29->busy_until = 0;
+  return f29->busy_until != 0;
+}
+
+static unsigned int
+sim_f29_read (sim_device *sim, unsigned long offset)
+{
+  sim_flash29 *f29 = &sim->f29;
+
+  if (sim_f29_busy (sim)) {
+    f29->toggle ^= 0x44;
+    return (~f29->busy_data & 0x80) | f29->toggle;
+  }
+
+  if (f29->state == SIM_F29_AUTOSELECT) {
+    switch ((offset >> 1) & 0xff) {
+      case 0:
+        return sim->target->f29_manufacturer;
+      case 1:
+        return sim->target->f29_device;
+      default:
+        return 0;
+    }
+  }
+
+  return sim_get_be (sim->f29_array + offset, 2);
+}
+
+static void
+sim_f29_program (sim_device *sim, unsigned long offset, unsigned int data)
+{
+  unsigned int old = sim_get_be (sim->f29_array + offset, 2);
+
+  sim_put_be (sim->f29_array + offset, 2, old & data);
+  sim->f29.busy_until = sim->clock + SIM_F29_PROGRAM_NSECS;
+  sim->f29.busy_data = data;
+}
+
+static void
+sim_f29_erase (sim_device *sim, unsigned long offset, unsigned long size,
+               uint64_t nsecs)
+{
+  memset (sim->f29_array + offset, 0xff, size);
+  sim->f29.busy_until = sim->clock + nsecs;
+  sim->f29.busy_data = 0xff;
+}
+
+static void
+sim_f29_write (sim_device *sim, unsigned long offset, unsigned int data)
+{
+  sim_flash29   *f29 = &sim->f29;
+  unsigned long reg = (offset >> 1) & 0x7ff;
+  unsigned int  cmd = data & 0xff;
+
+  if (sim_f29_busy (sim))
+    return;
+
+  switch (f29->state) {
+    case SIM_F29_READ:
+    case SIM_F29_AUTOSELECT:
+      if (cmd == 0xf0)
+        f29->state = SIM_F29_READ;
+      else if ((reg == 0x555) && (cmd == 0xaa))
+        f29->state = SIM_F29_UNLOCK1;
+      break;
+
+    case SIM_F29_UNLOCK1:
+      if ((reg == 0x2aa) && (cmd == 0x55))
+        f29->state = SIM_F29_UNLOCK2;
+      else
+        f29->state = SIM_F29_READ;
+      break;
+
+    case SIM_F29_UNLOCK2:
+      f29->state = SIM_F29_READ;
+      if (reg != 0x555)
+        break;
+      if (cmd == 0x90)
+        f29->state = SIM_F29_AUTOSELECT;
+      else if (cmd == 0xa0)
+        f29->state = SIM_F29_PROGRAM;
+      else if (cmd == 0x80)
+        f29->state = SIM_F29_ERASE;
+      else if ((cmd == 0x20) && sim->target->f29_bypass)
+        f29->state = SIM_F29_BYPASS;
+      break;
+
+    case SIM_F29_PROGRAM:
+      sim_f29_program (sim, offset, data);
+      f29->state = SIM_F29_READ;
+      break;
+
+    case SIM_F29_ERASE:
+      if ((reg == 0x555) && (cmd == 0xaa))
+        f29->state = SIM_F29_ERASE_UNLOCK1;
+      else
+        f29->state = SIM_F29_READ;
+      break;
+
+    case SIM_F29_ERASE_UNLOCK1:
+      if ((reg == 0x2aa) && (cmd == 0x55))
+        f29->state = SIM_F29_ERASE_UNLOCK2;
+      else
+        f29->state = SIM_F29_READ;
+      break;
+
+    case SIM_F29_ERASE_UNLOCK2:
+      if ((reg == 0x555) && (cmd == 0x10))
+        sim_f29_erase (sim, 0, sim->f29_size,
+                       sim->f29_erase_nsecs * SIM_MASS_ERASE_FACTOR);
+      else if (cmd == 0x30)
+        sim_f29_erase (sim, offset & ~(SIM_F29_SECTOR_SIZE - 1),
+                       SIM_F29_SECTOR_SIZE, sim->f29_erase_nsecs);
+      f29->state = SIM_F29_READ;
+      break;
+
+    case SIM_F29_BYPASS:
+      if (cmd == 0xa0)
+        f29->state = SIM_F29_BYPASS_PROGRAM;
+      else if (cmd == 0x90)
+        f29->state = SIM_F29_BYPASS_RESET;
+      break;
+
+    case SIM_F29_BYPASS_PROGRAM:
+      sim_f29_program (sim, offset, data);
+      f29->state = SIM_F29_BYPASS;
+      break;
+
+    case SIM_F29_BYPASS_RESET:
+      f29->state = cmd == 0x00 ? SIM_F29_READ : SIM_F29_BYPASS;
+      break;
+  }
+}
+
+/*
+ * The CFM. Commands take effect when they complete.
+ */
+static uint64_t
+sim_cfm_duration (sim_device *sim, sim_cfm_cmd *cmd)
+{
+  switch (cmd->cmd) {
+    case 0x20:
+      return SIM_CFM_PROGRAM_NSECS;
+    case 0x40:
+      return sim->cfm_erase_nsecs;
+    case 0x41:
+      return sim->cfm_erase_nsecs * SIM_MASS_ERASE_FACTOR;
+    default:
+      return SIM_CFM_VERIFY_NSECS;
+  }
+}
+
+static int
+sim_cfm_blank (sim_device *sim, unsigned long offset, unsigned long size)
+{
+  while (size--)
+    if (sim->cfm_array[offset++] != 0xff)
+      return 0;
+  return 1;
+}
+
+static void
+sim_cfm_complete (sim_device *sim, sim_cfm_cmd *cmd)
+{
+  sim_cfm       *cfm = &sim->cfm;
+  unsigned long page = cmd->offset & ~(SIM_CFM_PAGE_SIZE - 1);
+  unsigned long old;
+
+  switch (cmd->cmd) {
+    case 0x20:
+      old = sim_get_be (sim->cfm_array + cmd->offset, 4);
+      sim_put_be (sim->cfm_array + cmd->offset, 4, old & cmd->data);
+      break;
+    case 0x40:
+      memset (sim->cfm_array + page, 0xff, SIM_CFM_PAGE_SIZE);
+      break;
+    case 0x41:
+      memset (sim->cfm_array, 0xff, sim->cfm_size);
+      break;
+    case 0x05:
+      if (sim_cfm_blank (sim, 0, sim->cfm_size))
+        cfm->ustat |= SIM_CFM_BLANK;
+      break;
+    case 0x06:
+      if (sim_cfm_blank (sim, page, SIM_CFM_PAGE_SIZE))
+        cfm->ustat |= SIM_CFM_BLANK;
+      break;
+  }
+}
+
+static void
+sim_cfm_update (sim_device *sim)
+{
+  sim_cfm *cfm = &sim->cfm;
+
+  while (cfm->active && (sim->clock >= cfm->done)) {
+    sim_cfm_complete (sim, &cfm->running);
+    if (cfm->queued) {
+      cfm->running = cfm->buffer;
+      cfm->queued = 0;
+      cfm->done += sim_cfm_duration (sim, &cfm->running);
+      cfm->ustat |= SIM_CFM_CBEIF;
+    }
+    else {
+      cfm->active = 0;
+      cfm->ustat |= SIM_CFM_CCIF;
+    }
+  }
+}
+
+static void
+sim_cfm_launch (sim_device *sim)
+{
+  sim_cfm     *cfm = &sim->cfm;
+  sim_cfm_cmd cmd;
+
+  if (cfm->ustat & (SIM_CFM_ACCERR | SIM_CFM_PVIOL))
+    return;
+
+  if (!cfm->latched || !(cfm->clkd & SIM_CFM_DIVLD)) {
+    cfm->ustat |= SIM_CFM_ACCERR;
+    return;
+  }
+
+  switch (cfm->cmd) {
+    case 0x05:
+    case 0x06:
+    case 0x20:
+    case 0x40:
+    case 0x41:
+      break;
+    default:
+      cfm->ustat |= SIM_CFM_ACCERR;
+      return;
+  }
+
+  cmd.cmd = cfm->cmd;
+  cmd.offset = cfm->offset;
+  cmd.data = cfm->data;
+  cfm->latched = 0;
+
+  if (!cfm->active) {
+    cfm->running = cmd;
+    cfm->active = 1;
+    cfm->done = sim->clock + sim_cfm_duration (sim, &cmd);
+    cfm->ustat &= ~SIM_CFM_CCIF;
+  }
+  else {
+    cfm->buffer = cmd;
+    cfm->queued = 1;
+    cfm->ustat &= ~SIM_CFM_CBEIF;
+  }
+}
+
+static void
+sim_cfm_reg_write (sim_device *sim, unsigned long offset, unsigned long value)
+{
+  sim_cfm *cfm = &sim->cfm;
+
+  switch (offset) {
+    case SIM_CFM_CLKD:
+      cfm->clkd = value | SIM_CFM_DIVLD;
+      break;
+    case SIM_CFM_USTAT:
+      cfm->ustat &= ~(value & (SIM_CFM_ACCERR | SIM_CFM_PVIOL |
+                               SIM_CFM_BLANK));
+      if ((value & SIM_CFM_CBEIF) && (cfm->ustat & SIM_CFM_CBEIF))
+        sim_cfm_launch (sim);
+      break;
+    case SIM_CFM_CMD:
+      cfm->cmd = value;
+      if (!cfm->latched)
+        cfm->ustat |= SIM_CFM_ACCERR;
+      break;
+  }
+}
+
+static unsigned long
+sim_cfm_reg_read (sim_device *sim, unsigned long offset)
+{
+  switch (offset) {
+    case SIM_CFM_CLKD:
+      return sim->cfm.clkd;
+    case SIM_CFM_USTAT:
+      return sim->cfm.ustat;
+    case SIM_CFM_CMD:
+      return sim->cfm.cmd;
+  }
+  return 0;
+}
+
+static void
+sim_cfm_backdoor_write (sim_device *sim, unsigned long offset, int size,
+                        unsigned long value)
+{
+  sim_cfm *cfm = &sim->cfm;
+
+  if (!(cfm->ustat & SIM_CFM_CBEIF))
+    return;
+  if (size != 4) {
+    cfm->ustat |= SIM_CFM_ACCERR;
+    return;
+  }
+  cfm->latched = 1;
+  cfm->offset = offset;
+  cfm->data = value;
+}
+
+/*
+ * A memory access. A 16 bit flash port splits longwords into two bus
+ * cycles.
+ */
+static int
+sim_read (sim_device *sim, unsigned long adr, int size, unsigned long *value)
+{
+  const sim_region *region;
+  unsigned long    offset;
+  int              r = sim_region_find (sim, adr, size);
+
+  if (r < 0)
+    return BDM_FAULT_BERR;
+
+  region = &sim->target->regions[r];
+  offset = adr - region->base;
+
+  switch (region->type) {
+    case SIM_RAM:
+      *value = sim_get_be (sim->mem[r] + offset, size);
+      break;
+    case SIM_FLASH29:
+      if (size == 4)
+        *value = (sim_f29_read (sim, offset) << 16) |
+          sim_f29_read (sim, offset + 2);
+      else if (size == 2)
+        *value = sim_f29_read (sim, offset);
+      else
+        *value = (sim_f29_read (sim, offset & ~1) >> ((~offset & 1) * 8)) &
+          0xff;
+      break;
+    case SIM_CFM:
+    case SIM_CFM_BACKDOOR:
+      sim_cfm_update (sim);
+      *value = sim_get_be (sim->cfm_array + offset, size);
+      break;
+    case SIM_CFM_REGS:
+      sim_cfm_update (sim);
+      *value = sim_cfm_reg_read (sim, offset);
+      break;
+  }
+  return 0;
+}
+
+static int
+sim_write (sim_device *sim, unsigned long adr, int size, unsigned long value)
+{
+  const sim_region *region;
+  unsigned long    offset;
+  int              r = sim_region_find (sim, adr, size);
+
+  if (r < 0)
+    return BDM_FAULT_BERR;
+
+  region = &sim->target->regions[r];
+  offset = adr - region->base;
+
+  switch (region->type) {
+    case SIM_RAM:
+      sim_put_be (sim->mem[r] + offset, size, value);
+      break;
+    case SIM_FLASH29:
+      if (size == 4) {
+        sim_f29_write (sim, offset, (value >> 16) & 0xffff);
+        sim_f29_write (sim, offset + 2, value & 0xffff);
+      }
+      else
+        sim_f29_write (sim, offset & ~1, value & 0xffff);
+      break;
+    case SIM_CFM:
+      sim_cfm_update (sim);
+      sim->cfm.ustat |= SIM_CFM_ACCERR;
+      break;
+    case SIM_CFM_BACKDOOR:
+      sim_cfm_update (sim);
+      sim_cfm_backdoor_write (sim, offset, size, value);
+      break;
+    case SIM_CFM_REGS:
+      sim_cfm_update (sim);
+      sim_cfm_reg_write (sim, offset, value);
+      break;
+  }
+  return 0;
+}
+
+/*
+ * Reset the processor. The stack pointer and PC are loaded from the
+ * vectors at 0.
+ */
+static void
+sim_reset (sim_device *sim)
+{
+  unsigned long value;
+
+  memset (sim->regs, 0, sizeof (sim->regs));
+  memset (sim->sysregs, 0, sizeof (sim->sysregs));
+  sim->sysregs[BDM_REG_SR] = 0x2700;
+  if (sim_read (sim, 0, 4, &value) == 0)
+    sim->regs[BDM_REG_A7] = sim->sysregs[BDM_REG_SSP] = value;
+  if (sim_read (sim, 4, 4, &value) == 0)
+    sim->sysregs[BDM_REG_RPC] = value;
+  sim->running = 0;
+  sim->released = 0;
+  sim->stop_status = BDM_TARGETSTOPPED;
+  if (sim->target->cpu != BDM_CPU32)
+    sim->sysregs[BDM_REG_CSR] = SIM_CSR_BKPT | SIM_CSR_REVISION;
+  sim->f29.state = SIM_F29_READ;
+  sim->f29.bypass = 0;
+}
+
+static void
+sim_go (sim_device *sim)
+{
+  sim->running = 1;
+  sim->halt_at = sim->run_nsecs ? sim->clock + sim->run_nsecs : 0;
+}
+
+static unsigned long *
+sim_ctlreg (sim_device *sim, unsigned int num)
+{
+  unsigned int r;
+
+  for (r = 0; r < sim->ctlreg_count; r++)
+    if (sim->ctlreg_num[r] == num)
+      return &sim->ctlreg_val[r];
+  if (sim->ctlreg_count == SIM_MAX_CTLREGS)
+    return NULL;
+  sim->ctlreg_num[r] = num;
+  sim->ctlreg_val[r] = 0;
+  sim->ctlreg_count++;
+  return &sim->ctlreg_val[r];
+}
+
+/*
+ * Run a BDMioctl request. Returns 0 or an error number.
+ */
+static int
+sim_io (sim_device *sim, int code, struct BDMioctl *ioc)
+{
+  unsigned long *reg;
+  int           size = 0;
+  int           csr = 0;
+  int           cf = sim->target->cpu != BDM_CPU32;
+
+  sim_run_update (sim);
+
+  if (sim->released)
+    return BDM_FAULT_RESPONSE;
+
+  switch (code) {
+    case BDM_READ_LONGWORD:
+    case BDM_WRITE_LONGWORD:
+      size = 4;
+      break;
+    case BDM_READ_WORD:
+    case BDM_WRITE_WORD:
+      size = 2;
+      break;
+    case BDM_READ_BYTE:
+    case BDM_WRITE_BYTE:
+      size = 1;
+      break;
+    case BDM_READ_SYSREG:
+      csr = ioc->address == BDM_REG_CSR;
+      break;
+  }
+
+  /*
+   * A Coldfire can access memory and the CSR while it runs.
+   */
+  if (sim->running && (!cf || !(size || csr)))
+    return BDM_FAULT_NVC;
+
+  switch (code) {
+    case BDM_READ_REG:
+      ioc->value = sim->regs[ioc->address & 0xf];
+      break;
+    case BDM_WRITE_REG:
+      sim->regs[ioc->address & 0xf] = ioc->value;
+      break;
+
+    case BDM_READ_SYSREG:
+      if (ioc->address >= BDM_MAX_SYSREG)
+        return EINVAL;
+      ioc->value = sim->sysregs[ioc->address];
+      if (ioc->address == BDM_REG_CSR)
+        sim->sysregs[BDM_REG_CSR] &= ~SIM_CSR_STATUS;
+      break;
+    case BDM_WRITE_SYSREG:
+      if (ioc->address >= BDM_MAX_SYSREG)
+        return EINVAL;
+      sim->sysregs[ioc->address] = ioc->value;
+      break;
+
+    case BDM_READ_CTLREG:
+      if (!cf)
+        return BDM_FAULT_NVC;
+      if (!(reg = sim_ctlreg (sim, ioc->address)))
+        return EINVAL;
+      ioc->value = *reg;
+      break;
+    case BDM_WRITE_CTLREG:
+      if (!cf)
+        return BDM_FAULT_NVC;
+      if (!(reg = sim_ctlreg (sim, ioc->address)))
+        return EINVAL;
+      *reg = ioc->value;
+      break;
+
+    case BDM_READ_DBREG:
+      ioc->value = sim->dbregs[ioc->address % SIM_MAX_DBREGS];
+      break;
+    case BDM_WRITE_DBREG:
+      sim->dbregs[ioc->address % SIM_MAX_DBREGS] = ioc->value;
+      break;
+
+    case BDM_READ_LONGWORD:
+    case BDM_READ_WORD:
+    case BDM_READ_BYTE:
+      sim->next = ioc->address + size;
+      return sim_read (sim, ioc->address, size, &ioc->value);
+
+    case BDM_WRITE_LONGWORD:
+    case BDM_WRITE_WORD:
+    case BDM_WRITE_BYTE:
+      sim->next = ioc->address + size;
+      return sim_write (sim, ioc->address, size, ioc->value);
+
+    default:
+      return EINVAL;
+  }
+  return 0;
+}
+
+static int
+sim_error (int error)
+{
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+static int
+bdmSimClose (int fd)
+{
+  sim_device *sim = sim_get (fd);
+  int        r;
+
+  if (!sim)
+    return -1;
+
+  for (r = 0; r < SIM_MAX_REGIONS; r++)
+    free (sim->mem[r]);
+  free (sim->f29_array);
+  free (sim->cfm_array);
+  memset (sim, 0, sizeof (*sim));
+  return 0;
+}
+
+static int
+bdmSimIoctlInt (int fd, int code, int *var)
+{
+  sim_device *sim = sim_get (fd);
+
+  if (!sim)
+    return -1;
+
+  sim_charge (sim, sim->link.op_nsecs);
+
+  switch (code) {
+    case BDM_GET_STATUS:
+      *var = sim_status (sim);
+      break;
+    case BDM_GET_DRV_VER:
+      *var = BDM_DRV_VERSION;
+      break;
+    case BDM_GET_CPU_TYPE:
+      *var = sim->target->cpu;
+      break;
+    case BDM_GET_IF_TYPE:
+      *var = sim->target->iface;
+      break;
+    case BDM_GET_CF_PST:
+      *var = sim->cf_pst;
+      break;
+    case BDM_SET_CF_PST:
+      sim->cf_pst = *var;
+      break;
+    case BDM_DEBUG:
+      sim->debug = *var;
+      break;
+    case BDM_SPEED:
+      break;
+    default:
+      return sim_error (EINVAL);
+  }
+  return 0;
+}
+
+static int
+bdmSimIoctlCommand (int fd, int code)
+{
+  sim_device *sim = sim_get (fd);
+
+  if (!sim)
+    return -1;
+
+  sim_charge (sim, sim->link.op_nsecs);
+  sim_run_update (sim);
+
+  switch (code) {
+    case BDM_INIT:
+      break;
+    case BDM_RESET_CHIP:
+      sim_reset (sim);
+      break;
+    case BDM_RESTART_CHIP:
+      sim_reset (sim);
+      sim_go (sim);
+      break;
+    case BDM_RELEASE_CHIP:
+      sim_reset (sim);
+      sim->released = 1;
+      break;
+    case BDM_STOP_CHIP:
+      if (sim->running) {
+        sim->running = 0;
+        sim->sysregs[BDM_REG_CSR] |= SIM_CSR_BKPT;
+        sim->stop_status = BDM_TARGETSTOPPED;
+      }
+      break;
+    case BDM_GO:
+      if (sim->released)
+        return sim_error (BDM_FAULT_RESPONSE);
+      sim_go (sim);
+      break;
+    case BDM_STEP_CHIP:
+      if (sim->running || sim->released)
+        return sim_error (BDM_FAULT_NVC);
+      sim->sysregs[BDM_REG_RPC] += 2;
+      break;
+    default:
+      return sim_error (EINVAL);
+  }
+  return 0;
+}
+
+static int
+bdmSimIoctlIo (int fd, int code, struct BDMioctl *ioc)
+{
+  sim_device *sim = sim_get (fd);
+
+  if (!sim)
+    return -1;
+
+  sim_charge (sim, sim->link.op_nsecs);
+  return sim_error (sim_io (sim, code, ioc));
+}
+
+static int
+bdmSimExecBatch (int fd, struct BDMbatchOp *ops, int count)
+{
+  sim_device *sim = sim_get (fd);
+  int        op;
+
+  if (!sim)
+    return -1;
+
+  sim_charge (sim, sim->link.op_nsecs);
+
+  for (op = 0; op < count; op++) {
+    sim_charge (sim, sim->link.batch_nsecs);
+    ops[op].error = sim_io (sim, ops[op].code, &ops[op].ioc);
+    if (ops[op].error)
+      return sim_error (ops[op].error);
+  }
+  return 0;
+}
+
+/*
+ * Block transfers carry on from the last memory access, as the
+ * driver's do.
+ */
+static int
+bdmSimRead (int fd, unsigned char *cbuf, int nbytes)
+{
+  sim_device    *sim = sim_get (fd);
+  unsigned long value;
+  int           left = nbytes;
+  int           size;
+  int           err;
+
+  if (!sim)
+    return -1;
+
+  sim_charge (sim, sim->link.op_nsecs +
+              ((uint64_t) nbytes * sim->link.byte_nsecs));
+
+  while (left) {
+    size = left >= 4 ? 4 : left >= 2 ? 2 : 1;
+    if ((err = sim_read (sim, sim->next, size, &value)) != 0)
+      return sim_error (err);
+    sim_put_be (cbuf, size, value);
+    sim->next += size;
+    cbuf += size;
+    left -= size;
+  }
+  return nbytes;
+}
+
+static int
+bdmSimWrite (int fd, unsigned char *cbuf, int nbytes)
+{
+  sim_device *sim = sim_get (fd);
+  int        left = nbytes;
+  int        size;
+  int        err;
+
+  if (!sim)
+    return -1;
+
+  sim_charge (sim, sim->link.op_nsecs +
+              ((uint64_t) nbytes * sim->link.byte_nsecs));
+
+  while (left) {
+    size = left >= 4 ? 4 : left >= 2 ? 2 : 1;
+    if ((err = sim_write (sim, sim->next, size,
+                          sim_get_be (cbuf, size))) != 0)
+      return sim_error (err);
+    sim->next += size;
+    cbuf += size;
+    left -= size;
+  }
+  return nbytes;
+}
+
+static bdm_iface simIface = {
+  .open = bdmSimOpen,
+  .close = bdmSimClose,
+  .read = bdmSimRead,
+  .write = bdmSimWrite,
+  .ioctl_int = bdmSimIoctlInt,
+  .ioctl_io = bdmSimIoctlIo,
+  .ioctl_cmd = bdmSimIoctlCommand,
+  .error_str = NULL,
+  .exec_batch = bdmSimExecBatch
+};
+
+/*
+ * Is the name a simulated device ?
+ */
+int
+bdmSimName (const char *name)
+{
+  return strncmp (name, BDM_SIM_PREFIX, strlen (BDM_SIM_PREFIX)) == 0;
+}
+
+/*
+ * Apply an option. Returns 0 if the option is not valid.
+ */
+static int
+sim_option (sim_device *sim, const char *option, size_t len)
+{
+  const sim_link *link;
+  const char     *value = memchr (option, '=', len);
+  size_t         name_len;
+  unsigned long  number;
+  char           *end;
+
+  if (!value)
+    return 0;
+
+  name_len = value - option;
+  value++;
+
+  if ((name_len == 4) && (strncmp (option, "link", 4) == 0)) {
+    for (link = sim_links; link->name; link++)
+      if ((strlen (link->name) == (len - 5)) &&
+          (strncmp (link->name, value, len - 5) == 0)) {
+        sim->link = *link;
+        return 1;
+      }
+    return 0;
+  }
+
+  number = strtoul (value, &end, 0);
+  if (end != (option + len))
+    return 0;
+
+  if ((name_len == 2) && (strncmp (option, "op", 2) == 0))
+    sim->link.op_nsecs = number * 1000;
+  else if ((name_len == 5) && (strncmp (option, "batch", 5) == 0))
+    sim->link.batch_nsecs = number * 1000;
+  else if ((name_len == 4) && (strncmp (option, "byte", 4) == 0))
+    sim->link.byte_nsecs = number;
+  else if ((name_len == 5) && (strncmp (option, "erase", 5) == 0))
+    sim->f29_erase_nsecs = sim->cfm_erase_nsecs = (uint64_t) number * 1000000;
+  else if ((name_len == 3) && (strncmp (option, "run", 3) == 0))
+    sim->run_nsecs = (uint64_t) number * 1000000;
+  else
+    return 0;
+  return 1;
+}
+
+/*
+ * Open a simulated device. Returns -1 with errno set to ENOENT if the
+ * name is not one, and EINVAL for an unknown target or option.
+ */
+int
+bdmSimOpen (const char *name, bdm_iface **iface)
+{
+  const sim_target *target;
+  const sim_region *region;
+  sim_device       *sim;
+  const char       *spec;
+  const char       *option;
+  size_t           len;
+  int              fd;
+  int              r;
+
+  *iface = NULL;
+
+  if (!bdmSimName (name)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  spec = name + strlen (BDM_SIM_PREFIX);
+  len = strcspn (spec, ",");
+
+  for (target = sim_targets; target->name; target++)
+    if ((strlen (target->name) == len) &&
+        (strncmp (target->name, spec, len) == 0))
+      break;
+
+  if (!target->name) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (fd = 0; fd < SIM_MAX_DEVICES; fd++)
+    if (!sim_devices[fd].used)
+      break;
+
+  if (fd == SIM_MAX_DEVICES) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  sim = &sim_devices[fd];
+  memset (sim, 0, sizeof (*sim));
+  sim->used = 1;
+  sim->target = target;
+  sim->link = sim_links[0];
+  sim->f29_erase_nsecs = SIM_F29_SECTOR_NSECS;
+  sim->cfm_erase_nsecs = SIM_CFM_PAGE_NSECS;
+
+  for (option = spec + len; *option == ','; option += len) {
+    option++;
+    len = strcspn (option, ",");
+    if (!sim_option (sim, option, len)) {
+      bdmSimClose (fd);
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  for (r = 0, region = target->regions; region->size; r++, region++) {
+    unsigned char **mem;
+
+    switch (region->type) {
+      case SIM_RAM:
+        mem = &sim->mem[r];
+        break;
+      case SIM_FLASH29:
+        mem = &sim->f29_array;
+        sim->f29_size = region->size;
+        break;
+      case SIM_CFM:
+        mem = &sim->cfm_array;
+        sim->cfm_size = region->size;
+        break;
+      default:
+        continue;
+    }
+    if (!(*mem = malloc (region->size))) {
+      bdmSimClose (fd);
+      errno = ENOMEM;
+      return -1;
+    }
+    memset (*mem, region->type == SIM_RAM ? 0 : 0xff, region->size);
+  }
+
+  sim->cfm.ustat = SIM_CFM_CBEIF | SIM_CFM_CCIF;
+  if (target->flashbar)
+    *sim_ctlreg (sim, SIM_CF_FLASHBAR) = target->flashbar;
+
+  gettimeofday (&sim->start, NULL);
+  sim_reset (sim);
+
+  *iface = &simIface;
+  return fd;
+}
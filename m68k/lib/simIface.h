@@ -0,0 +1,41 @@
+/*
+ * Motorola Background Debug Mode Simulated Target
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _BDM_SIM_IFACE_H_
+#define _BDM_SIM_IFACE_H_
+
+#if __cplusplus
+extern "C"
+{
+#endif
+
+#include "bdm-iface.h"
+
+/*
+ * The prefix of a simulated device name, for example "sim:cf5282".
+ */
+#define BDM_SIM_PREFIX "sim:"
+
+int bdmSimName (const char *name);
+int bdmSimOpen (const char *name, bdm_iface **iface);
+
+#if __cplusplus
+}
+#endif
+
+#endif
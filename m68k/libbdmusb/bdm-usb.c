@@ -40,11 +40,45 @@ extern int debugLevel;
 int os_copy_in (void *dst, void *src, int size);
 int os_copy_out (void *dst, void *src, int size);
 
+/*
+ * USB pods share the driver's minors from the TBLCF interface on. Each
+ * open pod has its own minor, which is the file descriptor handed back
+ * to the BDM library.
+ */
+#define BDM_USB_FIRST_MINOR (BDM_COLDFIRE_TBLCF * BDM_MINORS_PER_IFACE)
+
+static int
+bdm_usb_alloc_minor (void)
+{
+  int minor;
+  for (minor = BDM_USB_FIRST_MINOR; minor < bdm_get_device_info_count (); minor++)
+    if (!bdm_get_device_info (minor)->exists)
+      return minor;
+  return -1;
+}
+
+static int
+bdm_usb_valid_minor (int fd)
+{
+  return (fd >= BDM_USB_FIRST_MINOR) && (fd < bdm_get_device_info_count ()) &&
+    bdm_get_device_info (fd)->exists;
+}
+
 static int
 bdm_usb_close (int fd)
 {
+  struct BDM *self;
+
+  if (!bdm_usb_valid_minor (fd))
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  self = bdm_get_device_info (fd);
   bdm_close (fd);
-  bdmusb_usb_close(fd);
+  bdmusb_usb_close (self->usbDev);
+  self->exists = 0;
   return 0;
 }
 
@@ -123,15 +157,25 @@ bdm_usb_ioctl_io (int fd, int code, struct BDMioctl *ioc)
   return bdm_usb_ioctl (fd, code, ioc);
 }
 
+static int
+bdm_usb_exec_batch (int fd, struct BDMbatchOp *ops, int count)
+{
+  struct BDMbatch batch;
+  batch.count = count;
+  batch.ops = ops;
+  return bdm_usb_ioctl (fd, BDM_EXEC_BATCH, &batch);
+}
+
 static bdm_iface usbIface = {
-  .open      = bdm_usb_open,
-  .close     = bdm_usb_close,
-  .read      = bdm_usb_read,
-  .write     = bdm_usb_write,
-  .ioctl_int = bdm_usb_ioctl_int,
-  .ioctl_io  = bdm_usb_ioctl_io,
-  .ioctl_cmd = bdm_usb_ioctl_command,
-  .error_str = NULL
+  .open       = bdm_usb_open,
+  .close      = bdm_usb_close,
+  .read       = bdm_usb_read,
+  .write      = bdm_usb_write,
+  .ioctl_int  = bdm_usb_ioctl_int,
+  .ioctl_io   = bdm_usb_ioctl_io,
+  .ioctl_cmd  = bdm_usb_ioctl_command,
+  .error_str  = NULL,
+  .exec_batch = bdm_usb_exec_batch
 };
 
 static usbdm_options_type_e config_options;
@@ -248,10 +292,18 @@ bdm_usb_open (const char *device, bdm_iface** iface)
         {
           if (strncmp (device, name, length) == 0)
           {
+            int minor = bdm_usb_alloc_minor ();
+
+            if (minor < 0)
+            {
+              errno = EMFILE;
+              return -1;
+            }
+
             /*
-             * Set up the self srructure. Only ever one with ioperm.
+             * Set up the self structure, one per open pod.
              */
-            self = bdm_get_device_info (0);
+            self = bdm_get_device_info (minor);
 
             /*
              * Open the USB device.
@@ -367,7 +419,9 @@ bdm_usb_open (const char *device, bdm_iface** iface)
 		if (bdmusb_set_target_type(udev->dev_ref, targetType) == 0)
 		    self->cf_running = 1;
 		else {
-		    //bdm_usb_close(udev->dev_ref);
+		    bdmusb_usb_close(udev->dev_ref);
+		    self->exists = 0;
+		    errno = EIO;
 		    return -1;
 		}
 		
@@ -377,11 +431,15 @@ bdm_usb_open (const char *device, bdm_iface** iface)
 	    
 	    // Now init the HW
 	    //self->init_hardware(self);
-	    errno = bdm_open (0);
+	    errno = bdm_open (minor);
             if (errno)
+            {
+              bdmusb_usb_close (self->usbDev);
+              self->exists = 0;
               return -1;
-            
-            return 0;
+            }
+
+            return minor;
           }
         }
 
@@ -29,6 +29,8 @@
 
 #include "libusb-1.0/libusb.h"
 
+#include "commands.h"
+
 /** Type of USB BDM pod */
 typedef enum {
 	P_NONE     = 0,     /** - No USB POD */
@@ -96,8 +98,12 @@ typedef struct {
    unsigned char icp_hw_ver; /**< Version of Hardware (reported by ICP code) */
 } usbmd_version_t;
 
+/* per device asynchronous transfer queue, see bdmusb_async.c */
+typedef struct bdm_usb_async_state_s bdm_usb_async_state;
+
 /*
- * Manage the USB devices we have connected.
+ * Manage the USB devices we have connected. Everything a command needs
+ * lives here so different devices can be driven from different threads.
  */
 typedef struct bdmusb_dev_s {
   int                             dev_ref;
@@ -113,6 +119,9 @@ typedef struct bdmusb_dev_s {
   target_hw_cap_type_e            hw_cap;
   target_type_e                   target;
   usbdm_options_type_e            options;
+  /* command buffer */
+  unsigned char                   usb_data[MAX_DATA_SIZE+2];
+  bdm_usb_async_state             *async;
 } bdmusb_dev;
 
 
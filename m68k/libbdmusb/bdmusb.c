@@ -26,6 +26,8 @@
 #include "bdmusb-hwdesc.h"
 #include "bdmusb.h"
 #include "bdmusb_low_level.h"
+#include "bdmusb_async.h"
+#include "bdmusb_trace.h"
 
 #include "commands.h"
 
@@ -35,8 +37,6 @@ unsigned int osbdm_dev_count;
 unsigned int usb_dev_count;
 bdmusb_dev    *usb_devs;
 
-unsigned char usb_data[MAX_DATA_SIZE+2];
-
 /*
  * The lits of devices.
  */
@@ -50,11 +50,14 @@ static int           usb_dev_count;
 */
 /* provides low level USB functions which talk to the hardware */
 
-/* initialisation */
+/* initialisation, once per process as the device list is shared by
+ * every open device */
 unsigned char bdmusb_init(void) {
-  libusb_init(NULL);          /* init LIBUSB */
-  libusb_set_debug(NULL, 0);    /* set debug level to minimum */
-  bdmusb_find_supported_devices();
+  if (!usb_devs) {
+    libusb_init(NULL);          /* init LIBUSB */
+    libusb_set_debug(NULL, 0);    /* set debug level to minimum */
+    bdmusb_find_supported_devices();
+  }
   return usb_dev_count;
 }
 
@@ -163,6 +166,7 @@ void bdmusb_find_supported_devices(void) {
 
 /* gets version of the interface (HW and SW) in BCD format */
 unsigned char bdmusb_get_version(bdmusb_dev* dev, usbmd_version_t* version) {
+    unsigned char *usb_data = dev->usb_data;
     static const usbmd_version_t defaultVersion = {0,0,0,0};
     unsigned char return_value;
     
@@ -231,6 +235,7 @@ void bdmusb_dev_name(int dev, char *name, int namelen) {
 
 /* returns status of the last command: 0 on sucess and non-zero on failure */
 unsigned char bdmusb_get_last_sts_value(int dev) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     
     usb_data[0]=1;	 /* get 1 byte */
@@ -262,6 +267,7 @@ unsigned char bdmusb_get_last_sts_value(int dev) {
 /* sets target MCU type */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_set_target_type(int dev, target_type_e target_type) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
 
     usb_data[0]=1;	 /* get 1 byte */
@@ -305,6 +311,7 @@ unsigned char bdmusb_set_target_type(int dev, target_type_e target_type) {
 /* resets the target to normal or BDM mode */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_target_reset(int dev, target_mode_e target_mode) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     usb_data[0]=1;	 /* get 1 byte */
     switch (usb_devs[dev].type) {
@@ -343,6 +350,7 @@ unsigned char bdmusb_target_reset(int dev, target_mode_e target_mode) {
 /* fills user supplied structure with current state of the BDM communication channel */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_bdm_sts(int dev, bdm_status_t *bdm_status) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     unsigned int temp_state;
     usb_data[0]=3;	 /* get 3 bytes */
@@ -454,6 +462,7 @@ unsigned char bdmusb_bdm_sts(int dev, bdm_status_t *bdm_status) {
 /* brings the target into BDM mode */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_target_halt(int dev) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     usb_data[0]=1;	 /* get 1 byte */
     switch (usb_devs[dev].type) {
@@ -485,6 +494,7 @@ unsigned char bdmusb_target_halt(int dev) {
 /* starts target execution from current PC address */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_target_go(int dev) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     usb_data[0]=1;	 /* get 1 byte */
     usb_data[1]=CMD_USBDM_TARGET_GO;
@@ -515,6 +525,7 @@ unsigned char bdmusb_target_go(int dev) {
 /* steps over a single target instruction */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_target_step(int dev) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     usb_data[0]=1;	 /* get 1 byte */
     switch (usb_devs[dev].type) {
@@ -547,6 +558,7 @@ unsigned char bdmusb_target_step(int dev) {
 /* reads control register at the specified address and writes its contents into the supplied buffer */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_read_creg(int dev, unsigned int address, unsigned long int* result) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     
     usb_data[0]=5;	 /* get 5 bytes */
@@ -606,6 +618,7 @@ unsigned char bdmusb_read_creg(int dev, unsigned int address, unsigned long int*
 
 /* writes control register at the specified address */
 void bdmusb_write_creg(int dev, unsigned int address, unsigned long int value) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     
     usb_data[0]=6;	 /* send 6 bytes */
@@ -658,6 +671,7 @@ void bdmusb_write_creg(int dev, unsigned int address, unsigned long int value) {
 /* reads the specified debug register and writes its contents into the supplied buffer */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_read_dreg(int dev, unsigned int dreg_index, unsigned long int * result) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     
     usb_data[0]=5;	 /* get 5 bytes */
@@ -698,6 +712,7 @@ unsigned char bdmusb_read_dreg(int dev, unsigned int dreg_index, unsigned long i
 
 /* writes specified debug register */
 void bdmusb_write_dreg(int dev, unsigned int dreg_index, unsigned long int value) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     
     usb_data[0]=6;	 /* send 6 bytes */
@@ -742,6 +757,7 @@ void bdmusb_write_dreg(int dev, unsigned int dreg_index, unsigned long int value
 /* reads the specified register and writes its contents into the supplied buffer */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_read_reg(int dev, unsigned int reg_index, unsigned long int * result) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
   
       usb_data[0]=5;	 /* get 5 bytes */
@@ -782,6 +798,7 @@ unsigned char bdmusb_read_reg(int dev, unsigned int reg_index, unsigned long int
 
 /* writes specified register */
 void bdmusb_write_reg(int dev, unsigned int reg_index, unsigned long int value) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
     
     usb_data[0]=6;	 /* send 6 bytes */
@@ -825,29 +842,29 @@ void bdmusb_write_reg(int dev, unsigned int reg_index, unsigned long int value)
 #define USBDM_MEMORY_HEADER_SIZE    8
 #define TBLCF_MEMORY_HEADER_SIZE    6
 
-void __assemble_message_header(target_type_e type, unsigned char command, 
+void __assemble_message_header(unsigned char *buf, target_type_e type, unsigned char command, 
 			       unsigned char element_size, 
 			       unsigned char byte_count, unsigned int address) {
   
-    usb_data[1]= command;
+    buf[1]= command;
     switch (type) {
 	case P_USBDM:
 	case P_OSBDM:
 	case P_USBDM_V2:
-	    usb_data[0]=0;
-	    usb_data[2]=element_size; //element_size
-	    usb_data[3]=byte_count; // count (number of bytes)
-	    usb_data[4]=(address>>24)&0xff;
-	    usb_data[5]=(address>>16)&0xff;
-	    usb_data[6]=(address>>8)&0xff;
-	    usb_data[7]=(address)&0xff;
+	    buf[0]=0;
+	    buf[2]=element_size; //element_size
+	    buf[3]=byte_count; // count (number of bytes)
+	    buf[4]=(address>>24)&0xff;
+	    buf[5]=(address>>16)&0xff;
+	    buf[6]=(address>>8)&0xff;
+	    buf[7]=(address)&0xff;
 	    break;
 	case P_TBLCF:
-	    usb_data[0]=byte_count+1;	 /* get 2 bytes */
-	    usb_data[2]=(address>>24)&0xff;
-	    usb_data[3]=(address>>16)&0xff;
-	    usb_data[4]=(address>>8)&0xff;
-	    usb_data[5]=(address)&0xff;
+	    buf[0]=byte_count+1;	 /* get 2 bytes */
+	    buf[2]=(address>>24)&0xff;
+	    buf[3]=(address>>16)&0xff;
+	    buf[4]=(address>>8)&0xff;
+	    buf[5]=(address)&0xff;
 	    break;
 	case P_NONE:
 	case P_TBDML:
@@ -856,25 +873,56 @@ void __assemble_message_header(target_type_e type, unsigned char command,
     };
 }
 
-const char *mem_size_str[] = {
-  "byte",
-  "word",
-  "long"
-};
+/* can a memory block move straight between libusb and the caller's buffer */
+/* bulk endpoint USBDM pods can in both directions, TBLCF only for reads */
+static int bdmusb_block_direct(int dev, int write) {
+    switch (usb_devs[dev].type) {
+	case P_USBDM:
+	case P_USBDM_V2:
+	    return !usb_devs[dev].use_only_ep0;
+	case P_TBLCF:
+	    return !write;
+	case P_OSBDM:
+	case P_NONE:
+	case P_TBDML:
+	default:
+	    return 0;
+    };
+}
+
+/* largest memory block the pod accepts in one transfer */
+/* USBDM, OSBDM and TBLCF pods hold a whole transfer, header or status
+ * byte included, in MAX_PACKET_SIZE bytes; the block only has to be a
+ * whole number of elements */
+static unsigned int bdmusb_max_block_size(unsigned int overhead,
+                                          unsigned char element_size) {
+    return (MAX_PACKET_SIZE-overhead)&~(element_size-1);
+}
+
+/* copies a block read through the asynchronous queue to its place */
+static void bdmusb_read_block_done(int status, unsigned char *reply,
+                                   unsigned int reply_size, void *user) {
+    if (status == BDM_RC_OK)
+      memcpy(user, reply+1, reply_size-1);
+}
 
 /* reads memory from the specified address */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_read_memory(int dev, unsigned char element_size, unsigned int  byte_count,
                                   unsigned int  address, unsigned char *data) {
-    int ret_val;
+    unsigned char *usb_data = usb_devs[dev].usb_data;
+    int ret_val = BDM_RC_OK;
+    int command = -1;
     int tblcf_cmd = -1;
-    int element_indx = 0;
     char unaligned;
+    int direct;
+    int async;
+    unsigned char status = 0;
     
     unsigned int original_byte_count = byte_count;
     unsigned char *original_data = data;
     
-    unsigned int max_data_size = (MAX_PACKET_SIZE-1)&~0x03;
+    unsigned int max_data_size;
     
     int block_size;
     
@@ -905,54 +953,94 @@ unsigned char bdmusb_read_memory(int dev, unsigned char element_size, unsigned i
       return BDM_RC_ILLEGAL_PARAMS;
     }
     
+    switch (usb_devs[dev].type) {
+	case P_USBDM_V2:
+	    command = CMD_USBDM_READ_MEM;
+	    break;
+	case P_TBLCF:
+	    command = tblcf_cmd;
+	    break;
+	case P_USBDM:
+	case P_OSBDM:
+	    command = CMD_CF_READ_MEM;
+	    break;
+	case P_NONE:
+	case P_TBDML:
+	default:
+	    break;
+    };
+    
+    /* the reply is a status byte followed by the block */
+    max_data_size = bdmusb_max_block_size(1, element_size);
+    direct = bdmusb_block_direct(dev, 0);
+    async = (byte_count > max_data_size) && bdm_usb_async_usable(dev);
+    
     while (byte_count > 0) {
+	unsigned char header[USBDM_MEMORY_HEADER_SIZE];
+	unsigned char *reply = usb_data;
+	unsigned char saved = 0;
+	
 	block_size = byte_count;
 	if (block_size > max_data_size)
 	    block_size = max_data_size;
 	
-	switch (usb_devs[dev].type) {
-	    case P_USBDM_V2:
-		__assemble_message_header(usb_devs[dev].type, CMD_USBDM_READ_MEM, element_size, block_size, address);
+	if (async) {
+	    /* several blocks in flight, each copied to its place as it arrives */
+	    __assemble_message_header(header, usb_devs[dev].type, command, element_size, block_size, address);
+	    ret_val = bdm_usb_async_submit(dev, header, USBDM_MEMORY_HEADER_SIZE, NULL, 0, block_size+1,
+	                                   bdmusb_read_block_done, data);
+	    if (ret_val != BDM_RC_OK)
 		break;
-	    case P_TBLCF:
-		if (tblcf_cmd > 0)
-		  __assemble_message_header(usb_devs[dev].type, tblcf_cmd, element_size, block_size, address);
-		break;
-	    case P_USBDM:
-	    case P_OSBDM:
-		__assemble_message_header(usb_devs[dev].type, CMD_CF_READ_MEM, element_size, block_size, address);
-		break;
-	    case P_NONE:
-	    case P_TBDML:
-	    default:
-		break;
-	};
+	    data += block_size;
+	    address += block_size;
+	    byte_count -= block_size;
+	    continue;
+	}
+	else if (direct) {
+	    /* the block is received in place; the status byte lands on the
+	     * last byte of the previous block which is put back after */
+	    if (data != original_data) {
+		reply = data-1;
+		saved = *reply;
+	    }
+	    __assemble_message_header(header, usb_devs[dev].type, command, element_size, block_size, address);
+	    ret_val = bdm_usb_block_transaction(dev, header, USBDM_MEMORY_HEADER_SIZE, NULL, 0, reply, block_size+1);
+	}
+	else {
+	    __assemble_message_header(usb_data, usb_devs[dev].type, command, element_size, block_size, address);
+	    //bdm_usb_send_ep0(&usb_devs[dev], usb_data);
+	    if ( (usb_devs[dev].type == P_USBDM) || (usb_devs[dev].type == P_USBDM_V2) )
+		ret_val = bdm_usb_transaction(dev, USBDM_MEMORY_HEADER_SIZE, block_size+1, usb_data);
+	    else
+		ret_val = bdm_usb_recv_ep0(&usb_devs[dev], usb_data);
+	}
 	
-	//bdm_usb_send_ep0(&usb_devs[dev], usb_data);
-	if ( (usb_devs[dev].type == P_USBDM) || (usb_devs[dev].type == P_USBDM_V2) )
-	    ret_val = bdm_usb_transaction(dev, USBDM_MEMORY_HEADER_SIZE, block_size+1, usb_data);
+	status = reply[0];
+	if (reply == usb_data)
+	    memcpy(data, usb_data+1, block_size);
 	else
-	    ret_val = bdm_usb_recv_ep0(&usb_devs[dev], usb_data);
+	    *reply = saved;
 	
 	if (usb_devs[dev].type == P_TBLCF)
-	  ret_val = (!(usb_data[0]==tblcf_cmd));
+	  ret_val = (!(status==tblcf_cmd));
 	
 	if (ret_val != BDM_RC_OK)
 	  return ret_val;
 	
-	memcpy(data, usb_data+1, block_size);
-	
 	data += block_size;
 	address += block_size;
 	byte_count -= block_size;
     }
-    element_indx = element_size-1;
-    if (element_indx >2)
-      element_indx = 2;
-    
-    bdm_print("BDMUSB_READ_MEMORY: Read %d %s from address 0x%08lX, (0x%02X)\r\n",
-              (original_byte_count/element_size), mem_size_str[element_indx], address,usb_data[0]);
-    bdm_print_dump(original_data, original_byte_count);
+    if (async) {
+	status = bdm_usb_async_flush(dev);
+	if (ret_val == BDM_RC_OK)
+	    ret_val = status;
+	if (ret_val != BDM_RC_OK)
+	    return ret_val;
+    }
+    bdmusb_trace(BDMUSB_TRACE_READ_MEMORY, BDMUSB_TRACE_FLAGS(&usb_devs[dev]), status,
+                 address, element_size, original_byte_count, original_byte_count,
+                 original_data);
     
     return ret_val;
 }
@@ -961,10 +1049,14 @@ unsigned char bdmusb_read_memory(int dev, unsigned char element_size, unsigned i
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_write_memory(int dev, unsigned char element_size, unsigned int  byte_count,
                                   unsigned int  address, unsigned char *data) {
-    int ret_val;
+    unsigned char *usb_data = usb_devs[dev].usb_data;
+    int ret_val = BDM_RC_OK;
+    int command = -1;
     int tblcf_cmd = -1;
-    int element_indx = 0;
     char unaligned;
+    int direct;
+    int async;
+    unsigned char status = 0;
     unsigned char header_size = USBDM_MEMORY_HEADER_SIZE;
     
     unsigned int original_byte_count = byte_count;
@@ -977,8 +1069,6 @@ unsigned char bdmusb_write_memory(int dev, unsigned char element_size, unsigned
     if (usb_devs[dev].type == P_TBLCF)
       header_size = TBLCF_MEMORY_HEADER_SIZE;
     
-    max_data_size = (MAX_PACKET_SIZE-header_size)&~0x03;
-    
     switch(element_size) {
       case 1:
 	unaligned = 0;
@@ -1006,39 +1096,59 @@ unsigned char bdmusb_write_memory(int dev, unsigned char element_size, unsigned
       return BDM_RC_ILLEGAL_PARAMS;
     }
     
+    switch (usb_devs[dev].type) {
+	case P_USBDM_V2:
+	    command = CMD_USBDM_WRITE_MEM;
+	    break;
+	case P_TBLCF:
+	    command = tblcf_cmd;
+	    break;
+	case P_USBDM:
+	case P_OSBDM:
+	    command = CMD_CF_WRITE_MEM;
+	    break;
+	case P_NONE:
+	case P_TBDML:
+	default:
+	    break;
+    };
+    
+    max_data_size = bdmusb_max_block_size(header_size, element_size);
+    direct = bdmusb_block_direct(dev, 1);
+    async = (byte_count > max_data_size) && bdm_usb_async_usable(dev);
+    
     while (byte_count > 0) {
 	block_size = byte_count;
 	if (block_size > max_data_size)
 	    block_size = max_data_size;
 	
-	switch (usb_devs[dev].type) {
-	    case P_USBDM_V2:
-		__assemble_message_header(usb_devs[dev].type, CMD_USBDM_WRITE_MEM, element_size, block_size, address);
-		break;
-	    case P_TBLCF:
-		if (tblcf_cmd > 0)
-		  __assemble_message_header(usb_devs[dev].type, tblcf_cmd, element_size, block_size, address);
-		break;
-	    case P_USBDM:
-	    case P_OSBDM:
-		__assemble_message_header(usb_devs[dev].type, CMD_CF_WRITE_MEM, element_size, block_size, address);
+	if (async) {
+	    /* several blocks in flight, each sent from the caller's buffer */
+	    unsigned char header[USBDM_MEMORY_HEADER_SIZE];
+	    __assemble_message_header(header, usb_devs[dev].type, command, element_size, block_size, address);
+	    ret_val = bdm_usb_async_submit(dev, header, header_size, data, block_size, 1, NULL, NULL);
+	    if (ret_val != BDM_RC_OK)
 		break;
-	    case P_NONE:
-	    case P_TBDML:
-	    default:
-		break;
-	};
-	
-	memcpy(usb_data+header_size, data, block_size);
-	
-	//bdm_usb_send_ep0(&usb_devs[dev], usb_data);
-	if ( (usb_devs[dev].type == P_USBDM) || (usb_devs[dev].type == P_USBDM_V2) )
-	    ret_val = bdm_usb_transaction(dev, USBDM_MEMORY_HEADER_SIZE+block_size, 1, usb_data);
-	else
-	    ret_val = bdm_usb_recv_ep0(&usb_devs[dev], usb_data);
+	}
+	else if (direct) {
+	    /* the block is sent from the caller's buffer */
+	    unsigned char header[USBDM_MEMORY_HEADER_SIZE];
+	    __assemble_message_header(header, usb_devs[dev].type, command, element_size, block_size, address);
+	    ret_val = bdm_usb_block_transaction(dev, header, header_size, data, block_size, &status, 1);
+	}
+	else {
+	    __assemble_message_header(usb_data, usb_devs[dev].type, command, element_size, block_size, address);
+	    memcpy(usb_data+header_size, data, block_size);
+	    //bdm_usb_send_ep0(&usb_devs[dev], usb_data);
+	    if ( (usb_devs[dev].type == P_USBDM) || (usb_devs[dev].type == P_USBDM_V2) )
+		ret_val = bdm_usb_transaction(dev, USBDM_MEMORY_HEADER_SIZE+block_size, 1, usb_data);
+	    else
+		ret_val = bdm_usb_recv_ep0(&usb_devs[dev], usb_data);
+	    status = usb_data[0];
+	}
 	
 	if (usb_devs[dev].type == P_TBLCF)
-	  ret_val = (!(usb_data[0]==tblcf_cmd));
+	  ret_val = (!(status==tblcf_cmd));
 	
 	if (ret_val != BDM_RC_OK)
 	  return ret_val;
@@ -1047,13 +1157,16 @@ unsigned char bdmusb_write_memory(int dev, unsigned char element_size, unsigned
 	address += block_size;
 	byte_count -= block_size;
     }
-    element_indx = element_size-1;
-    if (element_indx >2)
-      element_indx = 2;
-    
-    bdm_print("BDMUSB_WRITE_MEMORY: Write %d %s from address 0x%08lX, (0x%02X)\r\n",
-              (original_byte_count/element_size), mem_size_str[element_indx], address,usb_data[0]);
-    bdm_print_dump(original_data, original_byte_count);
+    if (async) {
+	status = bdm_usb_async_flush(dev);
+	if (ret_val == BDM_RC_OK)
+	    ret_val = status;
+	if (ret_val != BDM_RC_OK)
+	    return ret_val;
+    }
+    bdmusb_trace(BDMUSB_TRACE_WRITE_MEMORY, BDMUSB_TRACE_FLAGS(&usb_devs[dev]), status,
+                 address, element_size, original_byte_count, original_byte_count,
+                 original_data);
     
     return ret_val;
 }
@@ -1135,7 +1248,6 @@ unsigned char bdmusb_read_block8(int dev, unsigned long int address,
     ret_val = bdmusb_read_memory(dev, 1, bytecount, address, buffer);
     
     bdm_print("BDMUSB_READ_BLOCK8: Block read, size 0x%02X (0x%02X):\r\n", bytecount, ret_val);
-    bdm_print_dump(buffer, bytecount);
     
     return ret_val;
 }
@@ -1160,7 +1272,6 @@ unsigned char bdmusb_read_block16(int dev, unsigned long int address,
     ret_val = bdmusb_read_memory(dev, 2, bytecount, address, buffer);
     
     bdm_print("BDMUSB_READ_BLOCK16: Block read, size 0x%02X (0x%02X):\r\n", bytecount, ret_val);
-    bdm_print_dump(buffer, bytecount);
     
     return ret_val;
 }
@@ -1199,7 +1310,6 @@ unsigned char bdmusb_read_block32(int dev, unsigned long int address,
     ret_val = bdmusb_read_memory(dev, 4, bytecount, address, buffer);
     
     bdm_print("BDMUSB_READ_BLOCK32: Block read, size 0x%02X (0x%02X):\r\n", bytecount, ret_val);
-    bdm_print_dump(buffer, bytecount);
     
     return ret_val;
 }
@@ -1215,7 +1325,6 @@ unsigned char bdmusb_write_block8(int dev, unsigned long int address,
     ret_val = bdmusb_write_memory(dev, 1, bytecount, address, buffer);
     
     bdm_print("BDMUSB_WRITE_BLOCK8: Block write, size 0x%02X:\r\n", bytecount);
-    bdm_print_dump(buffer, bytecount);
     
     return ret_val;
 }
@@ -1307,7 +1416,6 @@ unsigned char bdmusb_write_block32(int dev, unsigned long int address,
     ret_val = bdmusb_write_memory(dev, 4, bytecount, address, buffer);
     
     bdm_print("BDMUSB_WRITE_BLOCK32: Block write, size 0x%02X:\r\n", bytecount);
-    bdm_print_dump(usb_data+6, MAX_DATA_SIZE&0xfffc);
     #ifdef WRITE_BLOCK_CHECK
     ret_val = bdmusb_get_last_sts_value(dev);
     if (ret_val != BDM_RC_OK)
@@ -0,0 +1,319 @@
+/*
+    BDM USB abstraction project
+    Asynchronous USBDM transfer queue
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * A USBDM command is an OUT packet with the header and as much data as
+ * fits in MAX_FIRST_TRANSACTION bytes, an OUT packet with the rest of the
+ * data sent from the caller's buffer and an IN packet with the reply.
+ * The synchronous code waits for every reply before it sends the next
+ * command. Here the transfers of up to BDM_USB_ASYNC_DEPTH commands are
+ * queued on the endpoints with libusb's asynchronous API. The host
+ * controller works through each endpoint's transfers in the order they
+ * were submitted, so the pod still sees the commands in order but never
+ * waits for the host between them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "log.h"
+#include "bdmusb-hwdesc.h"
+#include "bdmusb.h"
+#include "bdmusb_low_level.h"
+#include "bdmusb_async.h"
+#include "bdmusb_trace.h"
+
+#include "commands.h"
+
+/* how long cancelled transfers get to call back, about one TIMEOUT */
+#define BDM_USB_ASYNC_DRAIN_TRIES 10
+#define BDM_USB_ASYNC_DRAIN_USECS 100000
+
+typedef struct {
+  int                     pending;      /* transfers still in flight */
+  int                     done;         /* set once pending drops to 0 */
+  int                     active[3];
+  int                     status;
+  unsigned char           first[MAX_FIRST_TRANSACTION];
+  unsigned char           reply[MAX_PACKET_SIZE];
+  unsigned int            reply_size;
+  struct libusb_transfer  *xfer[3];
+  bdm_usb_async_callback  callback;
+  void                    *user;
+  struct bdm_usb_async_state_s *queue;
+} bdm_usb_async_cmd;
+
+/* one queue per device, allocated on first use */
+struct bdm_usb_async_state_s {
+  bdm_usb_async_cmd       cmds[BDM_USB_ASYNC_DEPTH];
+  unsigned int            head;         /* next command to report */
+  unsigned int            tail;         /* next free command */
+  int                     error;        /* first error since the last flush */
+  int                     trace_flags;
+  int                     outstanding;  /* transfers not yet called back */
+  int                     dead;         /* dropped with transfers outstanding */
+  int                     released;     /* the device no longer holds it */
+};
+
+int bdm_usb_async_usable(int dev) {
+    return ((usb_devs[dev].type == P_USBDM) || (usb_devs[dev].type == P_USBDM_V2)) &&
+      !usb_devs[dev].use_only_ep0 && bdmusb_usb_dev_open(dev);
+}
+
+static void bdm_usb_async_free(bdm_usb_async_state *q) {
+    int c, x;
+    for (c = 0; c < BDM_USB_ASYNC_DEPTH; c++)
+      for (x = 0; x < 3; x++)
+	if (q->cmds[c].xfer[x])
+	  libusb_free_transfer(q->cmds[c].xfer[x]);
+    free(q);
+}
+
+static void bdm_usb_async_transfer_done(struct libusb_transfer *xfer) {
+    bdm_usb_async_cmd *cmd = xfer->user_data;
+    bdm_usb_async_state *q = cmd->queue;
+    int x;
+
+    for (x = 0; x < 3; x++)
+      if (cmd->xfer[x] == xfer)
+        cmd->active[x] = 0;
+
+    /* a dropped queue only waits for its last transfer; it is then
+     * freed if the device has let go of it, or else usable again */
+    q->outstanding--;
+    if (q->dead) {
+	if (q->outstanding == 0) {
+	    if (q->released)
+	      bdm_usb_async_free(q);
+	    else
+	      q->dead = 0;
+	}
+	return;
+    }
+
+    bdmusb_trace(xfer->endpoint == EP_IN ? BDMUSB_TRACE_EP_IN : BDMUSB_TRACE_EP_OUT,
+                 cmd->queue->trace_flags,
+                 xfer->status != LIBUSB_TRANSFER_COMPLETED ? BDM_RC_USB_ERROR :
+                 xfer->endpoint == EP_IN ? cmd->reply[0] : BDM_RC_OK, 0, 0,
+                 xfer->length, xfer->actual_length, xfer->buffer);
+
+    if (xfer->status != LIBUSB_TRANSFER_COMPLETED) {
+	bdm_print("bdm_usb_async: transfer failed (status = %d)\n", xfer->status);
+	if (cmd->status == BDM_RC_OK)
+	  cmd->status = BDM_RC_USB_ERROR;
+    }
+    else if ((xfer->endpoint == EP_IN) && (cmd->reply[0] != BDM_RC_OK)) {
+	bdm_print("bdm_usb_async: error return (%d)\n", cmd->reply[0]);
+	cmd->status = cmd->reply[0];
+    }
+    if ((cmd->status != BDM_RC_OK) && (cmd->queue->error == BDM_RC_OK))
+      cmd->queue->error = cmd->status;
+    if (--cmd->pending == 0)
+      cmd->done = 1;
+}
+
+/* cancels everything in flight once a command has failed */
+static void bdm_usb_async_cancel(bdm_usb_async_state *q) {
+    unsigned int c;
+    int x;
+    for (c = q->head; c != q->tail; c++) {
+	bdm_usb_async_cmd *cmd = &q->cmds[c % BDM_USB_ASYNC_DEPTH];
+	for (x = 0; x < 3; x++)
+	  if (cmd->active[x])
+	    libusb_cancel_transfer(cmd->xfer[x]);
+    }
+}
+
+/* gives cancelled transfers a bounded time to call back; event handling
+ * may be failing, so this cannot wait for them forever */
+static int bdm_usb_async_drain(bdm_usb_async_state *q) {
+    int tries;
+    for (tries = 0; tries < BDM_USB_ASYNC_DRAIN_TRIES; tries++) {
+	struct timeval tv = { 0, BDM_USB_ASYNC_DRAIN_USECS };
+	unsigned int c;
+	for (c = q->head; c != q->tail; c++)
+	  if (q->cmds[c % BDM_USB_ASYNC_DEPTH].pending)
+	    break;
+	if (c == q->tail)
+	  return 0;
+	if (libusb_handle_events_timeout(NULL, &tv) < 0)
+	  break;
+    }
+    return -1;
+}
+
+int bdm_usb_async_poll(int dev, int wait) {
+    bdm_usb_async_state *q = usb_devs[dev].async;
+    bdm_usb_async_cmd *cmd;
+
+    if (!q)
+      return 0;
+
+    while (q->head != q->tail) {
+	cmd = &q->cmds[q->head % BDM_USB_ASYNC_DEPTH];
+	if (cmd->pending == 0) {
+	    if (cmd->callback)
+	      cmd->callback(cmd->status, cmd->reply, cmd->reply_size, cmd->user);
+	    q->head++;
+	    wait = 0;
+	    continue;
+	}
+	if (wait) {
+	    /* other threads may be handling events for their own devices,
+	     * so wait on this command rather than on any event */
+	    if (libusb_handle_events_completed(NULL, &cmd->done) < 0) {
+		/* cancel what is in flight and drop the queue; while
+		 * transfers still have not called back the queue is dead,
+		 * so their commands are not reused or freed under them */
+		bdm_print("bdm_usb_async: event handling failed\n");
+		bdm_usb_async_cancel(q);
+		if (bdm_usb_async_drain(q) < 0) {
+		    bdm_print("bdm_usb_async: transfers still in flight\n");
+		    if (q->outstanding)
+		      q->dead = 1;
+		}
+		q->head = q->tail;
+		if (q->error == BDM_RC_OK)
+		  q->error = BDM_RC_USB_ERROR;
+		return -1;
+	    }
+	}
+	else {
+	    struct timeval tv = { 0, 0 };
+	    libusb_handle_events_timeout(NULL, &tv);
+	    if (cmd->pending)
+	      break;
+	}
+	if (q->error != BDM_RC_OK)
+	  bdm_usb_async_cancel(q);
+    }
+    return q->tail - q->head;
+}
+
+int bdm_usb_async_flush(int dev) {
+    bdm_usb_async_state *q = usb_devs[dev].async;
+    int ret_val;
+    if (!q)
+      return BDM_RC_OK;
+    while (bdm_usb_async_poll(dev, 1) > 0)
+      ;
+    ret_val = q->error;
+    q->error = BDM_RC_OK;
+    return ret_val;
+}
+
+void bdm_usb_async_release(int dev) {
+    bdm_usb_async_state *q = usb_devs[dev].async;
+    if (!q)
+      return;
+    bdm_usb_async_flush(dev);
+    usb_devs[dev].async = NULL;
+    /* the last late callback frees a dead queue */
+    if (q->dead)
+      q->released = 1;
+    else
+      bdm_usb_async_free(q);
+}
+
+static int bdm_usb_async_queue(bdm_usb_async_cmd *cmd, int x, unsigned char endpoint,
+                               unsigned char *buffer, unsigned int length,
+                               libusb_device_handle *handle) {
+    int ret_val;
+    if (!cmd->xfer[x]) {
+	cmd->xfer[x] = libusb_alloc_transfer(0);
+	if (!cmd->xfer[x])
+	  return BDM_RC_USB_ERROR;
+    }
+    libusb_fill_bulk_transfer(cmd->xfer[x], handle, endpoint, buffer, length,
+                              bdm_usb_async_transfer_done, cmd, TIMEOUT);
+    ret_val = libusb_submit_transfer(cmd->xfer[x]);
+    if (ret_val < 0) {
+	bdm_print("bdm_usb_async: submit failed (USB error = %d)\n", ret_val);
+	return BDM_RC_USB_ERROR;
+    }
+    cmd->active[x] = 1;
+    cmd->pending++;
+    cmd->queue->outstanding++;
+    return BDM_RC_OK;
+}
+
+int bdm_usb_async_submit(int dev, unsigned char *header, unsigned int header_size,
+                         unsigned char *tx, unsigned int tx_size,
+                         unsigned int reply_size,
+                         bdm_usb_async_callback callback, void *user) {
+    libusb_device_handle *handle = usb_devs[dev].handle;
+    bdm_usb_async_state *q = usb_devs[dev].async;
+    bdm_usb_async_cmd *cmd;
+    unsigned int total = header_size+tx_size;
+    unsigned int first_size = total>MAX_FIRST_TRANSACTION?MAX_FIRST_TRANSACTION:total;
+    int ret_val;
+
+    if (!bdm_usb_async_usable(dev) || (reply_size > MAX_PACKET_SIZE) || (total > 255))
+      return BDM_RC_ILLEGAL_PARAMS;
+
+    if (!q) {
+	q = calloc(1, sizeof(bdm_usb_async_state));
+	if (!q)
+	  return BDM_RC_USB_ERROR;
+	q->trace_flags = BDMUSB_TRACE_FLAGS(&usb_devs[dev]);
+	usb_devs[dev].async = q;
+    }
+
+    /* nothing is queued behind transfers that never called back */
+    if (q->dead)
+      return BDM_RC_USB_ERROR;
+
+    /* wait for the oldest command if the queue is full */
+    while ((q->tail - q->head) == BDM_USB_ASYNC_DEPTH)
+      if (bdm_usb_async_poll(dev, 1) < 0)
+	return BDM_RC_USB_ERROR;
+
+    if (q->error != BDM_RC_OK)
+      return q->error;
+
+    cmd = &q->cmds[q->tail % BDM_USB_ASYNC_DEPTH];
+    cmd->queue = q;
+    cmd->pending = 0;
+    cmd->done = 0;
+    cmd->status = BDM_RC_OK;
+    cmd->reply_size = reply_size;
+    cmd->callback = callback;
+    cmd->user = user;
+    memset(cmd->active, 0, sizeof(cmd->active));
+    q->tail++;
+
+    header[0] = total;
+    memcpy(cmd->first, header, header_size);
+    memcpy(cmd->first+header_size, tx, first_size-header_size);
+
+    ret_val = bdm_usb_async_queue(cmd, 0, EP_OUT, cmd->first, first_size, handle);
+    if ((ret_val == BDM_RC_OK) && (total > first_size))
+      ret_val = bdm_usb_async_queue(cmd, 1, EP_OUT, tx+(first_size-header_size),
+                                    total-first_size, handle);
+    if (ret_val == BDM_RC_OK)
+      ret_val = bdm_usb_async_queue(cmd, 2, EP_IN, cmd->reply, reply_size, handle);
+
+    if (ret_val != BDM_RC_OK) {
+	cmd->status = ret_val;
+	if (q->error == BDM_RC_OK)
+	  q->error = ret_val;
+	bdm_usb_async_cancel(q);
+    }
+    return ret_val;
+}
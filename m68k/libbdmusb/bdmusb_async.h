@@ -0,0 +1,53 @@
+/*
+    BDM USB abstraction project
+    Asynchronous USBDM transfer queue
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _BDMUSB_ASYNC_H_
+#define _BDMUSB_ASYNC_H_
+
+/* number of commands kept in flight */
+#define BDM_USB_ASYNC_DEPTH 8
+
+/* called in submission order when a command finishes; reply[0] is the
+ * BDM status and status is the result of the whole command */
+typedef void (*bdm_usb_async_callback)(int status, unsigned char *reply,
+                                       unsigned int reply_size, void *user);
+
+/* can the queue be used with this device */
+int bdm_usb_async_usable(int dev);
+
+/* queues a command; the header is copied, tx must stay valid until the
+ * command finishes; returns 0 on success and a BDM_RC_* error on failure */
+int bdm_usb_async_submit(int dev, unsigned char *header, unsigned int header_size,
+                         unsigned char *tx, unsigned int tx_size,
+                         unsigned int reply_size,
+                         bdm_usb_async_callback callback, void *user);
+
+/* handles USB events and reports the device's finished commands, with
+ * wait set blocks until at least one command finished; returns the number
+ * of commands still queued or -1 on error */
+int bdm_usb_async_poll(int dev, int wait);
+
+/* waits for all of the device's queued commands; returns the first error
+ * or 0 */
+int bdm_usb_async_flush(int dev);
+
+/* drains the device's queue and frees it; called when the device closes */
+void bdm_usb_async_release(int dev);
+
+#endif /* _BDMUSB_ASYNC_H_ */
@@ -25,6 +25,8 @@
 #include "bdmusb-hwdesc.h"
 #include "bdmusb.h"
 #include "bdmusb_low_level.h"
+#include "bdmusb_async.h"
+#include "bdmusb_trace.h"
 
 #include "commands.h"
 
@@ -35,11 +37,6 @@
 
 #define bdmusb_print(val) bdm_print(val)
 
-//static unsigned char usb_data[MAX_DATA_SIZE+2];
-extern unsigned char usb_data[MAX_DATA_SIZE+2];
-
-#define EP_OUT (LIBUSB_ENDPOINT_OUT|1) /**< EP # for Out endpoint */
-#define EP_IN  (LIBUSB_ENDPOINT_IN |2) /**< EP # for In endpoint */
 
 // Internal functions 
 int bdm_usb_send_epOut(bdmusb_dev *dev, unsigned int count, unsigned char *data);
@@ -271,10 +268,10 @@ static const char *const oldCommandTable[]= {
   *
   * @return pointer to static string describing the command
   */
-const char *getCommandName(bdmusb_dev *dev, unsigned char command) {
-   static char const *commandName = NULL;
+const char *bdmusb_command_name(int usbdm_v2, unsigned char command) {
+   char const *commandName = NULL;
 
-   if (dev->type != P_USBDM_V2) {
+   if (!usbdm_v2) {
       if (command < sizeof(oldCommandTable)/sizeof(oldCommandTable[0]))
          commandName = oldCommandTable[command];
    }
@@ -287,6 +284,10 @@ const char *getCommandName(bdmusb_dev *dev, unsigned char command) {
    return commandName;
 }
 
+const char *getCommandName(bdmusb_dev *dev, unsigned char command) {
+   return bdmusb_command_name(dev->type == P_USBDM_V2, command);
+}
+
 /** Debug command string from code*/
 static const char *const debugCommands[] = {
    "ACKN",              // 0
@@ -336,8 +337,8 @@ unsigned char bdm_usb_send_ep0(bdmusb_dev *dev, unsigned char * data) {
     bdmusb_print("USB EP0 send: device not open\n");
     return(1);
   }
-  bdmusb_print("USB EP0 send:\n");
-  bdm_print_dump(data,(*count)+1);
+  bdmusb_trace(BDMUSB_TRACE_EP0_SEND, BDMUSB_TRACE_FLAGS(dev), BDM_RC_OK, 0, 0,
+               (*count)+1, (*count)+1, data);
   i=libusb_control_transfer(usb_devs[dev->dev_ref].handle, 0x40, *(data+1), (*(data+2))+256*(*(data+3)),
                             (*(data+4))+256*(*(data+5)), data+6,
                             (uint16_t)(((*count)>5)?((*count)-5):0), TIMEOUT);
@@ -356,12 +357,12 @@ unsigned char bdm_usb_recv_ep0(bdmusb_dev *dev, unsigned char * data) {
     bdmusb_print("USB EP0 receive request: device not open\n");
     return(BDM_RC_USB_ERROR);
   }
-  bdmusb_print("USB EP0 receive request:\n");
-  bdm_print_dump(data,6);
+  bdmusb_trace(BDMUSB_TRACE_EP0_REQUEST, BDMUSB_TRACE_FLAGS(dev), BDM_RC_OK, 0, 0,
+               6, 6, data);
   i=libusb_control_transfer(dev->handle, 0xC0, *(data+1), (*(data+2))+256*(*(data+3)),
                             (*(data+4))+256*(*(data+5)), data, count, TIMEOUT);
-  bdmusb_print("USB EP0 receive:\n");
-  bdm_print_dump(data,count);
+  bdmusb_trace(BDMUSB_TRACE_EP0_RECV, BDMUSB_TRACE_FLAGS(dev), i<0?BDM_RC_USB_ERROR:BDM_RC_OK,
+               0, 0, count, i<0?0:i, data);
   if (i<0) return(BDM_RC_USB_ERROR); else return(BDM_RC_OK);
 }
 
@@ -404,12 +405,15 @@ int bdmusb_usb_open(const char *device) {
     return -1;
   }
   bdm_print("USB Interface claimed\n");
+  bdmusb_trace_open();
   return dev;
 }
 
 /* closes connection to the currently open device */
 void bdmusb_usb_close(int dev) {
   if (bdmusb_usb_dev_open(dev)) {
+    bdm_usb_async_release(dev);
+    bdmusb_trace_close();
     libusb_set_configuration(usb_devs[dev].handle,0);   // Un-set the configuration
     /* release the interface */
     libusb_release_interface(usb_devs[dev].handle,0);
@@ -425,6 +429,7 @@ void bdmusb_usb_close(int dev) {
 /* requests bootloader execution on next power-up */
 /* returns 0 on success and non-zero on failure */
 unsigned char bdmusb_request_boot(int dev) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	if (usb_devs[dev].type==P_TBLCF) {
 	    usb_data[0]=1;			  	/* return 1 byte */
 	    usb_data[1]=CMD_TBLCF_SET_BOOT;
@@ -450,13 +455,8 @@ int bdm_usb_send_epOut(bdmusb_dev *dev, unsigned int count, unsigned char *data)
       return BDM_RC_USB_ERROR;
    }
 
-//#ifdef LOG_LOW_LEVEL
-   bdm_print("============================\n");
-   bdm_print("bdm_usb_send_epOut() - USB EP0ut send (%s, size=%d):\n", getCommandName(dev, data[1]), count);
-   if (data[1] == CMD_USBDM_DEBUG)
-      bdm_print("bdm_usb_send_epOut() - Debug cmd = %s\n", getDebugCommandName(data[2]));
-   bdm_print_dump(data, count);
-//#endif // LOG_LOW_LEVEL
+   bdmusb_trace(BDMUSB_TRACE_EP_OUT, BDMUSB_TRACE_FLAGS(dev), BDM_RC_OK, 0, 0,
+                count, count, data);
 
    ret_val = libusb_bulk_transfer (dev->handle,
                        EP_OUT,  // Endpoint
@@ -467,15 +467,11 @@ int bdm_usb_send_epOut(bdmusb_dev *dev, unsigned int count, unsigned char *data)
                        );
    if (ret_val<0) {
       bdm_print("bdm_usb_send_epOut() - Transfer failed (USB error = %d)\n", ret_val);
-      data[0] = BDM_RC_USB_ERROR;
       return BDM_RC_USB_ERROR;
    }
 
    return BDM_RC_OK;
 }
-// Temporary buffer for IN transactions
-unsigned char dummyBuffer[200];
-
 int bdm_usb_recv_epIn(bdmusb_dev *dev, unsigned int count, unsigned char *data) {
    int ret_val;
    int retry = 5;
@@ -486,15 +482,11 @@ int bdm_usb_recv_epIn(bdmusb_dev *dev, unsigned int count, unsigned char *data)
       return BDM_RC_USB_ERROR;
    }
 
-//#ifdef LOG_LOW_LEVEL
-   bdm_print("bdm_usb_recv_epIn(%d, ...)\n", count);
-//#endif // LOG_LOW_LEVEL
-
    do {
       ret_val = libusb_bulk_transfer (dev->handle,
                          EP_IN,     // Endpoint
-                         (unsigned char*)dummyBuffer,    // ptr to Rx data buffer
-                         sizeof(dummyBuffer)-5, // number of bytes to Rx
+                         data,                  // ptr to Rx data buffer
+                         count,                 // number of bytes to Rx
 			 &count_sent,           // number of bytes sended 
                          TIMEOUT                // timeout
                          );
@@ -512,22 +504,11 @@ int bdm_usb_recv_epIn(bdmusb_dev *dev, unsigned int count, unsigned char *data)
       return BDM_RC_USB_ERROR;
    }
 
-   if (count_sent != count) {
-      bdm_print("bdm_usb_recv_epIn() - Expected %d; received %d\n", count, count_sent);
-   }
-   
-   memcpy(data, dummyBuffer, count);
-   if (data[0] != BDM_RC_OK) { // Error?
-      //bdm_print("bdm_usb_recv_epIn() - Error Return (%s):\n", getErrorName(data[0]));
-      bdm_print("bdm_usb_recv_epIn() - Error Return (%d):\n", data[0] );
-      bdm_print("bdm_usb_recv_epIn(size = %d, recvd = %d):\n", count, count_sent);
-      bdm_print_dump(data,ret_val);
-      memset(&data[1], 0x00, count-1);
-   }
+   bdmusb_trace(BDMUSB_TRACE_EP_IN, BDMUSB_TRACE_FLAGS(dev), data[0], 0, 0,
+                count, count_sent, data);
 
-//#ifdef LOG_LOW_LEVEL
-   bdm_print_dump(data, count_sent);
-//#endif // LOG_LOW_LEVEL
+   if (data[0] != BDM_RC_OK) // Error?
+      memset(&data[1], 0x00, count-1);
 
    return data[0];
 }  
@@ -596,4 +577,54 @@ int  bdm_usb_transaction(int dev, unsigned int txSize, unsigned int rxSize, unsi
       // more complex trannsactions
       ret_val = bdm_usb_transaction_epinout(&usb_devs[dev], txSize, rxSize, data);
 
-}
\ No newline at end of file
+    return ret_val;
+}
+
+/* Memory block transaction without a staging buffer. The command header
+ * is taken from header[], block data is sent straight from tx and the
+ * reply, status byte first, is received straight into rx.
+ * Bulk endpoint USBDM pods send and receive, the other pods only read
+ * with the command in the EP0 SETUP packet. */
+int bdm_usb_block_transaction(int dev, unsigned char *header, unsigned int header_size,
+                              unsigned char *tx, unsigned int tx_size,
+                              unsigned char *rx, unsigned int rx_size) {
+    bdmusb_dev *usb_dev = &usb_devs[dev];
+    int ret_val;
+
+    if ((usb_dev->type == P_USBDM || usb_dev->type == P_USBDM_V2) && !usb_dev->use_only_ep0) {
+	// The first packet holds the header and as much of the block as fits
+	// in the first packet, the rest goes from the caller's buffer
+	unsigned char first[MAX_FIRST_TRANSACTION];
+	unsigned int total = header_size+tx_size;
+	unsigned int first_size = total>MAX_FIRST_TRANSACTION?MAX_FIRST_TRANSACTION:total;
+
+	header[0] = total;
+	memcpy(first, header, header_size);
+	memcpy(first+header_size, tx, first_size-header_size);
+	ret_val = bdm_usb_send_epOut(usb_dev, first_size, first);
+	if ((ret_val == BDM_RC_OK) && (total>first_size))
+	    ret_val = bdm_usb_send_epOut(usb_dev, total-first_size, tx+(first_size-header_size));
+	if (ret_val == BDM_RC_OK)
+	    ret_val = bdm_usb_recv_epIn(usb_dev, rx_size, rx);
+	else
+	    rx[0] = ret_val;
+	return ret_val;
+    }
+
+    if (tx_size || !bdmusb_usb_dev_open(dev)) {
+	rx[0] = BDM_RC_USB_ERROR;
+	return BDM_RC_USB_ERROR;
+    }
+    bdmusb_trace(BDMUSB_TRACE_EP0_REQUEST, BDMUSB_TRACE_FLAGS(usb_dev), BDM_RC_OK, 0, 0,
+                 6, 6, header);
+    ret_val = libusb_control_transfer(usb_dev->handle, 0xC0, header[1], header[2]+256*header[3],
+                                      header[4]+256*header[5], rx, rx_size, TIMEOUT);
+    bdmusb_trace(BDMUSB_TRACE_EP0_RECV, BDMUSB_TRACE_FLAGS(usb_dev),
+                 ret_val<0?BDM_RC_USB_ERROR:BDM_RC_OK, 0, 0, rx_size,
+                 ret_val<0?0:ret_val, rx);
+    if (ret_val<0) {
+	rx[0] = BDM_RC_USB_ERROR;
+	return BDM_RC_USB_ERROR;
+    }
+    return BDM_RC_OK;
+}
@@ -21,6 +21,12 @@
 #ifndef _BDMUSB_LOW_LEVEL_H_
 #define _BDMUSB_LOW_LEVEL_H_
 
+#define EP_OUT (LIBUSB_ENDPOINT_OUT|1) /**< EP # for Out endpoint */
+#define EP_IN  (LIBUSB_ENDPOINT_IN |2) /**< EP # for In endpoint */
+
+/* bytes of a USBDM command sent in its first OUT packet */
+#define MAX_FIRST_TRANSACTION 30
+
 int bdmusb_usb_dev_open(int dev);
 /* opens a device with given number (0...), returns 0 on success and 1 on error */
 int bdmusb_usb_open(const char *device);
@@ -35,5 +41,14 @@ unsigned char bdmusb_request_boot(int dev);
 unsigned char bdm_usb_recv_ep0(bdmusb_dev *dev, unsigned char * data);
 unsigned char bdm_usb_send_ep0(bdmusb_dev *dev, unsigned char * data);
 
+/* command names for the logs */
+const char *bdmusb_command_name(int usbdm_v2, unsigned char command);
+const char *getDebugCommandName(unsigned char cmd);
+
 int bdm_usb_transaction(int dev, unsigned int txSize, unsigned int rxSize, unsigned char *data);
+
+/* memory block transfer straight to and from the caller's buffers */
+int bdm_usb_block_transaction(int dev, unsigned char *header, unsigned int header_size,
+                              unsigned char *tx, unsigned int tx_size,
+                              unsigned char *rx, unsigned int rx_size);
 #endif /* _BDMUSB_LOW_LEVEL_H_ */
\ No newline at end of file
@@ -0,0 +1,256 @@
+/*
+    BDM USB abstraction project
+    Binary trace of the USB traffic
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include "log.h"
+#include "bdmusb-hwdesc.h"
+#include "bdmusb.h"
+#include "bdmusb_low_level.h"
+#include "bdmusb_trace.h"
+
+#include "commands.h"
+
+bdmusb_trace_rec *bdmusb_trace_ring;
+
+static uint32_t bdmusb_trace_seq;
+static uint32_t bdmusb_trace_kept;    /* records put in the ring */
+static int bdmusb_trace_users;        /* pods open */
+
+static const char *const bdmusb_trace_mem_size[] = {
+  "byte",
+  "word",
+  "long"
+};
+
+/* renders records made while the debug level is up */
+static void bdmusb_trace_print(void *arg, const char *line) {
+  bdm_print("%s", line);
+}
+
+static void bdmusb_trace_render_data(const bdmusb_trace_rec *rec,
+                                     const unsigned char *data,
+                                     unsigned int count,
+                                     bdmusb_trace_output output, void *arg);
+
+void bdmusb_trace_add(int kind, int flags, int status, unsigned long address,
+                      int element, unsigned int size, unsigned int actual,
+                      const unsigned char *data) {
+  bdmusb_trace_rec local;
+  bdmusb_trace_rec *rec = &local;
+  struct timeval now;
+  unsigned int captured = actual<BDMUSB_TRACE_DATA?actual:BDMUSB_TRACE_DATA;
+
+  if (bdmusb_trace_ring)
+    rec = &bdmusb_trace_ring[bdmusb_trace_kept++ % BDMUSB_TRACE_RECS];
+
+  gettimeofday(&now, NULL);
+  rec->seq = bdmusb_trace_seq++;
+  rec->sec = now.tv_sec;
+  rec->usec = now.tv_usec;
+  rec->address = address;
+  rec->size = size;
+  rec->actual = actual;
+  rec->kind = kind;
+  rec->flags = flags;
+  rec->status = status;
+  rec->element = element;
+  if (data)
+    memcpy(rec->data, data, captured);
+
+  /* the ring only keeps the first bytes, the live output shows them all */
+  if (bdmGetDebugFlag() > 1)
+    bdmusb_trace_render_data(rec, data, data ? actual : 0,
+                             bdmusb_trace_print, NULL);
+}
+
+void bdmusb_trace_open(void) {
+  bdmusb_trace_users++;
+  if (!bdmusb_trace_ring && getenv("M68K_BDM_USB_TRACE")) {
+    bdmusb_trace_ring = calloc(BDMUSB_TRACE_RECS, sizeof(bdmusb_trace_rec));
+    bdmusb_trace_kept = 0;
+    bdmusb_trace_seq = 0;
+  }
+}
+
+/* the ring is shared by the open pods, the last close drops it so a
+ * later session starts a new trace */
+void bdmusb_trace_close(void) {
+  const char *path = getenv("M68K_BDM_USB_TRACE");
+  if (bdmusb_trace_ring && path)
+    bdmusb_trace_save(path);
+  if (bdmusb_trace_users > 0)
+    bdmusb_trace_users--;
+  if (bdmusb_trace_users == 0) {
+    free(bdmusb_trace_ring);
+    bdmusb_trace_ring = NULL;
+  }
+}
+
+/* writes the ring oldest first; returns 0 on success and -1 on error */
+int bdmusb_trace_save(const char *path) {
+  bdmusb_trace_file header;
+  unsigned int first = 0;
+  unsigned int r;
+  FILE *file;
+
+  if (!bdmusb_trace_ring)
+    return -1;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BDMUSB_TRACE_MAGIC, sizeof(header.magic));
+  header.version = BDMUSB_TRACE_VERSION;
+  header.rec_size = sizeof(bdmusb_trace_rec);
+  header.count = bdmusb_trace_kept;
+  if (bdmusb_trace_kept > BDMUSB_TRACE_RECS) {
+    header.count = BDMUSB_TRACE_RECS;
+    header.lost = bdmusb_trace_kept - BDMUSB_TRACE_RECS;
+    first = bdmusb_trace_kept % BDMUSB_TRACE_RECS;
+  }
+
+  file = fopen(path, "wb");
+  if (!file) {
+    bdm_print("bdmusb_trace_save: cannot open %s\n", path);
+    return -1;
+  }
+  fwrite(&header, sizeof(header), 1, file);
+  for (r = 0; r < header.count; r++)
+    fwrite(&bdmusb_trace_ring[(first + r) % BDMUSB_TRACE_RECS],
+           sizeof(bdmusb_trace_rec), 1, file);
+  if (fclose(file) != 0) {
+    bdm_print("bdmusb_trace_save: cannot write %s\n", path);
+    return -1;
+  }
+  return 0;
+}
+
+/* the COUNT bytes of DATA as the hex dumps showed them, 32 to a line */
+static void bdmusb_trace_dump(const bdmusb_trace_rec *rec,
+                              const unsigned char *data, unsigned int count,
+                              bdmusb_trace_output output, void *arg) {
+  char line[256];
+  char *p = line;
+  unsigned int i;
+
+  for (i = 0; i < count; i++) {
+    p += sprintf(p, "%02X ", data[i]);
+    if (((i+1)%32)==0) {
+      strcpy(p, "\n");
+      output(arg, line);
+      p = line;
+    }
+    else if (((i+1)%8)==0)
+      *p++ = ' ';
+  }
+  if (p != line) {
+    strcpy(p, "\n");
+    output(arg, line);
+  }
+  if (rec->actual > count) {
+    sprintf(line, "... %u more bytes not traced\n", rec->actual - count);
+    output(arg, line);
+  }
+}
+
+void bdmusb_trace_render(const bdmusb_trace_rec *rec, bdmusb_trace_output output,
+                         void *arg) {
+  unsigned int count = rec->actual;
+
+  if (count > BDMUSB_TRACE_DATA)
+    count = BDMUSB_TRACE_DATA;
+  bdmusb_trace_render_data(rec, rec->data, count, output, arg);
+}
+
+/* renders REC with COUNT bytes of DATA, which starts with the bytes the
+ * record holds and may go on past them */
+static void bdmusb_trace_render_data(const bdmusb_trace_rec *rec,
+                                     const unsigned char *data,
+                                     unsigned int count,
+                                     bdmusb_trace_output output, void *arg) {
+  char line[256];
+  int v2 = (rec->flags & BDMUSB_TRACE_USBDM_V2) != 0;
+  int element_indx;
+
+  switch (rec->kind) {
+  case BDMUSB_TRACE_EP0_SEND:
+    output(arg, "USB EP0 send:\n");
+    bdmusb_trace_dump(rec, data, count, output, arg);
+    break;
+
+  case BDMUSB_TRACE_EP0_REQUEST:
+    output(arg, "USB EP0 receive request:\n");
+    bdmusb_trace_dump(rec, data, count, output, arg);
+    break;
+
+  case BDMUSB_TRACE_EP0_RECV:
+    output(arg, "USB EP0 receive:\n");
+    bdmusb_trace_dump(rec, data, count, output, arg);
+    break;
+
+  case BDMUSB_TRACE_EP_OUT:
+    output(arg, "============================\n");
+    sprintf(line, "bdm_usb_send_epOut() - USB EP0ut send (%s, size=%u):\n",
+            bdmusb_command_name(v2, rec->data[1]), rec->size);
+    output(arg, line);
+    if (rec->data[1] == CMD_USBDM_DEBUG) {
+      sprintf(line, "bdm_usb_send_epOut() - Debug cmd = %s\n",
+              getDebugCommandName(rec->data[2]));
+      output(arg, line);
+    }
+    bdmusb_trace_dump(rec, data, count, output, arg);
+    break;
+
+  case BDMUSB_TRACE_EP_IN:
+    sprintf(line, "bdm_usb_recv_epIn(%u, ...)\n", rec->size);
+    output(arg, line);
+    if (rec->actual != rec->size) {
+      sprintf(line, "bdm_usb_recv_epIn() - Expected %u; received %u\n",
+              rec->size, rec->actual);
+      output(arg, line);
+    }
+    if (rec->status != BDM_RC_OK) {
+      sprintf(line, "bdm_usb_recv_epIn() - Error Return (%d):\n", rec->status);
+      output(arg, line);
+    }
+    bdmusb_trace_dump(rec, data, count, output, arg);
+    break;
+
+  case BDMUSB_TRACE_READ_MEMORY:
+  case BDMUSB_TRACE_WRITE_MEMORY:
+    element_indx = rec->element ? rec->element-1 : 0;
+    if (element_indx > 2)
+      element_indx = 2;
+    sprintf(line, "BDMUSB_%s_MEMORY: %s %u %s from address 0x%08lX, (0x%02X)\r\n",
+            rec->kind == BDMUSB_TRACE_READ_MEMORY ? "READ" : "WRITE",
+            rec->kind == BDMUSB_TRACE_READ_MEMORY ? "Read" : "Write",
+            rec->element ? rec->size / rec->element : rec->size,
+            bdmusb_trace_mem_size[element_indx],
+            (unsigned long) rec->address, rec->status);
+    output(arg, line);
+    bdmusb_trace_dump(rec, data, count, output, arg);
+    break;
+
+  default:
+    sprintf(line, "unknown trace record kind %d\n", rec->kind);
+    output(arg, line);
+    break;
+  }
+}
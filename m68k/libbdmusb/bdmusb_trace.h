@@ -0,0 +1,116 @@
+/*
+    BDM USB abstraction project
+    Binary trace of the USB traffic
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef _BDMUSB_TRACE_H_
+#define _BDMUSB_TRACE_H_
+
+#include <stdint.h>
+
+/*
+ * Each USB packet and memory transfer is traced as a fixed size record
+ * holding the command, sizes, status, a timestamp and the first
+ * BDMUSB_TRACE_DATA bytes. Nothing is formatted when the record is
+ * made. Records are kept in a ring of the last BDMUSB_TRACE_RECS when
+ * M68K_BDM_USB_TRACE names a file, and the ring is written there when
+ * the device is closed for bdmusb-trace to render as text. With the BDM
+ * debug level above 1 each record is rendered as it is made, with all
+ * of its data, as the hex dumps were.
+ *
+ * Without BDMUSB_TRACE defined the trace compiles away.
+ */
+#define BDMUSB_TRACE_DATA  32
+#define BDMUSB_TRACE_RECS  4096
+
+#define BDMUSB_TRACE_MAGIC   "BDMUSBTR"
+#define BDMUSB_TRACE_VERSION 1
+
+/* record kinds */
+#define BDMUSB_TRACE_EP0_SEND     1   /* EP0 command with data */
+#define BDMUSB_TRACE_EP0_REQUEST  2   /* EP0 command asking for data */
+#define BDMUSB_TRACE_EP0_RECV     3   /* the data an EP0 command returned */
+#define BDMUSB_TRACE_EP_OUT       4   /* bulk OUT packet */
+#define BDMUSB_TRACE_EP_IN        5   /* bulk IN packet */
+#define BDMUSB_TRACE_READ_MEMORY  6   /* memory block read */
+#define BDMUSB_TRACE_WRITE_MEMORY 7   /* memory block write */
+
+/* flags */
+#define BDMUSB_TRACE_USBDM_V2     (1 << 0)  /* pod uses the USBDM V2 commands */
+
+#define BDMUSB_TRACE_FLAGS(_usb_dev) \
+  ((_usb_dev)->type == P_USBDM_V2 ? BDMUSB_TRACE_USBDM_V2 : 0)
+
+typedef struct {
+  uint32_t seq;
+  uint32_t sec;
+  uint32_t usec;
+  uint32_t address;                 /* memory transfers */
+  uint32_t size;                    /* bytes asked for */
+  uint32_t actual;                  /* bytes moved */
+  uint8_t  kind;
+  uint8_t  flags;
+  uint8_t  status;
+  uint8_t  element;                 /* memory transfer element size */
+  uint8_t  data[BDMUSB_TRACE_DATA];
+} bdmusb_trace_rec;
+
+/* the file written is this header then the records oldest first, in
+ * the byte order of the host that wrote it */
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t rec_size;
+  uint32_t count;
+  uint32_t lost;                    /* records that fell out of the ring */
+} bdmusb_trace_file;
+
+/* set while records are kept in the ring */
+extern bdmusb_trace_rec *bdmusb_trace_ring;
+
+extern int bdmGetDebugFlag (void);
+
+#if BDMUSB_TRACE
+#define bdmusb_tracing() (bdmusb_trace_ring || (bdmGetDebugFlag () > 1))
+#define bdmusb_trace(_kind, _flags, _status, _address, _element, _size, _actual, _data) \
+  do { \
+    if (bdmusb_tracing()) \
+      bdmusb_trace_add(_kind, _flags, _status, _address, _element, \
+                       _size, _actual, _data); \
+  } while (0)
+#else
+#define bdmusb_tracing() 0
+#define bdmusb_trace(_kind, _flags, _status, _address, _element, _size, _actual, _data) \
+  do { (void) (_size); (void) (_data); } while (0)
+#endif
+
+void bdmusb_trace_add(int kind, int flags, int status, unsigned long address,
+                      int element, unsigned int size, unsigned int actual,
+                      const unsigned char *data);
+
+/* start keeping records if M68K_BDM_USB_TRACE is set */
+void bdmusb_trace_open(void);
+/* write the ring to the M68K_BDM_USB_TRACE file, free it on the last close */
+void bdmusb_trace_close(void);
+int bdmusb_trace_save(const char *path);
+
+/* render a record as text, a line at a time */
+typedef void (*bdmusb_trace_output)(void *arg, const char *line);
+void bdmusb_trace_render(const bdmusb_trace_rec *rec, bdmusb_trace_output output,
+                         void *arg);
+
+#endif /* _BDMUSB_TRACE_H_ */
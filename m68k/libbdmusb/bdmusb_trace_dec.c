@@ -0,0 +1,104 @@
+/*
+    BDM USB abstraction project
+    Render a USB traffic trace as text
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/*
+ * Reads the file a library run with M68K_BDM_USB_TRACE set wrote and
+ * prints the records as the library's debug output shows them. With -t
+ * each record is preceded by its number and the time since the first.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "bdmusb_trace.h"
+
+static void print_line(void *arg, const char *line) {
+  fputs(line, stdout);
+}
+
+static void usage(const char *progname) {
+  fprintf(stderr, "usage: %s [-t] trace-file\n"
+          "  -t  show the record number and time of each record\n",
+          progname);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  bdmusb_trace_file header;
+  bdmusb_trace_rec rec;
+  const char *path = NULL;
+  int times = 0;
+  uint32_t sec = 0;
+  uint32_t usec = 0;
+  uint32_t r;
+  FILE *file;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0)
+      times = 1;
+    else if ((argv[i][0] == '-') || path)
+      usage(argv[0]);
+    else
+      path = argv[i];
+  }
+  if (!path)
+    usage(argv[0]);
+
+  file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return 1;
+  }
+
+  if ((fread(&header, sizeof(header), 1, file) != 1) ||
+      (memcmp(header.magic, BDMUSB_TRACE_MAGIC, sizeof(header.magic)) != 0)) {
+    fprintf(stderr, "%s: not a BDM USB trace\n", path);
+    return 1;
+  }
+  if ((header.version != BDMUSB_TRACE_VERSION) ||
+      (header.rec_size != sizeof(bdmusb_trace_rec))) {
+    fprintf(stderr, "%s: trace version or byte order not supported\n", path);
+    return 1;
+  }
+
+  if (header.lost)
+    printf("(%u earlier records not kept)\n", header.lost);
+
+  for (r = 0; r < header.count; r++) {
+    if (fread(&rec, sizeof(rec), 1, file) != 1) {
+      fprintf(stderr, "%s: truncated after %u records\n", path, r);
+      return 1;
+    }
+    if (times) {
+      long delta;
+      if (r == 0) {
+        sec = rec.sec;
+        usec = rec.usec;
+      }
+      delta = ((long) (rec.sec - sec) * 1000000L) + ((long) rec.usec - (long) usec);
+      printf("#%u +%ld.%06ld\n", rec.seq, delta / 1000000L, delta % 1000000L);
+    }
+    bdmusb_trace_render(&rec, print_line, NULL);
+  }
+
+  fclose(file);
+  return 0;
+}
@@ -29,6 +29,8 @@ void bdm_print_dump(unsigned char *data, unsigned int size) {
   static char buf[256];
   char *p = buf;
   unsigned int i=0;
+  if (bdmGetDebugFlag () <= 1)
+    return;
   while(size--) {
     p += sprintf(p,"%02X ",*(data++));
     if (((++i)%32)==0) {
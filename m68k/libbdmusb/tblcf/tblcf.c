@@ -31,8 +31,6 @@
 
 /* define symbol "LOG" during compilation to produce a log file tblcf_dll.log */
 
-//static unsigned char usb_data[MAX_DATA_SIZE+2];
-extern unsigned char usb_data[MAX_DATA_SIZE+2];
 
 /* returns version of the DLL in BCD format */
 unsigned char tblcf_version(void) {
@@ -50,6 +48,7 @@ unsigned char tblcf_get_last_sts(int dev) {
 /* resynchronizes communication with the target (in case of noise, etc.) */
 /* returns 0 on success and non-zero on failure */
 unsigned char tblcf_resynchronize(int dev) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	usb_data[0]=1;	 /* get 1 byte */
 	usb_data[1]=CMD_TBLCF_TARGET_RESYNCHRONIZE;
 	tblcf_usb_recv_ep0(dev, usb_data);
@@ -60,6 +59,7 @@ unsigned char tblcf_resynchronize(int dev) {
 /* asserts the TA signal for the specified time (in 10us ticks) */
 /* returns 0 on success and non-zero on failure */
 unsigned char tblcf_assert_ta(int dev, unsigned char duration_10us) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	usb_data[0]=1;	 /* get 1 byte */
 	usb_data[1]=CMD_TBLCF_TARGET_ASSERT_TA;
 	usb_data[2]=duration_10us;
@@ -71,6 +71,7 @@ unsigned char tblcf_assert_ta(int dev, unsigned char duration_10us) {
 /* JTAG - go from RUN-TEST/IDLE to SHIFT-DR or SHIFT-IR state */
 /* returns 0 on success and non-zero on failure */
 unsigned char tblcf_jtag_sel_shift(int dev, unsigned char mode) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	usb_data[0]=1;	 /* get 1 byte */
 	usb_data[1]=CMD_JTAG_GOTOSHIFT;
 	usb_data[2]=mode;
@@ -82,6 +83,7 @@ unsigned char tblcf_jtag_sel_shift(int dev, unsigned char mode) {
 /* JTAG - go from RUN-TEST/IDLE to TEST-LOGIC-RESET state */
 /* returns 0 on success and non-zero on failure */
 unsigned char tblcf_jtag_sel_reset(int dev) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	usb_data[0]=1;	 /* get 1 byte */
 	usb_data[1]=CMD_JTAG_GOTORESET;
 	tblcf_usb_recv_ep0(dev, usb_data);
@@ -93,6 +95,7 @@ unsigned char tblcf_jtag_sel_reset(int dev) {
 /* parameter exit: ==0 : stay in SHIFT-xx, !=0 : go to RUN-TEST/IDLE when done */
 /* data: shifted in LSB (last byte) first, unused bits (if any) are in the MSB (first) byte */
 void tblcf_jtag_write(int dev, unsigned char bit_count, unsigned char exit, unsigned char *buffer) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	int i;
 	usb_data[0]=(bit_count>>3)+((bit_count&0x07)!=0)+3;	 /* send all data bits & 3 more bytes */
 	usb_data[1]=CMD_JTAG_WRITE;
@@ -109,6 +112,7 @@ void tblcf_jtag_write(int dev, unsigned char bit_count, unsigned char exit, unsi
 /* data: shifted in LSB (last byte) first, unused bits (if any) are in the MSB (first) byte */
 /* returns 0 on success and non-zero on failure */
 unsigned char tblcf_jtag_read(int dev, unsigned char bit_count, unsigned char exit, unsigned char *buffer) {
+	unsigned char *usb_data = usb_devs[dev].usb_data;
 	int i;
 	usb_data[0]=(bit_count>>3)+((bit_count&0x07)!=0)+1;	 /* get all data bits & the status byte */
 	usb_data[1]=CMD_JTAG_READ;
@@ -27,7 +27,6 @@
 #define NULL '\0'
 #endif
 
-extern unsigned char usb_data[MAX_DATA_SIZE+2];
 
 /** Obtain a description of the hardware version
   *
@@ -65,6 +64,7 @@ const char *getHardwareDescription(unsigned int hardwareVersion) {
 }
 
 unsigned char usbdm_get_capabilities(bdmusb_dev* dev) {
+    unsigned char *usb_data = dev->usb_data;
     unsigned char return_value;
     bdm_print("USBDM_get_capabilities()\n");
 
@@ -95,6 +95,7 @@ unsigned char usbdm_get_capabilities(bdmusb_dev* dev) {
   *     other     => Error code - see \ref USBDM_ErrorCode
   */
 unsigned char usbdm_set_options(bdmusb_dev* dev) {
+    unsigned char *usb_data = dev->usb_data;
 
 //#ifdef LOG
    //bdmState.activityFlag = BDM_ACTIVE;
@@ -172,6 +173,7 @@ unsigned char usbdm_set_options(bdmusb_dev* dev) {
   *     other      => Error code - see \ref USBDM_ErrorCode
   */
 unsigned char usbdm_set_speed( bdmusb_dev* dev) {
+    unsigned char *usb_data = dev->usb_data;
    unsigned int value;
 
    //bdmState.activityFlag = BDM_ACTIVE;
@@ -221,6 +223,7 @@ unsigned char usbdm_set_speed( bdmusb_dev* dev) {
   *     other      => Error code - see \ref USBDM_ErrorCode
   */
 unsigned char usbdm_connect(int dev) {
+    unsigned char *usb_data = usb_devs[dev].usb_data;
     int ret_val;
 
     bdm_print("USBDM_CONNECT\n");
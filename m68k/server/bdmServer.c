@@ -30,6 +30,7 @@
  */
 
 #include <BDMlib.h>
+#include <bdmRemote.h>
 #include <ctype.h>
 #include <errno.h>
 #include <inttypes.h>
@@ -67,12 +68,13 @@ void xfree (char *p);
 /*
  * Local data.
  */
-static const char *version_string = "1.0.0";
+static const char *version_string = "1.1.0";
 static char       myname[MAXHOSTNAMELEN];
 static char       *current_host;
 static char       *current_addr;
 static char       *program_name;
 static int        debug = 0;
+static int        binary_mode = 0;
 
 /*
  * Define the messages between the client and the server.
@@ -88,6 +90,7 @@ enum bdm_message_id
   READ,
   WRITE,
   QUIT,
+  BINARY,
   INVALID
 };
 
@@ -106,7 +109,8 @@ struct bdm_message messages[] =
   { "IOIO",   IOIO},
   { "READ",   READ },
   { "WRITE",  WRITE },
-  { "QUIT",   QUIT }
+  { "QUIT",   QUIT },
+  { "BINARY", BINARY }
 };
 
 /*
@@ -141,7 +145,8 @@ static const int ioctl_code_table[] = {
   BDM_READ_CTLREG,
   BDM_WRITE_CTLREG,
   BDM_READ_DBREG,
-  BDM_WRITE_DBREG
+  BDM_WRITE_DBREG,
+  BDM_CLOCK_BENCH
 };
 
 /*
@@ -248,6 +253,59 @@ get_message (char *buf, int buf_len)
   }
 }
 
+/*
+ * Read exactly nbytes from the input handle.
+ */
+
+int
+get_bytes (unsigned char *buf, int nbytes)
+{
+  int got = 0;
+
+  while (got < nbytes) {
+    int ret = read (0, buf + got, nbytes - got);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if (ret == 0)
+      return 0;
+    got += ret;
+  }
+  return got;
+}
+
+/*
+ * Wait up to usecs for input.
+ */
+
+int
+input_wait (long usecs)
+{
+  struct timeval tv;
+  fd_set         readfds;
+
+  FD_ZERO (&readfds);
+  FD_SET (0, &readfds);
+
+  tv.tv_sec  = usecs / 1000000;
+  tv.tv_usec = usecs % 1000000;
+
+  return select (0 + 1, &readfds, 0, 0, &tv) > 0;
+}
+
+/*
+ * Is there more input waiting ? Used to hold replies back while a
+ * client has requests in flight.
+ */
+
+int
+input_pending (void)
+{
+  return input_wait (0);
+}
+
 /*
  * Decode the id to an ioctl number.
  *
@@ -310,7 +368,22 @@ helo (char *device)
     syslog (LOG_INFO, "open error: %s (%d), opening `%s'",
             bdmErrorString (), errno, device);
   }
-  printf ("HELO %d %s BDM server %s ready.", errno, myname, version_string);
+  printf ("HELO %d %s BDM server %s ready. %s",
+          errno, myname, version_string, BDM_REMOTE_BIN_CAPABILITY);
+}
+
+/*
+ * Switch to binary framing. The reply is the last text message.
+ */
+
+void
+binary (char *message)
+{
+  message += sizeof "BINARY";
+  binary_mode = strtoul (message, NULL, 0) != 0;
+  if (debug)
+    syslog (LOG_INFO, "binary mode: %s", binary_mode ? "on" : "off");
+  printf ("BINARY 0.");
 }
 
 /*
@@ -576,6 +649,232 @@ quit ()
   exit (0);
 }
 
+/*
+ * Log a failed frame request. The library does not always set errno,
+ * for example when the BDM is not open, and a frame with an error of 0
+ * is a success to the client.
+ */
+
+void
+frame_error (const char *label)
+{
+  if (!errno)
+    errno = EIO;
+  syslog (LOG_INFO, "%s error: %s (%d)", label, bdmErrorString (), errno);
+}
+
+/*
+ * Run a batch frame. The reply reuses the request payload.
+ */
+
+void
+frame_batch (bdm_remote_frame *frame, unsigned char *payload)
+{
+  struct BDMbatchOp *ops;
+  unsigned char     *p;
+  unsigned long     count = frame->arg[0];
+  unsigned long     op;
+
+  if ((count * BDM_REMOTE_BIN_BATCH_OP_SIZE) != frame->length) {
+    syslog (LOG_INFO, "batch error: bad count (%lu)", count);
+    errno = EINVAL;
+    frame->length = 0;
+    return;
+  }
+
+  ops = (struct BDMbatchOp*) xmalloc (count * sizeof (struct BDMbatchOp) + 1);
+
+  for (op = 0, p = payload; op < count; op++) {
+    ops[op].code        = decode_id (bdmRemoteGet32 (p));
+    ops[op].error       = -1;
+    ops[op].ioc.address = bdmRemoteGet32 (p + 8);
+    ops[op].ioc.value   = bdmRemoteGet32 (p + 12);
+    p += BDM_REMOTE_BIN_BATCH_OP_SIZE;
+  }
+
+  errno = 0;
+  if (bdmExecBatch (ops, count) < 0)
+    frame_error ("batch");
+
+  for (op = 0, p = payload; op < count; op++) {
+    bdmRemotePut32 (p + 4, ops[op].error);
+    bdmRemotePut32 (p + 8, ops[op].ioc.address);
+    bdmRemotePut32 (p + 12, ops[op].ioc.value);
+    p += BDM_REMOTE_BIN_BATCH_OP_SIZE;
+  }
+
+  xfree ((char*) ops);
+}
+
+/*
+ * Watch the target for the client. The status is polled every
+ * WATCH_POLL_USECS until a bit of the mask is set or the client sends
+ * another request.
+ */
+
+#define WATCH_POLL_USECS (1000)
+
+void
+frame_watch (bdm_remote_frame *frame)
+{
+  unsigned long mask = frame->arg[0];
+  int           status;
+
+  fflush (stdout);
+
+  while (1) {
+    errno = 0;
+    status = bdmStatus ();
+    if (status < 0) {
+      frame_error ("watch");
+      status = 0;
+      break;
+    }
+    if ((status & mask) || input_wait (WATCH_POLL_USECS))
+      break;
+  }
+
+  frame->arg[0] = status;
+  frame->length = 0;
+}
+
+/*
+ * Process binary frames until the client quits or the link drops. The
+ * replies are buffered while more requests are waiting so a pipelined
+ * client gets them in as few segments as possible.
+ *
+ * Once a READ or WRITE fails the target address pointer is unknown so
+ * any READ or WRITE already in flight is failed with the same error
+ * until the client issues an ioctl.
+ */
+
+void
+process_frames (void)
+{
+  unsigned char    *buf;
+  unsigned char    *payload;
+  bdm_remote_frame frame;
+  int              stream_error = 0;
+  int              code;
+  int              var;
+  struct BDMioctl  ioc;
+  long             nbytes;
+
+  buf = (unsigned char*) xmalloc (BDM_REMOTE_BIN_HDR_SIZE +
+                                  BDM_REMOTE_BIN_MAX_PAYLOAD);
+  payload = buf + BDM_REMOTE_BIN_HDR_SIZE;
+
+  while (1) {
+    if (!input_pending ())
+      fflush (stdout);
+
+    if (get_bytes (buf, BDM_REMOTE_BIN_HDR_SIZE) <= 0)
+      break;
+
+    bdmRemoteFrameUnpack (buf, &frame);
+
+    if (debug > 1)
+      syslog (LOG_INFO, "frame: op:%d id:%d len:%lu",
+              frame.op, frame.id, frame.length);
+
+    if (frame.length > BDM_REMOTE_BIN_MAX_PAYLOAD) {
+      syslog (LOG_INFO, "frame error: payload too big (%lu)", frame.length);
+      break;
+    }
+
+    if (frame.length && (get_bytes (payload, frame.length) <= 0))
+      break;
+
+    errno = 0;
+
+    switch (frame.op) {
+      case BDM_REMOTE_BIN_IOINT:
+        stream_error = 0;
+        var = frame.arg[1];
+        code = decode_id (frame.arg[0]);
+        if ((code == -1) || (bdmIoctlInt (code, &var) < 0))
+          frame_error ("ioint");
+        frame.arg[1] = var;
+        frame.length = 0;
+        break;
+
+      case BDM_REMOTE_BIN_IOCMD:
+        stream_error = 0;
+        code = decode_id (frame.arg[0]);
+        if ((code == -1) || (bdmIoctlCommand (code) < 0))
+          frame_error ("iocmd");
+        frame.length = 0;
+        break;
+
+      case BDM_REMOTE_BIN_IOIO:
+        stream_error = 0;
+        ioc.address = frame.arg[1];
+        ioc.value   = frame.arg[2];
+        code = decode_id (frame.arg[0]);
+        if ((code == -1) || (bdmIoctlIo (code, &ioc) < 0))
+          frame_error ("ioio");
+        frame.arg[1] = ioc.address;
+        frame.arg[2] = ioc.value;
+        frame.length = 0;
+        break;
+
+      case BDM_REMOTE_BIN_READ:
+        nbytes = frame.arg[0];
+        if (nbytes > BDM_REMOTE_BIN_MAX_PAYLOAD)
+          nbytes = BDM_REMOTE_BIN_MAX_PAYLOAD;
+        if (stream_error)
+          errno = stream_error;
+        else if (bdmRead (payload, nbytes) < 0) {
+          frame_error ("read");
+          stream_error = errno;
+        }
+        frame.length = errno ? 0 : nbytes;
+        frame.arg[0] = frame.length;
+        break;
+
+      case BDM_REMOTE_BIN_WRITE:
+        if (stream_error)
+          errno = stream_error;
+        else if (bdmWrite (payload, frame.length) < 0) {
+          frame_error ("write");
+          stream_error = errno;
+        }
+        frame.arg[0] = errno ? 0 : frame.length;
+        frame.length = 0;
+        break;
+
+      case BDM_REMOTE_BIN_BATCH:
+        stream_error = 0;
+        frame_batch (&frame, payload);
+        break;
+
+      case BDM_REMOTE_BIN_WATCH:
+        stream_error = 0;
+        frame_watch (&frame);
+        break;
+
+      case BDM_REMOTE_BIN_QUIT:
+        xfree ((char*) buf);
+        quit ();
+        break;
+
+      default:
+        syslog (LOG_INFO, "frame error: invalid op (%d)", frame.op);
+        errno = EINVAL;
+        frame.length = 0;
+        break;
+    }
+
+    frame.error = errno;
+
+    bdmRemoteFramePack (buf, &frame);
+    fwrite (buf, 1, BDM_REMOTE_BIN_HDR_SIZE + frame.length, stdout);
+  }
+
+  fflush (stdout);
+  xfree ((char*) buf);
+}
+
 /*
  * Process a message.
  */
@@ -618,6 +917,10 @@ process_message (char *message, int msg_len, int msg_buf_len)
       quit ();
       break;
 
+    case BINARY:
+      binary (message);
+      break;
+
     default:
       break;
   }
@@ -761,6 +1064,11 @@ main (int argc, char **argv)
       process_message (buf, cread, BDM_SERVER_BUF_SIZE);
 
       fflush (stdout);
+
+      if (binary_mode) {
+        process_frames ();
+        break;
+      }
     }
   }
 
@@ -0,0 +1,666 @@
+/*
+ * A microbenchmark for the BDM library.
+ *
+ * Times each of the library's target operations against any device
+ * bdmOpen accepts and writes the results as JSON, so pods, interfaces
+ * and library versions can be compared.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <sys/types.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#if !defined (__MINGW32__)
+#include <sys/time.h>
+#endif
+
+#include <BDMlib.h>
+
+/*
+ * Where the memory and run tests work when -a is not given. It is the
+ * SRAM the test programs use on a ColdFire. There is no common RAM
+ * address on a CPU32 so those targets need -a.
+ */
+#define BENCH_CF_SRAM  0x20000000
+
+/*
+ * A test gives up after this many errors in a row. It is most likely
+ * an operation the target or interface does not support.
+ */
+#define BENCH_MAX_ERRORS 8
+
+/*
+ * The loop the run tests execute, "bra.s *".
+ */
+#define BENCH_LOOP_OPCODE 0x60fe
+
+static const unsigned long bench_sizes[] = {
+  1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024, 4096, 16384
+};
+
+static const unsigned long bench_aligns[] = { 0, 1, 2, 3 };
+
+#define BENCH_COUNT(_a) (sizeof (_a) / sizeof ((_a)[0]))
+#define BENCH_MAX_SWEEP 32
+
+/*
+ * The state shared by the tests.
+ */
+typedef struct {
+  int            cpu;
+  unsigned long  address;
+  int            have_address;
+  unsigned long  size;          /* bytes in a memory transfer */
+  unsigned long  align;         /* offset of a transfer from address */
+  unsigned char *buffer;
+  unsigned long  value;
+  int            iterations;
+  double         budget;        /* seconds a test may run for */
+} bench_t;
+
+/*
+ * A test. The setup and teardown calls are made once around the test
+ * and pre and post around every op, none of them are timed.
+ */
+typedef struct {
+  const char *name;
+  int         needs_address;
+  int         sized;
+  int (*setup) (bench_t *b);
+  int (*pre) (bench_t *b);
+  int (*op) (bench_t *b);
+  int (*post) (bench_t *b);
+  int (*teardown) (bench_t *b);
+} bench_test_t;
+
+static const char *progname;
+static FILE       *out;
+static int         verbose;
+static int         results;
+static int         failed;
+static char      **only;
+static int         only_count;
+
+static void
+clean_exit (int exit_code)
+{
+  if (bdmIsOpen ()) {
+    bdmSetDriverDebugFlag (0);
+    bdmClose ();
+  }
+  exit (exit_code);
+}
+
+static void
+fatal (char *fmt, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", progname);
+  va_start (args, fmt);
+  vfprintf (stderr, fmt, args);
+  va_end (args);
+  clean_exit (1);
+}
+
+static double
+now_usecs (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv, NULL);
+  return (tv.tv_sec * 1000000.0) + tv.tv_usec;
+}
+
+/* write a string as a JSON string
+ */
+static void
+json_string (const char *s)
+{
+  fputc ('"', out);
+  for (; s && *s; s++) {
+    if ((*s == '"') || (*s == '\\'))
+      fprintf (out, "\\%c", *s);
+    else if ((unsigned char) *s < ' ')
+      fprintf (out, "\\u%04x", (unsigned char) *s);
+    else
+      fputc (*s, out);
+  }
+  fputc ('"', out);
+}
+
+/*
+ * The operations.
+ */
+
+static int
+op_reg_read (bench_t *b)
+{
+  return bdmReadRegister (BDM_REG_D0, &b->value);
+}
+
+static int
+op_reg_write (bench_t *b)
+{
+  return bdmWriteRegister (BDM_REG_D0, ++b->value);
+}
+
+static int
+op_sysreg_read (bench_t *b)
+{
+  return bdmReadSystemRegister (BDM_REG_RPC, &b->value);
+}
+
+static int
+setup_sysreg_write (bench_t *b)
+{
+  return bdmReadSystemRegister (BDM_REG_RPC, &b->value);
+}
+
+static int
+op_sysreg_write (bench_t *b)
+{
+  return bdmWriteSystemRegister (BDM_REG_RPC, b->value);
+}
+
+static int
+op_byte_read (bench_t *b)
+{
+  unsigned char c;
+  return bdmReadByte (b->address, &c);
+}
+
+static int
+op_word_read (bench_t *b)
+{
+  unsigned short s;
+  return bdmReadWord (b->address, &s);
+}
+
+static int
+op_long_read (bench_t *b)
+{
+  return bdmReadLongWord (b->address, &b->value);
+}
+
+static int
+op_byte_write (bench_t *b)
+{
+  return bdmWriteByte (b->address, (unsigned char) ++b->value);
+}
+
+static int
+op_word_write (bench_t *b)
+{
+  return bdmWriteWord (b->address, (unsigned short) ++b->value);
+}
+
+static int
+op_long_write (bench_t *b)
+{
+  return bdmWriteLongWord (b->address, ++b->value);
+}
+
+static int
+op_mem_read (bench_t *b)
+{
+  return bdmReadMemory (b->address + b->align, b->buffer, b->size);
+}
+
+static int
+op_mem_write (bench_t *b)
+{
+  return bdmWriteMemory (b->address + b->align, b->buffer, b->size);
+}
+
+/* Place the loop at the address and point the PC at it with the
+   interrupts masked.
+ */
+static int
+setup_loop (bench_t *b)
+{
+  if (bdmWriteWord (b->address, BENCH_LOOP_OPCODE) < 0)
+    return -1;
+  if (bdmWriteSystemRegister (BDM_REG_SR, 0x2700) < 0)
+    return -1;
+  return bdmWriteSystemRegister (BDM_REG_RPC, b->address);
+}
+
+static int
+pre_loop (bench_t *b)
+{
+  return bdmWriteSystemRegister (BDM_REG_RPC, b->address);
+}
+
+static int
+op_go (bench_t *b)
+{
+  return bdmGo ();
+}
+
+static int
+op_stop (bench_t *b)
+{
+  return bdmStop ();
+}
+
+static int
+op_step (bench_t *b)
+{
+  return bdmStep ();
+}
+
+static int
+op_status (bench_t *b)
+{
+  return bdmStatus ();
+}
+
+static int
+setup_running (bench_t *b)
+{
+  if (setup_loop (b) < 0)
+    return -1;
+  return bdmGo ();
+}
+
+static const bench_test_t bench_tests[] = {
+  { "reg-read",       0, 0, NULL, NULL, op_reg_read, NULL, NULL },
+  { "reg-write",      0, 0, NULL, NULL, op_reg_write, NULL, NULL },
+  { "sysreg-read",    0, 0, NULL, NULL, op_sysreg_read, NULL, NULL },
+  { "sysreg-write",   0, 0, setup_sysreg_write, NULL, op_sysreg_write, NULL,
+    NULL },
+  { "byte-read",      1, 0, NULL, NULL, op_byte_read, NULL, NULL },
+  { "word-read",      1, 0, NULL, NULL, op_word_read, NULL, NULL },
+  { "long-read",      1, 0, NULL, NULL, op_long_read, NULL, NULL },
+  { "byte-write",     1, 0, NULL, NULL, op_byte_write, NULL, NULL },
+  { "word-write",     1, 0, NULL, NULL, op_word_write, NULL, NULL },
+  { "long-write",     1, 0, NULL, NULL, op_long_write, NULL, NULL },
+  { "mem-read",       1, 1, NULL, NULL, op_mem_read, NULL, NULL },
+  { "mem-write",      1, 1, NULL, NULL, op_mem_write, NULL, NULL },
+  { "status",         0, 0, NULL, NULL, op_status, NULL, NULL },
+  { "go",             1, 0, setup_loop, pre_loop, op_go, op_stop, NULL },
+  { "stop",           1, 0, setup_loop, op_go, op_stop, NULL, NULL },
+  { "step",           1, 0, setup_loop, pre_loop, op_step, NULL, NULL },
+  { "status-running", 1, 0, setup_running, NULL, op_status, NULL, op_stop },
+};
+
+static int
+bench_selected (const char *name)
+{
+  int i;
+
+  if (!only_count)
+    return 1;
+  for (i = 0; i < only_count; i++)
+    if (strncmp (name, only[i], strlen (only[i])) == 0)
+      return 1;
+  return 0;
+}
+
+static int
+compare_samples (const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double
+percentile (double *samples, int count, double p)
+{
+  return samples[(int) (((count - 1) * p) + 0.5)];
+}
+
+/* Run a test and write its result object.
+ */
+static void
+bench_run (const bench_test_t *test, bench_t *b, double *samples)
+{
+  const char *error = NULL;
+  double      start;
+  double      total = 0;
+  double      sum = 0;
+  int         count = 0;
+  int         errors = 0;
+  int         in_a_row = 0;
+
+  if (test->setup && test->setup (b) < 0) {
+    error = bdmErrorString ();
+    errors++;
+  }
+  else {
+    start = now_usecs ();
+    while (count < b->iterations) {
+      double t0, t1;
+      int    rc;
+
+      if (test->pre && test->pre (b) < 0)
+        rc = -1;
+      else {
+        t0 = now_usecs ();
+        rc = test->op (b);
+        t1 = now_usecs ();
+        if (rc >= 0) {
+          samples[count++] = t1 - t0;
+          sum += t1 - t0;
+        }
+      }
+      if ((rc >= 0) && test->post && (test->post (b) < 0))
+        rc = -1;
+
+      if (rc < 0) {
+        if (!error)
+          error = bdmErrorString ();
+        errors++;
+        if (++in_a_row == BENCH_MAX_ERRORS)
+          break;
+      }
+      else
+        in_a_row = 0;
+
+      total = (now_usecs () - start) / 1000000.0;
+      if (total > b->budget)
+        break;
+    }
+  }
+  if (test->teardown)
+    test->teardown (b);
+
+  if (errors)
+    failed = 1;
+
+  fprintf (out, "%s\n    { \"name\": ", results++ ? "," : "");
+  json_string (test->name);
+  if (test->sized)
+    fprintf (out, ", \"size\": %lu, \"align\": %lu", b->size, b->align);
+  fprintf (out, ", \"count\": %d, \"errors\": %d", count, errors);
+  if (error) {
+    fprintf (out, ", \"error\": ");
+    json_string (error);
+  }
+
+  if (count) {
+    double seconds = sum / 1000000.0;
+    qsort (samples, count, sizeof (double), compare_samples);
+    fprintf (out, ",\n      \"seconds\": %.6f, \"ops_per_sec\": %.1f",
+             seconds, count / seconds);
+    if (test->sized)
+      fprintf (out, ", \"bytes_per_sec\": %.1f",
+               (count * (double) b->size) / seconds);
+    fprintf (out,
+             ",\n      \"latency_us\": { \"min\": %.1f, \"mean\": %.1f,"
+             " \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f }",
+             samples[0], sum / count,
+             percentile (samples, count, 0.50),
+             percentile (samples, count, 0.90),
+             percentile (samples, count, 0.99),
+             samples[count - 1]);
+
+    if (verbose) {
+      fprintf (stderr, "%-15s", test->name);
+      if (test->sized)
+        fprintf (stderr, " %6lu+%lu", b->size, b->align);
+      else
+        fprintf (stderr, "         ");
+      fprintf (stderr, " %7d ops %10.1f ops/s  p50 %8.1fus  p99 %8.1fus\n",
+               count, count / seconds,
+               percentile (samples, count, 0.50),
+               percentile (samples, count, 0.99));
+    }
+  }
+  else if (verbose)
+    fprintf (stderr, "%-15s failed: %s\n", test->name,
+             error ? error : "no result");
+  fprintf (out, " }");
+}
+
+/* parse a comma separated list of numbers
+ */
+static int
+parse_list (const char *opt, char *arg, unsigned long *list)
+{
+  int   count = 0;
+  char *end;
+
+  while (*arg) {
+    if (count == BENCH_MAX_SWEEP)
+      fatal ("-%s: more than %d values\n", opt, BENCH_MAX_SWEEP);
+    list[count++] = strtoul (arg, &end, 0);
+    if ((end == arg) || ((*end != ',') && (*end != '\0')))
+      fatal ("-%s: bad value '%s'\n", opt, arg);
+    arg = *end ? end + 1 : end;
+  }
+  return count;
+}
+
+static const char *
+processor_name (int cpu)
+{
+  switch (cpu) {
+    case BDM_CPU32:
+      return "cpu32";
+    case BDM_COLDFIRE:
+      return "coldfire";
+    case BDM_COLDFIRE_V1:
+      return "coldfire-v1";
+  }
+  return "unknown";
+}
+
+static void
+usage (void)
+{
+  printf ("%s [options] device\n"
+   " where :\n"
+   "    -a addr      : RAM the memory and run tests may use\n"
+   "                   (default 0x%x on a ColdFire)\n"
+   "    -n count     : operations per test (default 1000)\n"
+   "    -t secs      : most time a test may take (default 2)\n"
+   "    -s sizes     : memory transfer sizes, eg 1,4,256\n"
+   "    -l aligns    : memory transfer offsets, eg 0,1\n"
+   "    -x tests     : run the tests starting with these names, eg mem,go\n"
+   "    -o file      : write the JSON results to file\n"
+   "    -r           : reset the target first\n"
+   "    -d [level]   : enable driver debug output\n"
+   "    -D [delay]   : delay count for the clock generation\n"
+   "    -v           : show a summary of each test on stderr\n"
+   "    device       : the bdm device, eg /dev/bdmcf0 or sim:cf5282\n",
+   progname, BENCH_CF_SRAM);
+  exit (1);
+}
+
+int
+main (int argc, char **argv)
+{
+  bench_t        b;
+  unsigned long  sizes[BENCH_MAX_SWEEP];
+  unsigned long  aligns[BENCH_MAX_SWEEP];
+  int            size_count = 0;
+  int            align_count = 0;
+  unsigned long  largest = 0;
+  double        *samples;
+  char          *dev;
+  char          *output = NULL;
+  char          *tests = NULL;
+  int            reset = 0;
+  int            debug_level = 0;
+  int            delay_counter = 0;
+  unsigned int   ver = 0;
+  int            iface = -1;
+  int            opt;
+  int            t, s, a;
+
+  progname = argv[0];
+  memset (&b, 0, sizeof (b));
+  b.iterations = 1000;
+  b.budget = 2.0;
+
+  while ((opt = getopt (argc, argv, "a:n:t:s:l:x:o:rd:D:vh")) >= 0) {
+    switch (opt) {
+      case 'a':
+        b.address = strtoul (optarg, NULL, 0);
+        b.have_address = 1;
+        break;
+      case 'n':
+        b.iterations = strtoul (optarg, NULL, 0);
+        break;
+      case 't':
+        b.budget = strtod (optarg, NULL);
+        break;
+      case 's':
+        size_count = parse_list ("s", optarg, sizes);
+        break;
+      case 'l':
+        align_count = parse_list ("l", optarg, aligns);
+        break;
+      case 'x':
+        tests = optarg;
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'r':
+        reset = 1;
+        break;
+      case 'd':
+        debug_level = strtoul (optarg, NULL, 0);
+        break;
+      case 'D':
+        delay_counter = strtoul (optarg, NULL, 0);
+        break;
+      case 'v':
+        verbose = 1;
+        break;
+      default:
+        usage ();
+    }
+  }
+
+  if ((optind + 1) != argc)
+    usage ();
+  dev = argv[optind];
+
+  if (b.iterations < 1)
+    fatal ("-n must be at least 1\n");
+
+  if (!size_count) {
+    size_count = BENCH_COUNT (bench_sizes);
+    memcpy (sizes, bench_sizes, sizeof (bench_sizes));
+  }
+  if (!align_count) {
+    align_count = BENCH_COUNT (bench_aligns);
+    memcpy (aligns, bench_aligns, sizeof (bench_aligns));
+  }
+  for (s = 0; s < size_count; s++)
+    if (sizes[s] > largest)
+      largest = sizes[s];
+
+  if (tests) {
+    char *p;
+    only_count = 1;
+    for (p = tests; *p; p++)
+      if (*p == ',')
+        only_count++;
+    if (!(only = calloc (only_count, sizeof (char *))))
+      fatal ("out of memory\n");
+    only_count = 0;
+    for (p = strtok (tests, ","); p; p = strtok (NULL, ","))
+      only[only_count++] = p;
+  }
+
+  if (!(b.buffer = malloc (largest ? largest : 1)) ||
+      !(samples = malloc (b.iterations * sizeof (double))))
+    fatal ("out of memory\n");
+  for (s = 0; s < largest; s++)
+    b.buffer[s] = (unsigned char) s;
+
+  if (output) {
+    if (!(out = fopen (output, "w")))
+      fatal ("%s: %s\n", output, strerror (errno));
+  }
+  else
+    out = stdout;
+
+  if (bdmOpen (dev) < 0)
+    fatal ("open %s failed: %s\n", dev, bdmErrorString ());
+
+  if (debug_level)
+    bdmSetDriverDebugFlag (debug_level);
+
+  if (delay_counter)
+    bdmSetDelay (delay_counter);
+
+  if (bdmGetProcessor (&b.cpu) < 0)
+    fatal ("GetProcessor failed: %s\n", bdmErrorString ());
+  bdmGetDrvVersion (&ver);
+  bdmGetInterface (&iface);
+
+  if (!b.have_address &&
+      ((b.cpu == BDM_COLDFIRE) || (b.cpu == BDM_COLDFIRE_V1))) {
+    b.address = BENCH_CF_SRAM;
+    b.have_address = 1;
+  }
+  if (!b.have_address && verbose)
+    fprintf (stderr, "no RAM address (-a), memory and run tests skipped\n");
+
+  if (reset && (bdmReset () < 0))
+    fatal ("reset failed: %s\n", bdmErrorString ());
+
+  fprintf (out, "{\n  \"tool\": \"bdm-bench\",\n  \"version\": ");
+  json_string (PACKAGE_VERSION);
+  fprintf (out, ",\n  \"time\": %lu,\n  \"device\": ", (unsigned long) time (NULL));
+  json_string (dev);
+  fprintf (out, ",\n  \"processor\": ");
+  json_string (processor_name (b.cpu));
+  fprintf (out, ",\n  \"interface\": %d,\n  \"driver_version\": \"%u.%u\",\n",
+           iface, ver >> 8, ver & 0xff);
+  if (b.have_address)
+    fprintf (out, "  \"address\": %lu,\n", b.address);
+  fprintf (out, "  \"iterations\": %d,\n  \"budget_secs\": %.3f,\n"
+           "  \"results\": [", b.iterations, b.budget);
+
+  for (t = 0; t < BENCH_COUNT (bench_tests); t++) {
+    const bench_test_t *test = &bench_tests[t];
+
+    if (!bench_selected (test->name))
+      continue;
+    if (test->needs_address && !b.have_address)
+      continue;
+
+    if (!test->sized)
+      bench_run (test, &b, samples);
+    else {
+      for (s = 0; s < size_count; s++) {
+        for (a = 0; a < align_count; a++) {
+          b.size = sizes[s];
+          b.align = aligns[a];
+          bench_run (test, &b, samples);
+        }
+      }
+    }
+    fflush (out);
+  }
+
+  fprintf (out, "\n  ]\n}\n");
+  if (out != stdout)
+    fclose (out);
+
+  clean_exit (failed ? 2 : 0);
+  return 0;
+}
@@ -31,6 +31,11 @@
 #include <string.h>
 #include <stdint.h>
 #include <time.h>
+#if !defined (__MINGW32__)
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#endif
 
 #include <elf-utils.h>
 
@@ -50,6 +55,7 @@ static void do_command (size_t argc, char **argv);
 #endif
 
 static int verify;
+static int differential;
 static int verbosity = 1;
 static int delay = 0;
 static int debug_driver = 0;
@@ -72,6 +78,13 @@ static int num_vars = 0;
 static int loaded_elf_cnt = 0;
 static elf_handle *loaded_elfs = NULL;
 
+/* gang mode: the script runs on each of these devices in parallel
+ */
+static char **gang_dev = NULL;
+static int gang_cnt = 0;
+static char **gang_lines = NULL;
+static int gang_line_cnt = 0;
+
 static void
 wait_here (int msecs)
 {
@@ -518,6 +531,20 @@ write_memory (uint32_t adr, unsigned char *buf, uint32_t cnt)
   return cnt;
 }
 
+uint32_t
+write_memory_diff (uint32_t adr, unsigned char *buf, uint32_t cnt,
+                   flash_diff_t *stats)
+{
+  memset (stats, 0, sizeof (*stats));
+  return write_memory (adr, buf, cnt);
+}
+
+int
+flash_crc32_verify (uint32_t adr, unsigned char *data, uint32_t cnt)
+{
+  return -1;
+}
+
 int
 flash_plugin (uint32_t adr, uint32_t len, char *argv[])
 {
@@ -615,6 +642,45 @@ check_one_register (char *regname)
     printf(" %s", regname);
 }
 
+/* Verify a loaded section. The CRC plugin is used when it has been
+   loaded with flash-plugin, so only a checksum has to travel over the
+   BDM link. Without it the contents are read back and compared.
+ */
+static int
+verify_section (uint32_t paddr, unsigned char *data, uint32_t size)
+{
+  unsigned char rbuf[4 * 1024];
+  uint32_t off;
+  unsigned int cnt;
+
+  switch (flash_crc32_verify (paddr, data, size)) {
+    case 1:
+      return 1;
+    case 0:
+      if (verbosity)
+        printf ("\b\bFAIL\n");
+      warn ("%sCRC of contents from 0x%08lx with size %x don't match\n",
+            verbosity ? "" : "\n", paddr, size);
+      return 0;
+  }
+
+  for (off = 0; off < size; off += cnt) {
+    cnt = size - off;
+    if (cnt > sizeof (rbuf))
+      cnt = sizeof (rbuf);
+    read_memory (paddr + off, rbuf, cnt);
+    if (memcmp (data + off, rbuf, cnt)) {
+      if (verbosity)
+        printf ("\b\bFAIL\n");
+      warn ("%sRead back contents from 0x%08lx with size %x don't match\n",
+            verbosity ? "" : "\n", paddr + off, cnt);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
 /* load a bfd section into target
  */
 
@@ -657,7 +723,33 @@ load_section (elf_handle * elf, GElf_Phdr * phdr, GElf_Shdr * shdr,
       return 0;
     }
 
-    for (off = 0; off < shdr->sh_size; off += cnt) {
+    /* In differential mode the whole section is handed to the flash
+       layer so it can compare and erase complete sectors.
+     */
+    if (differential) {
+      flash_diff_t stats;
+      uint32_t ret;
+
+      ret = write_memory_diff (paddr, data, shdr->sh_size, &stats);
+      if (ret != shdr->sh_size) {
+        if (verbosity)
+          printf ("\b\bFAIL\n");
+        warn ("%swrite_memory_diff(0x%x, xxx, 0x%x)==0x%x failed\n",
+              verbosity ? "" : "\n", paddr, shdr->sh_size, ret);
+        return 0;
+      }
+
+      if (verify && !verify_section (paddr, data, shdr->sh_size))
+        return 0;
+
+      if (verbosity)
+        printf ("\b\b\b\b\b\b\b\b\b\b\b\b\b\b0x%08x: OK"
+                " (same:%u programmed:%u erased:%u)\n",
+                (unsigned int) shdr->sh_size, stats.same,
+                stats.programmed, stats.erased);
+    }
+
+    for (off = 0; !differential && off < shdr->sh_size; off += cnt) {
       int ret;
 
       cnt = shdr->sh_size - off;
@@ -675,24 +767,16 @@ load_section (elf_handle * elf, GElf_Phdr * phdr, GElf_Shdr * shdr,
         return 0;
       }
 
-      if (verify) {
-        read_memory (paddr + off, rbuf, cnt);
-        if (memcmp (data + off, rbuf, cnt)) {
-          if (verbosity)
-            printf ("\b\bFAIL\n");
-          warn ("%sRead back contents from 0x%08lx with size %x don't match\n",
-                verbosity ? "" : "\n", paddr + off, cnt);
-          return 0;
-        }
-      }
-
       if (verbosity) {
         printf ("\b\b\b\b\b\b\b\b\b\b\b\b\b\b0x%08x: OK", off + cnt);
         fflush (stdout);
       }
     }
 
-    if (verbosity && off >= shdr->sh_size)
+    if (!differential && verify && !verify_section (paddr, data, shdr->sh_size))
+      return 0;
+
+    if (verbosity && !differential && off >= shdr->sh_size)
       printf ("\n");
 
     if (cpu_type == BDM_CPU32) {
@@ -1013,36 +1097,54 @@ static void
 cmd_load (size_t argc, char **argv)
 {
   elf_handle elf;
+  int i;
 
   if (verbosity)
     printf ("\n");
 
   verify = 0;
-  if (STREQ (argv[1], "-v")) {
-    verify = 1;
+  differential = 0;
+  while (argc > 1 && argv[1][0] == '-') {
+    if (STREQ (argv[1], "-v"))
+      verify = 1;
+    else if (STREQ (argv[1], "-d"))
+      differential = 1;
+    else
+      fatal ("Unknown load option %s\n", argv[1]);
+    argc--;
     argv++;
   }
 
   if (argc < 2)
     fatal ("Wrong number of arguments\n");
 
-  elf_handle_init (&elf);
-
-  if (!elf_open (argv[1], &elf, printf)) {
-    warn ("can not open %s: %s\n", argv[1], strerror (errno));
-    return;
-  }
-
   /* FIXME: loading a file multiple times should not open it again. Only
      the search order for the symbols should be adjusted. The question is
      how to distinguish foo/bar from foo/baz/../bar. On unix, dev/inode
      could be used for this. But how to do it on windows?
+     For now a file opened under the same name is reused, which is also
+     how gang mode hands the images it read before forking to the targets.
    */
-  if (!(loaded_elfs = realloc (loaded_elfs,
-                               (loaded_elf_cnt + 1) * sizeof (elf_handle))))
-    fatal ("Out of memory\n");
+  for (i = 0; i < loaded_elf_cnt; i++)
+    if (STREQ (loaded_elfs[i].file, argv[1]))
+      break;
+
+  if (i < loaded_elf_cnt)
+    elf = loaded_elfs[i];
+  else {
+    elf_handle_init (&elf);
 
-  loaded_elfs[loaded_elf_cnt++] = elf;
+    if (!elf_open (argv[1], &elf, printf)) {
+      warn ("can not open %s: %s\n", argv[1], strerror (errno));
+      return;
+    }
+
+    if (!(loaded_elfs = realloc (loaded_elfs,
+                                 (loaded_elf_cnt + 1) * sizeof (elf_handle))))
+      fatal ("Out of memory\n");
+
+    loaded_elfs[loaded_elf_cnt++] = elf;
+  }
 
   elf_map_over_sections (&elf, load_section, argv[2]);
 
@@ -1157,13 +1259,20 @@ cmd_reset (size_t argc, char *argv[])
     printf ("OK\n");
 }
 
+/* poll function for cmd_wait, ends on an error as well
+ */
+static int
+wait_poll (void *arg)
+{
+  return bdmStatus () & (BDM_TARGETSTOPPED | BDM_TARGETHALT);
+}
+
 /* Wait until target is stopped or hlated
  */
 static void
 cmd_wait (size_t argc, char **argv)
 {
-  while (!((bdmStatus ()) & (BDM_TARGETSTOPPED | BDM_TARGETHALT)))
-    wait_here (250);
+  bdmPollWait (wait_poll, NULL, -1);
 
   if (verbosity)
     printf ("OK\n");
@@ -1177,6 +1286,19 @@ cmd_time (size_t argc, char **argv)
   printf (" %ld seconds\n", time(NULL) - base_time);
 }
 
+/* measure the serial clock rate of a bit-banged interface
+ */
+static void
+cmd_bench_clock (size_t argc, char **argv)
+{
+  unsigned long bps;
+
+  if (bdmClockBench (&bps) < 0)
+    fatal ("bdmClockBench (): %s\n", bdmErrorString ());
+
+  printf (" %lu bits/sec, %lu frames/sec\n", bps, bps / 17);
+}
+
 /* sleep for a while
  */
 static void
@@ -1427,12 +1549,20 @@ static struct command_s {
   { "write-ctrl",      "DST VAL",             1, 3,       3, cmd_write_ctrl,
     "Write a VAL to destination control register DST.\n"
   },    
-  { "load",            "[-v] FN [SEC ...]",   1, 2, INT_MAX, cmd_load,
+  { "load",          "[-v] [-d] FN [SEC ...]", 1, 2, INT_MAX, cmd_load,
     "Load object file FN into the target.  Only the specified sections are\n"
     "loaded.  When no sections are specified, only sections with the\n"
     "SEC_LOAD flag are loaded.  If FN has an entry address specified, %rpc\n"
     "is set to this address.  With the -v flag, the written contents are\n"
-    "read back and verified.\n"
+    "verified.  When the flashcrc plugin has been loaded with flash-plugin\n"
+    "a CRC is computed on the target, otherwise the contents are read back.\n"
+    "With the -d flag, flash is written differentially.  Each flash sector\n"
+    "is read back and only sectors that differ are programmed, erasing\n"
+    "them first when needed.  Data in a sector outside the sections is\n"
+    "kept.  Intel chips know their sectors, for other chips set the\n"
+    "FLASH_SECTOR_SIZE variable to the uniform sector or page size.\n"
+    "Erases on separate flash chips run at the same time, and a chip that\n"
+    "is done erasing is programmed while the others are still erasing.\n"
     "After the load, the symbols from the loaded file are known to the\n"
     "commands which can deal with symbols.\n"
     "Please note that s-record and intel-hex don't have section names.  In\n"
@@ -1467,6 +1597,10 @@ static struct command_s {
   { "time",            "",                    0, 1,       1, cmd_time,
     "Print seconds since bdmctrl was started.\n"
   },
+  { "bench-clock",     "",                    1, 1,       1, cmd_bench_clock,
+    "Clock NOP frames through a parallel port interface and print the\n"
+    "serial bit rate.  USB pods clock frames in the pod and fail.\n"
+  },
   { "echo",            "[ARG ...]",           0, 1, INT_MAX, cmd_echo,
     "Print a line of text.\n"
   },
@@ -1500,6 +1634,8 @@ static struct command_s {
     "file(s) FN.\n"
     "ADR and LEN define a memory region on the target that can be used as\n"
     "temporary memory to download driver and flash contents.\n"
+    "The flashcrc plugin is not a flash driver, it is used by 'load -v'\n"
+    "to verify the written contents on the target.\n"
   },
   { "flash",           "ADR [DRIVER]",        1, 2,       3, cmd_flash,
     "Autodetect flash chip(s) on ADR.  Currently only 29Fxxx and 49Fxxx\n"
@@ -1575,6 +1711,9 @@ usage (char *progname, char *fmt, ...)
            "   -D <delay> Delay count for BDM clock generation (default=0).\n"
            "   -c <cmd>   Split <cmd> into args and execute resulting command.\n"
            "   -f         Turn warnings into fatal errors.\n"
+           "   -g <devs>  Gang mode, run the script on each device of the\n"
+           "              comma separated list <devs> in parallel. The device\n"
+           "              is passed as the first script argument.\n"
            "\n" " available commands are:\n", progname);
 
   for (i = 0; i < NUMOF (command); i++) {
@@ -1600,6 +1739,362 @@ help_command (char *progname, char *cmd)
   usage (progname, "unknown command '%s'.\n", cmd);
 }
 
+/* Gang mode. The script is read once and run on every gang device at
+   the same time, each in a child process of its own with the device
+   passed to the script as $1. ELF files the script loads are opened
+   before forking so the children share one copy of each image. The
+   output of every child is prefixed with its device and a pass/fail
+   report is printed once all of them are done.
+ */
+
+/* split a comma separated list of devices
+ */
+static void
+gang_add (char *list)
+{
+  char *dev;
+
+  for (dev = strtok (list, ","); dev; dev = strtok (NULL, ",")) {
+    if (!(gang_dev = realloc (gang_dev, (gang_cnt + 1) * sizeof (char *))) ||
+        !(gang_dev[gang_cnt++] = strdup (dev)))
+      fatal ("Out of memory\n");
+  }
+}
+
+static void
+gang_add_line (const char *line)
+{
+  if (!(gang_lines = realloc (gang_lines,
+                              (gang_line_cnt + 1) * sizeof (char *))) ||
+      !(gang_lines[gang_line_cnt++] = strdup (line)))
+    fatal ("Out of memory\n");
+}
+
+/* read the script into memory, comments stripped as cmd_source does
+ */
+static void
+gang_read_script (const char *name)
+{
+  char buf[1024];
+  FILE *file = stdin;
+
+  if (name && !(file = fopen (name, "r")))
+    fatal ("%s: %s: %s\n", progname, name, strerror (errno));
+
+  while (fgets (buf, 1020, file)) {
+    char *p;
+
+    buf[1020] = 0;
+    if ((p = strchr (buf, '\n')))
+      *p = 0;
+    if ((p = strchr (buf, '#')))
+      *p = 0;
+    gang_add_line (buf);
+  }
+
+  if (file != stdin)
+    fclose (file);
+}
+
+#if !defined (__MINGW32__)
+
+/* The script arguments of a target, the device inserted as $1.
+ */
+static char **
+gang_argv (int target, size_t glbl_argc, char **glbl_argv, size_t *ac)
+{
+  char **av;
+  size_t i;
+
+  if (!(av = malloc ((glbl_argc + 3) * sizeof (char *))))
+    fatal ("Out of memory\n");
+  *ac = 0;
+  av[(*ac)++] = glbl_argv[0];
+  av[(*ac)++] = glbl_argv[1];
+  av[(*ac)++] = gang_dev[target];
+  for (i = 2; i < glbl_argc; i++)
+    av[(*ac)++] = glbl_argv[i];
+  av[*ac] = NULL;
+  return av;
+}
+
+/* the children report files that cannot be opened
+ */
+static int
+gang_quiet (const char *format, ...)
+{
+  return 0;
+}
+
+/* Open the files named by "load" commands. Only names that are literal
+   or use the script arguments can be resolved here, anything else is
+   left to the children.
+ */
+static void
+gang_preload (size_t glbl_argc, char **glbl_argv)
+{
+  char **av;
+  size_t ac;
+  int l;
+
+  av = gang_argv (0, glbl_argc, glbl_argv, &ac);
+
+  for (l = 0; l < gang_line_cnt; l++) {
+    char *dup, *tok, *p, *file;
+    elf_handle elf;
+    int i;
+
+    if (!(dup = strdup (gang_lines[l])))
+      fatal ("Out of memory\n");
+
+    tok = strtok (dup, " \t");
+    if (tok && STREQ (tok, "load")) {
+      tok = strtok (NULL, " \t");
+      while (tok && (tok[0] == '-'))
+        tok = strtok (NULL, " \t");
+    }
+    else
+      tok = NULL;
+
+    /* $2 and friends only, a $1 would name the first device
+     */
+    for (p = tok ? strchr (tok, '$') : NULL; p; p = strchr (p + 1, '$')) {
+      size_t varnum;
+      if (!isdigit (p[1]))
+        break;
+      varnum = strtol (p + 1, NULL, 0);
+      if (varnum < 2 || varnum >= ac - 1)
+        break;
+    }
+
+    if (!tok || p) {
+      free (dup);
+      continue;
+    }
+
+    if (!(file = varstrdup (tok, ac - 1, av + 1)))
+      fatal ("Out of memory\n");
+    free (dup);
+
+    for (i = 0; i < loaded_elf_cnt; i++)
+      if (STREQ (loaded_elfs[i].file, file))
+        break;
+
+    if (i == loaded_elf_cnt) {
+      elf_handle_init (&elf);
+      if (elf_open (file, &elf, gang_quiet)) {
+        if (!(loaded_elfs = realloc (loaded_elfs,
+                                     (loaded_elf_cnt + 1) * sizeof (elf_handle))))
+          fatal ("Out of memory\n");
+        loaded_elfs[loaded_elf_cnt++] = elf;
+        if (verbosity)
+          printf ("gang: read %s\n", file);
+      }
+    }
+
+    free (file);
+  }
+
+  free (av);
+}
+
+/* The child side: run the script on one device.
+ */
+static void
+gang_child (int target, size_t glbl_argc, char **glbl_argv)
+{
+  char **av;
+  size_t ac;
+  int l;
+
+  av = gang_argv (target, glbl_argc, glbl_argv, &ac);
+
+  for (l = 0; l < gang_line_cnt; l++)
+    exec_line (gang_lines[l], ac, av);
+
+  clean_exit (EXIT_SUCCESS);
+}
+
+typedef struct
+{
+  pid_t pid;
+  int fd;
+  int status;
+  time_t start;
+  time_t end;
+  struct timeval shown;   /* when the partial line was last shown */
+  char line[1024];
+  size_t len;
+} gang_target_t;
+
+/* print a line of a target's output
+ */
+static void
+gang_show (int target, gang_target_t *t, int partial)
+{
+  printf ("[%s] %.*s%s\n", gang_dev[target], (int) t->len, t->line,
+          partial ? " ..." : "");
+  fflush (stdout);
+  gettimeofday (&t->shown, NULL);
+}
+
+/* Collect the output of a target. Backspaces rewind the line so the
+   progress counters end up as one line. A line still being written is
+   shown once a second so the progress streams.
+ */
+static void
+gang_output (int target, gang_target_t *t, const char *buf, ssize_t cnt)
+{
+  struct timeval now;
+  ssize_t i;
+
+  for (i = 0; i < cnt; i++) {
+    if (buf[i] == '\n') {
+      gang_show (target, t, 0);
+      t->len = 0;
+    } else if (buf[i] == '\b') {
+      if (t->len)
+        t->len--;
+    } else {
+      if (t->len == sizeof (t->line)) {
+        gang_show (target, t, 1);
+        t->len = 0;
+      }
+      t->line[t->len++] = buf[i];
+    }
+  }
+
+  gettimeofday (&now, NULL);
+  if (t->len && (now.tv_sec - t->shown.tv_sec) > 1)
+    gang_show (target, t, 1);
+}
+
+static void
+gang_run (size_t glbl_argc, char **glbl_argv)
+{
+  gang_target_t *targets;
+  int running = 0;
+  int failed = 0;
+  int target;
+
+  if (!(targets = calloc (gang_cnt, sizeof (gang_target_t))))
+    fatal ("Out of memory\n");
+
+  gang_preload (glbl_argc, glbl_argv);
+  fflush (stdout);
+  fflush (stderr);
+
+  for (target = 0; target < gang_cnt; target++) {
+    gang_target_t *t = &targets[target];
+    int pipefd[2];
+
+    if (pipe (pipefd) < 0)
+      fatal ("pipe: %s\n", strerror (errno));
+
+    t->start = time (NULL);
+    gettimeofday (&t->shown, NULL);
+    t->pid = fork ();
+    if (t->pid < 0)
+      fatal ("fork: %s\n", strerror (errno));
+
+    if (t->pid == 0) {
+      int null = open ("/dev/null", O_RDONLY);
+      int i;
+      for (i = 0; i < target; i++)
+        if (targets[i].fd >= 0)
+          close (targets[i].fd);
+      close (pipefd[0]);
+      dup2 (pipefd[1], STDOUT_FILENO);
+      dup2 (pipefd[1], STDERR_FILENO);
+      close (pipefd[1]);
+      if (null >= 0) {
+        dup2 (null, STDIN_FILENO);
+        close (null);
+      }
+      setvbuf (stdout, NULL, _IONBF, 0);
+      gang_child (target, glbl_argc, glbl_argv);
+    }
+
+    close (pipefd[1]);
+    t->fd = pipefd[0];
+    running++;
+  }
+
+  while (running) {
+    fd_set fds;
+    int maxfd = -1;
+
+    FD_ZERO (&fds);
+    for (target = 0; target < gang_cnt; target++) {
+      if (targets[target].fd >= 0) {
+        FD_SET (targets[target].fd, &fds);
+        if (targets[target].fd > maxfd)
+          maxfd = targets[target].fd;
+      }
+    }
+
+    if (select (maxfd + 1, &fds, NULL, NULL, NULL) < 0) {
+      if (errno == EINTR)
+        continue;
+      fatal ("select: %s\n", strerror (errno));
+    }
+
+    for (target = 0; target < gang_cnt; target++) {
+      gang_target_t *t = &targets[target];
+      char buf[512];
+      ssize_t cnt;
+
+      if (t->fd < 0 || !FD_ISSET (t->fd, &fds))
+        continue;
+
+      cnt = read (t->fd, buf, sizeof (buf));
+      if (cnt > 0) {
+        gang_output (target, t, buf, cnt);
+        continue;
+      }
+      if (cnt < 0 && errno == EINTR)
+        continue;
+
+      if (t->len)
+        gang_show (target, t, 0);
+      close (t->fd);
+      t->fd = -1;
+      waitpid (t->pid, &t->status, 0);
+      t->end = time (NULL);
+      running--;
+    }
+  }
+
+  printf ("\ngang: %d target%s\n", gang_cnt, gang_cnt == 1 ? "" : "s");
+  for (target = 0; target < gang_cnt; target++) {
+    gang_target_t *t = &targets[target];
+    int ok = WIFEXITED (t->status) && WEXITSTATUS (t->status) == EXIT_SUCCESS;
+
+    if (!ok)
+      failed++;
+    printf ("  %-24s %s", gang_dev[target], ok ? "PASS" : "FAIL");
+    if (WIFSIGNALED (t->status))
+      printf (" (signal %d)", WTERMSIG (t->status));
+    else if (!ok)
+      printf (" (exit %d)", WEXITSTATUS (t->status));
+    printf (" %lds\n", (long) (t->end - t->start));
+  }
+  printf ("gang: %d passed, %d failed\n", gang_cnt - failed, failed);
+
+  free (targets);
+  clean_exit (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+#else
+
+static void
+gang_run (size_t glbl_argc, char **glbl_argv)
+{
+  fatal ("%s: gang mode is not supported on this host\n", progname);
+}
+
+#endif
+
 int
 main (int argc, char *argv[])
 {
@@ -1612,7 +2107,7 @@ main (int argc, char *argv[])
 
   /* parse options
    */
-  while ((opt = getopt (argc, argv, "fd:D:v:h:c:")) >= 0) {
+  while ((opt = getopt (argc, argv, "fd:D:v:h:c:g:")) >= 0) {
     switch (opt) {
       case 'h':
         help_command (progname, optarg);
@@ -1627,9 +2122,15 @@ main (int argc, char *argv[])
         verbosity = strtol (optarg, NULL, 10);
         break;
       case 'c':
-        exec_line (optarg, 1, argv);
+        if (gang_cnt)
+          gang_add_line (optarg);
+        else
+          exec_line (optarg, 1, argv);
         need_stdin = 0;
         break;
+      case 'g':
+        gang_add (optarg);
+        break;
       case 'f':
         fatal_errors = 1;
         break;
@@ -1638,6 +2139,25 @@ main (int argc, char *argv[])
     }
   }
 
+  if (gang_cnt) {
+    /* Read the script once and run it on all the devices. The script
+       arguments follow the device, which is $1.
+     */
+    char *av[] = { "source", NULL };
+
+    if (optind < argc)
+      gang_read_script (argv[optind]);
+    else if (need_stdin)
+      gang_read_script (NULL);
+
+    if (optind < argc) {
+      optind--;
+      gang_run (argc - optind, argv + optind);
+    }
+    else
+      gang_run (1, av);
+  }
+
   if (optind < argc) {
     /* Non-option arguments are present, run "source" command on them
      */